@@ -0,0 +1,37 @@
+﻿#include "Stats.h"
+#include <cstdlib>
+#include <new>
+
+// the global operator new of the tools, counted for --stats; not a part of the library
+
+void* operator new(std::size_t size)
+{
+	CountAllocation();
+	if (size == 0)
+	{
+		size = 1;
+	}
+	while (true)
+	{
+		if (void* memory = std::malloc(size))
+		{
+			return memory;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+		{
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
@@ -0,0 +1,249 @@
+﻿#include "Alphabet.h"
+#include "Parallel.h"
+#include "Stats.h"
+#include <atomic>
+#include <unordered_map>
+
+namespace
+{
+// machines with fewer transitions than this are hashed and expanded on one thread
+const size_t PARALLEL_TRANSITIONS = 1 << 20;
+
+uint64_t Mix(uint64_t hash, uint64_t value)
+{
+	hash = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+	return hash ^ (hash >> 31);
+}
+
+bool SameColumns(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs, uint32_t stateCount,
+	uint32_t entryCount, uint32_t first, uint32_t second)
+{
+	for (size_t row = 0; row < size_t(stateCount) * entryCount; row += entryCount)
+	{
+		if (transitions[row + first] != transitions[row + second]
+			|| (outs && (*outs)[row + first] != (*outs)[row + second]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// the column hashes of every entry, a piece of the states per thread combined in order
+std::vector<uint64_t> HashColumns(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs,
+	uint32_t stateCount, uint32_t entryCount, unsigned threads)
+{
+	threads = (transitions.size() < PARALLEL_TRANSITIONS) ? 1 : ThreadCount(threads);
+	std::vector<uint64_t> pieceHashes(size_t(threads) * entryCount, 0);
+	ParallelFor(stateCount, threads, [&](size_t begin, size_t end, unsigned thread) {
+		uint64_t* hashes = pieceHashes.data() + size_t(thread) * entryCount;
+		for (size_t row = begin * entryCount; row < end * entryCount; row += entryCount)
+		{
+			for (uint32_t entry = 0; entry < entryCount; entry++)
+			{
+				uint64_t out = outs ? (*outs)[row + entry] : 0;
+				hashes[entry] = Mix(hashes[entry], uint64_t(transitions[row + entry]) << 32 | out);
+			}
+		}
+	});
+	std::vector<uint64_t> hashes(entryCount, 0);
+	for (size_t piece = 0; piece < pieceHashes.size(); piece += entryCount)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			hashes[entry] = Mix(hashes[entry], pieceHashes[piece + entry]);
+		}
+	}
+	return hashes;
+}
+
+// a class per distinct hash, trusting the hashes
+EntryClasses GroupByHashes(const std::vector<uint64_t>& hashes)
+{
+	EntryClasses entryClasses;
+	std::unordered_map<uint64_t, uint32_t> hashClasses;
+	for (uint64_t hash : hashes)
+	{
+		auto [found, added] = hashClasses.emplace(hash, ClassCount(entryClasses));
+		if (added)
+		{
+			entryClasses.representatives.push_back(static_cast<uint32_t>(entryClasses.classes.size()));
+		}
+		entryClasses.classes.push_back(found->second);
+	}
+	return entryClasses;
+}
+
+// true when every entry has the column of its representative, checked row by row
+bool MatchRepresentatives(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs,
+	uint32_t stateCount, const EntryClasses& entryClasses, unsigned threads)
+{
+	size_t entryCount = entryClasses.classes.size();
+	if (ClassCount(entryClasses) == entryCount)
+	{
+		return true;
+	}
+	threads = (transitions.size() < PARALLEL_TRANSITIONS) ? 1 : threads;
+	std::atomic<bool> match{ true };
+	ParallelFor(stateCount, threads, [&](size_t begin, size_t end, unsigned) {
+		bool pieceMatch = true;
+		for (size_t row = begin * entryCount; row < end * entryCount && pieceMatch; row += entryCount)
+		{
+			for (size_t entry = 0; entry < entryCount; entry++)
+			{
+				size_t representative = row + entryClasses.representatives[entryClasses.classes[entry]];
+				pieceMatch = pieceMatch && transitions[row + entry] == transitions[representative]
+					&& (!outs || (*outs)[row + entry] == (*outs)[representative]);
+			}
+		}
+		if (!pieceMatch)
+		{
+			match = false;
+		}
+	});
+	return match;
+}
+
+// classes with the same hash are chained and every entry is compared with the classes of its chain,
+// only for the rare machine where two different columns have the same hash
+EntryClasses GroupByColumns(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs,
+	uint32_t stateCount, uint32_t entryCount, const std::vector<uint64_t>& hashes)
+{
+	EntryClasses entryClasses;
+	entryClasses.classes.resize(entryCount, NO_ID);
+	std::unordered_map<uint64_t, uint32_t> firstClasses;
+	std::vector<uint32_t> nextClasses;
+	for (uint32_t entry = 0; entry < entryCount; entry++)
+	{
+		uint32_t newClass = ClassCount(entryClasses);
+		auto [found, added] = firstClasses.emplace(hashes[entry], newClass);
+		uint32_t entryClass = added ? NO_ID : found->second;
+		while (entryClass != NO_ID
+			&& !SameColumns(transitions, outs, stateCount, entryCount, entryClasses.representatives[entryClass], entry))
+		{
+			entryClass = nextClasses[entryClass];
+		}
+		if (entryClass == NO_ID)
+		{
+			entryClass = newClass;
+			entryClasses.representatives.push_back(entry);
+			nextClasses.push_back(added ? NO_ID : found->second);
+			found->second = newClass;
+		}
+		entryClasses.classes[entry] = entryClass;
+	}
+	return entryClasses;
+}
+
+template <typename Automaton>
+Automaton CompressedShell(const Automaton& automaton, const EntryClasses& entryClasses)
+{
+	Automaton compressed;
+	compressed.states = automaton.states;
+	compressed.outputs = automaton.outputs;
+	for (uint32_t entry : entryClasses.representatives)
+	{
+		Append(compressed.entries, Name(automaton.entries, entry));
+	}
+	return compressed;
+}
+
+// row by row, every entry takes the cell of its class
+void ExpandRows(const std::vector<uint32_t>& cells, std::vector<uint32_t>& expanded, const EntryClasses& entryClasses,
+	uint32_t stateCount, unsigned threads)
+{
+	size_t entryCount = entryClasses.classes.size();
+	size_t classCount = entryClasses.representatives.size();
+	expanded.resize(size_t(stateCount) * entryCount);
+	threads = (expanded.size() < PARALLEL_TRANSITIONS) ? 1 : threads;
+	ParallelFor(stateCount, threads, [&](size_t begin, size_t end, unsigned) {
+		for (size_t state = begin; state < end; state++)
+		{
+			const uint32_t* from = cells.data() + state * classCount;
+			uint32_t* to = expanded.data() + state * entryCount;
+			for (size_t entry = 0; entry < entryCount; entry++)
+			{
+				to[entry] = from[entryClasses.classes[entry]];
+			}
+		}
+	});
+}
+
+}
+
+EntryClasses GroupEntries(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs,
+	uint32_t stateCount, uint32_t entryCount, unsigned threads)
+{
+	std::vector<uint64_t> hashes = HashColumns(transitions, outs, stateCount, entryCount, threads);
+	EntryClasses entryClasses = GroupByHashes(hashes);
+	if (!MatchRepresentatives(transitions, outs, stateCount, entryClasses, threads))
+	{
+		entryClasses = GroupByColumns(transitions, outs, stateCount, entryCount, hashes);
+	}
+	AddEntryClasses(entryCount, ClassCount(entryClasses));
+	return entryClasses;
+}
+
+EntryClasses GroupEntries(const Mealy& mealy, unsigned threads)
+{
+	return GroupEntries(mealy.transitions, &mealy.outs, StateCount(mealy), EntryCount(mealy), threads);
+}
+
+EntryClasses GroupEntries(const Moore& moore, unsigned threads)
+{
+	return GroupEntries(moore.transitions, nullptr, StateCount(moore), EntryCount(moore), threads);
+}
+
+Mealy CompressEntries(const Mealy& mealy, const EntryClasses& entryClasses)
+{
+	Mealy compressed = CompressedShell(mealy, entryClasses);
+	size_t cellCount = size_t(StateCount(mealy)) * ClassCount(entryClasses);
+	compressed.transitions.reserve(cellCount);
+	compressed.outs.reserve(cellCount);
+	for (size_t row = 0; row < mealy.transitions.size(); row += EntryCount(mealy))
+	{
+		for (uint32_t entry : entryClasses.representatives)
+		{
+			compressed.transitions.push_back(mealy.transitions[row + entry]);
+			compressed.outs.push_back(mealy.outs[row + entry]);
+		}
+	}
+	return compressed;
+}
+
+Moore CompressEntries(const Moore& moore, const EntryClasses& entryClasses)
+{
+	Moore compressed = CompressedShell(moore, entryClasses);
+	compressed.outs = moore.outs;
+	compressed.transitions.reserve(size_t(StateCount(moore)) * ClassCount(entryClasses));
+	for (size_t row = 0; row < moore.transitions.size(); row += EntryCount(moore))
+	{
+		for (uint32_t entry : entryClasses.representatives)
+		{
+			compressed.transitions.push_back(moore.transitions[row + entry]);
+		}
+	}
+	return compressed;
+}
+
+Mealy ExpandEntries(const Mealy& mealy, const EntryClasses& entryClasses, const SymbolTable& entries, unsigned threads)
+{
+	Mealy expanded;
+	expanded.states = mealy.states;
+	expanded.entries = entries;
+	expanded.outputs = mealy.outputs;
+	ExpandRows(mealy.transitions, expanded.transitions, entryClasses, StateCount(mealy), threads);
+	ExpandRows(mealy.outs, expanded.outs, entryClasses, StateCount(mealy), threads);
+	return expanded;
+}
+
+Moore ExpandEntries(const Moore& moore, const EntryClasses& entryClasses, const SymbolTable& entries, unsigned threads)
+{
+	Moore expanded;
+	expanded.states = moore.states;
+	expanded.entries = entries;
+	expanded.outputs = moore.outputs;
+	expanded.outs = moore.outs;
+	ExpandRows(moore.transitions, expanded.transitions, entryClasses, StateCount(moore), threads);
+	return expanded;
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <vector>
+
+// Entries whose columns are equal: every state goes to the same target on them, with the same output in a
+// Mealy machine. Such entries cannot tell any two states apart, so a machine over one entry per class has
+// the same reachable states and the same minimal machine, and the others are copied back at the end.
+struct EntryClasses
+{
+	std::vector<uint32_t> classes; // classes[entry] -> its class, numbered in the order of their first entries
+	std::vector<uint32_t> representatives; // representatives[class] -> the first entry of the class
+};
+
+inline uint32_t ClassCount(const EntryClasses& entryClasses)
+{
+	return static_cast<uint32_t>(entryClasses.representatives.size());
+}
+
+// entries per class, the compression ratio of the alphabet; 1 for a machine without entries
+inline double EntryCompression(uint32_t entryCount, uint32_t classCount)
+{
+	return (classCount != 0) ? double(entryCount) / classCount : 1;
+}
+
+// columns are hashed state by state on threads (0 - all hardware threads), entries with equal hashes are
+// compared; outs is null for Moore machines, whose outputs do not depend on the entry
+EntryClasses GroupEntries(const std::vector<uint32_t>& transitions, const std::vector<uint32_t>* outs,
+	uint32_t stateCount, uint32_t entryCount, unsigned threads = 0);
+EntryClasses GroupEntries(const Mealy& mealy, unsigned threads = 0);
+EntryClasses GroupEntries(const Moore& moore, unsigned threads = 0);
+
+// the machine over the representatives, the entry of class c is named like representatives[c]
+Mealy CompressEntries(const Mealy& mealy, const EntryClasses& entryClasses);
+Moore CompressEntries(const Moore& moore, const EntryClasses& entryClasses);
+
+// a machine built over the classes with every entry back: the column of an entry is the one of its class
+Mealy ExpandEntries(const Mealy& mealy, const EntryClasses& entryClasses, const SymbolTable& entries, unsigned threads = 0);
+Moore ExpandEntries(const Moore& moore, const EntryClasses& entryClasses, const SymbolTable& entries, unsigned threads = 0);
@@ -0,0 +1,342 @@
+﻿#include "Analysis.h"
+#include "Alphabet.h"
+#include "Cancellation.h"
+#include "Parallel.h"
+#include "Stats.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+namespace
+{
+// frontiers with fewer transitions than this are expanded on one thread
+const size_t PARALLEL_FRONTIER_TRANSITIONS = 1 << 16;
+const uint32_t MIXED_OUTPUT = NO_ID - 1;
+// the BFS looks for cancellation after expanding about this many states
+const size_t CANCEL_CHECK_STATES = 1 << 16;
+
+bool SetBitAtomic(StateBits& bits, uint32_t index)
+{
+	uint64_t mask = uint64_t(1) << (index & 63);
+	std::atomic_ref<uint64_t> word(bits[index >> 6]);
+	if (word.load(std::memory_order_relaxed) & mask)
+	{
+		return false;
+	}
+	return !(word.fetch_or(mask, std::memory_order_relaxed) & mask);
+}
+
+uint32_t CountBits(const StateBits& bits)
+{
+	uint32_t count = 0;
+	for (uint64_t word : bits)
+	{
+		count += static_cast<uint32_t>(std::popcount(word));
+	}
+	return count;
+}
+
+// output seen so far on the paths from a component: NO_ID - none yet, MIXED_OUTPUT - several
+uint32_t MergeOutput(uint32_t current, uint32_t output)
+{
+	if (current == NO_ID || current == output)
+	{
+		return output;
+	}
+	return output == NO_ID ? current : MIXED_OUTPUT;
+}
+
+// stateOutput is NO_ID for Mealy machines, where the outputs sit on the transitions
+GraphReport Analyze(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>* transitionOuts, const std::vector<uint32_t>* stateOuts, unsigned threads)
+{
+	GraphReport report;
+	report.stateCount = stateCount;
+	report.entryCount = entryCount;
+	report.entryClassCount = ClassCount(GroupEntries(transitions, transitionOuts, stateCount, entryCount, threads));
+	if (stateCount == 0)
+	{
+		return report;
+	}
+	StateBits reachable = FindReachableStates(transitions, stateCount, entryCount, threads);
+	report.reachableCount = CountBits(reachable);
+	report.unreachableCount = stateCount - report.reachableCount;
+
+	std::vector<uint32_t> components = FindComponents(transitions, stateCount, entryCount);
+	for (uint32_t component : components)
+	{
+		if (component != NO_ID)
+		{
+			report.componentCount = std::max(report.componentCount, component + 1);
+		}
+	}
+
+	std::vector<uint32_t> sizes(report.componentCount, 0);
+	std::vector<bool> leaves(report.componentCount, false);
+	std::vector<uint32_t> componentOutput(report.componentCount, NO_ID);
+	std::vector<std::vector<uint32_t>> members(report.componentCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		if (components[state] != NO_ID)
+		{
+			members[components[state]].push_back(state);
+		}
+	}
+
+	// components come in reverse topological order, so successors are always done before
+	for (uint32_t component = 0; component < report.componentCount; component++)
+	{
+		uint32_t output = NO_ID;
+		bool sink = false;
+		for (uint32_t state : members[component])
+		{
+			sizes[component]++;
+			if (stateOuts)
+			{
+				output = MergeOutput(output, (*stateOuts)[state]);
+			}
+			sink = true;
+			for (uint32_t entry = 0; entry < entryCount; entry++)
+			{
+				size_t cell = size_t(state) * entryCount + entry;
+				uint32_t target = transitions[cell];
+				sink = sink && target == state;
+				if (transitionOuts)
+				{
+					output = MergeOutput(output, (*transitionOuts)[cell]);
+				}
+				if (components[target] != component)
+				{
+					leaves[component] = true;
+					output = MergeOutput(output, componentOutput[components[target]]);
+				}
+			}
+			report.sinkCount += sink ? 1 : 0;
+		}
+		componentOutput[component] = output;
+		report.largestComponent = std::max(report.largestComponent, sizes[component]);
+		report.trapComponentCount += leaves[component] ? 0 : 1;
+		report.deadCount += (output != MIXED_OUTPUT) ? sizes[component] : 0;
+	}
+
+	return report;
+}
+}
+
+StateBits FindReachableStates(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	unsigned threads)
+{
+	StateBits reachable((size_t(stateCount) + 63) / 64, 0);
+	if (stateCount == 0)
+	{
+		return reachable;
+	}
+	threads = ThreadCount(threads);
+
+	std::vector<uint32_t> frontier{ 0 };
+	SetBit(reachable, 0);
+	std::vector<std::vector<uint32_t>> nextFrontiers(threads);
+	size_t expanded = 0;
+	while (!frontier.empty())
+	{
+		expanded += frontier.size();
+		if (expanded >= CANCEL_CHECK_STATES)
+		{
+			CheckCancelled();
+			expanded = 0;
+		}
+		if (threads == 1 || frontier.size() * entryCount < PARALLEL_FRONTIER_TRANSITIONS)
+		{
+			std::vector<uint32_t>& next = nextFrontiers[0];
+			for (uint32_t state : frontier)
+			{
+				for (uint32_t entry = 0; entry < entryCount; entry++)
+				{
+					uint32_t target = transitions[size_t(state) * entryCount + entry];
+					if (SetBit(reachable, target))
+					{
+						next.push_back(target);
+					}
+				}
+			}
+			frontier.swap(next);
+			next.clear();
+			continue;
+		}
+
+		ParallelFor(frontier.size(), threads, [&](size_t begin, size_t end, unsigned thread) {
+			std::vector<uint32_t>& next = nextFrontiers[thread];
+			for (size_t i = begin; i < end; i++)
+			{
+				for (uint32_t entry = 0; entry < entryCount; entry++)
+				{
+					uint32_t target = transitions[size_t(frontier[i]) * entryCount + entry];
+					if (SetBitAtomic(reachable, target))
+					{
+						next.push_back(target);
+					}
+				}
+			}
+		});
+		frontier.clear();
+		for (auto& next : nextFrontiers)
+		{
+			frontier.insert(frontier.end(), next.begin(), next.end());
+			next.clear();
+		}
+	}
+
+	return reachable;
+}
+
+std::vector<uint32_t> FindComponents(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount)
+{
+	std::vector<uint32_t> components(stateCount, NO_ID);
+	if (stateCount == 0)
+	{
+		return components;
+	}
+
+	// iterative Tarjan from the start state
+	std::vector<uint32_t> index(stateCount, NO_ID);
+	std::vector<uint32_t> low(stateCount);
+	std::vector<uint32_t> stack;
+	std::vector<std::pair<uint32_t, uint32_t>> calls; // {state, next entry}
+	uint32_t nextIndex = 0;
+	uint32_t componentCount = 0;
+
+	index[0] = low[0] = nextIndex++;
+	stack.push_back(0);
+	calls.push_back({ 0, 0 });
+	while (!calls.empty())
+	{
+		auto& [state, entry] = calls.back();
+		if (entry < entryCount)
+		{
+			uint32_t target = transitions[size_t(state) * entryCount + entry++];
+			if (index[target] == NO_ID)
+			{
+				index[target] = low[target] = nextIndex++;
+				stack.push_back(target);
+				calls.push_back({ target, 0 });
+			}
+			else if (components[target] == NO_ID)
+			{
+				low[state] = std::min(low[state], index[target]);
+			}
+			continue;
+		}
+
+		uint32_t finished = state;
+		calls.pop_back();
+		if (low[finished] == index[finished])
+		{
+			uint32_t member;
+			do
+			{
+				member = stack.back();
+				stack.pop_back();
+				components[member] = componentCount;
+			} while (member != finished);
+			componentCount++;
+		}
+		if (!calls.empty())
+		{
+			uint32_t parent = calls.back().first;
+			low[parent] = std::min(low[parent], low[finished]);
+		}
+	}
+
+	return components;
+}
+
+GraphReport AnalyzeMealy(const Mealy& mealy, unsigned threads)
+{
+	return Analyze(mealy.transitions, StateCount(mealy), EntryCount(mealy), &mealy.outs, nullptr, threads);
+}
+
+GraphReport AnalyzeMoore(const Moore& moore, unsigned threads)
+{
+	return Analyze(moore.transitions, StateCount(moore), EntryCount(moore), nullptr, &moore.outs, threads);
+}
+
+Mealy KeepStates(const Mealy& mealy, const StateBits& keep)
+{
+	uint32_t entryCount = EntryCount(mealy);
+	std::vector<uint32_t> newIndexes(StateCount(mealy), NO_ID);
+	Mealy kept;
+	kept.entries = mealy.entries;
+	kept.outputs = mealy.outputs;
+	for (uint32_t state = 0; state < StateCount(mealy); state++)
+	{
+		if (TestBit(keep, state))
+		{
+			newIndexes[state] = Append(kept.states, Name(mealy.states, state));
+		}
+	}
+	kept.transitions.reserve(size_t(StateCount(kept)) * entryCount);
+	kept.outs.reserve(size_t(StateCount(kept)) * entryCount);
+	for (uint32_t state = 0; state < StateCount(mealy); state++)
+	{
+		if (!TestBit(keep, state))
+		{
+			continue;
+		}
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			kept.transitions.push_back(newIndexes[mealy.transitions[size_t(state) * entryCount + entry]]);
+			kept.outs.push_back(mealy.outs[size_t(state) * entryCount + entry]);
+		}
+	}
+	return kept;
+}
+
+Moore KeepStates(const Moore& moore, const StateBits& keep)
+{
+	uint32_t entryCount = EntryCount(moore);
+	std::vector<uint32_t> newIndexes(StateCount(moore), NO_ID);
+	Moore kept;
+	kept.entries = moore.entries;
+	kept.outputs = moore.outputs;
+	for (uint32_t state = 0; state < StateCount(moore); state++)
+	{
+		if (TestBit(keep, state))
+		{
+			newIndexes[state] = Append(kept.states, Name(moore.states, state));
+		}
+	}
+	kept.transitions.reserve(size_t(StateCount(kept)) * entryCount);
+	for (uint32_t state = 0; state < StateCount(moore); state++)
+	{
+		if (!TestBit(keep, state))
+		{
+			continue;
+		}
+		kept.outs.push_back(moore.outs[state]);
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			kept.transitions.push_back(newIndexes[moore.transitions[size_t(state) * entryCount + entry]]);
+		}
+	}
+	return kept;
+}
+
+Mealy DeleteUnreachableStates(const Mealy& mealy, unsigned threads)
+{
+	Mealy reachable = KeepStates(mealy, FindReachableStates(mealy.transitions, StateCount(mealy), EntryCount(mealy), threads));
+	if (Stats* stats = CurrentStats())
+	{
+		stats->unreachableStateCount += StateCount(mealy) - StateCount(reachable);
+	}
+	return reachable;
+}
+
+Moore DeleteUnreachableStates(const Moore& moore, unsigned threads)
+{
+	Moore reachable = KeepStates(moore, FindReachableStates(moore.transitions, StateCount(moore), EntryCount(moore), threads));
+	if (Stats* stats = CurrentStats())
+	{
+		stats->unreachableStateCount += StateCount(moore) - StateCount(reachable);
+	}
+	return reachable;
+}
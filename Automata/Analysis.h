@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <vector>
+
+// one bit per state
+using StateBits = std::vector<uint64_t>;
+
+inline bool TestBit(const StateBits& bits, uint32_t index)
+{
+	return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+// returns true when the bit was not set before
+inline bool SetBit(StateBits& bits, uint32_t index)
+{
+	uint64_t mask = uint64_t(1) << (index & 63);
+	if (bits[index >> 6] & mask)
+	{
+		return false;
+	}
+	bits[index >> 6] |= mask;
+	return true;
+}
+
+struct GraphReport
+{
+	uint32_t stateCount = 0;
+	uint32_t reachableCount = 0;
+	uint32_t unreachableCount = 0;
+	uint32_t componentCount = 0; // strongly connected components of the reachable part
+	uint32_t largestComponent = 0;
+	uint32_t trapComponentCount = 0; // components no transition leaves
+	uint32_t sinkCount = 0; // states whose every transition is a self-loop
+	uint32_t deadCount = 0; // states after which the output never changes
+	uint32_t entryCount = 0;
+	uint32_t entryClassCount = 0; // entries with distinct columns, see Alphabet.h
+};
+
+// states reachable from the start state 0, found by a level-synchronous BFS;
+// levels with a large frontier are expanded by several threads (0 - all hardware threads)
+StateBits FindReachableStates(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	unsigned threads = 0);
+
+// strongly connected components of the states reachable from state 0, numbered in reverse topological
+// order (every transition leads to the same or a smaller component); NO_ID for unreachable states
+std::vector<uint32_t> FindComponents(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount);
+
+GraphReport AnalyzeMealy(const Mealy& mealy, unsigned threads = 0);
+GraphReport AnalyzeMoore(const Moore& moore, unsigned threads = 0);
+
+// copy of the machine with only the kept states, in their original order
+Mealy KeepStates(const Mealy& mealy, const StateBits& keep);
+Moore KeepStates(const Moore& moore, const StateBits& keep);
+
+Mealy DeleteUnreachableStates(const Mealy& mealy, unsigned threads = 0);
+Moore DeleteUnreachableStates(const Moore& moore, unsigned threads = 0);
@@ -0,0 +1,19 @@
+﻿#pragma once
+// The library api: machines in memory, partial machines, entry classes, reachability, analysis, minimization,
+// incremental updates, equivalence, both conversions, running machines on input streams and generating C++ for them.
+// The files are only touched by the readers and writers, by the cache and by the out-of-core minimization.
+#include "Alphabet.h"
+#include "Analysis.h"
+#include "Automaton.h"
+#include "BinaryFormat.h"
+#include "Cache.h"
+#include "CodeGeneration.h"
+#include "Conversion.h"
+#include "Equivalence.h"
+#include "Incremental.h"
+#include "Minimization.h"
+#include "OutOfCore.h"
+#include "Refinement.h"
+#include "Simulation.h"
+#include "Sparse.h"
+#include "Streaming.h"
@@ -0,0 +1,128 @@
+﻿#include "Automaton.h"
+#include <charconv>
+#include <functional>
+#include <stdexcept>
+
+namespace
+{
+size_t HashName(std::string_view name)
+{
+	return std::hash<std::string_view>{}(name);
+}
+
+void InsertSlot(std::vector<uint32_t>& slots, size_t hash, uint32_t id)
+{
+	size_t mask = slots.size() - 1;
+	size_t slot = hash & mask;
+	while (slots[slot] != NO_ID)
+	{
+		slot = (slot + 1) & mask;
+	}
+	slots[slot] = id;
+}
+
+uint32_t AddName(SymbolTable& table, std::string_view name, size_t hash)
+{
+	uint32_t id = SymbolCount(table);
+	if (table.pool.size() + name.size() > UINT32_MAX || id == NO_ID - 1)
+	{
+		throw std::length_error("Too many names in the symbol table");
+	}
+	table.pool.append(name);
+	table.offsets.push_back(static_cast<uint32_t>(table.pool.size()));
+
+	if (table.slots.size() < 2 * (size_t(id) + 1))
+	{
+		RebuildIndex(table);
+	}
+	else
+	{
+		InsertSlot(table.slots, hash, id);
+	}
+	return id;
+}
+}
+
+uint32_t Intern(SymbolTable& table, std::string_view name)
+{
+	size_t hash = HashName(name);
+	if (!table.slots.empty())
+	{
+		size_t mask = table.slots.size() - 1;
+		for (size_t slot = hash & mask; table.slots[slot] != NO_ID; slot = (slot + 1) & mask)
+		{
+			if (Name(table, table.slots[slot]) == name)
+			{
+				return table.slots[slot];
+			}
+		}
+	}
+	return AddName(table, name, hash);
+}
+
+uint32_t Append(SymbolTable& table, std::string_view name)
+{
+	return AddName(table, name, HashName(name));
+}
+
+uint32_t Find(const SymbolTable& table, std::string_view name)
+{
+	if (table.slots.empty())
+	{
+		return NO_ID;
+	}
+	size_t mask = table.slots.size() - 1;
+	for (size_t slot = HashName(name) & mask; table.slots[slot] != NO_ID; slot = (slot + 1) & mask)
+	{
+		if (Name(table, table.slots[slot]) == name)
+		{
+			return table.slots[slot];
+		}
+	}
+	return NO_ID;
+}
+
+void RebuildIndex(SymbolTable& table)
+{
+	size_t capacity = 16;
+	while (capacity < 2 * size_t(SymbolCount(table)) + 2)
+	{
+		capacity *= 2;
+	}
+	table.slots.assign(capacity, NO_ID);
+
+	// ids are inserted in order, so duplicated names keep resolving to the first id
+	for (uint32_t id = 0; id < SymbolCount(table); id++)
+	{
+		std::string_view name = Name(table, id);
+		size_t mask = capacity - 1;
+		size_t slot = HashName(name) & mask;
+		bool duplicate = false;
+		for (; table.slots[slot] != NO_ID; slot = (slot + 1) & mask)
+		{
+			if (Name(table, table.slots[slot]) == name)
+			{
+				duplicate = true;
+				break;
+			}
+		}
+		if (!duplicate)
+		{
+			table.slots[slot] = id;
+		}
+	}
+}
+
+SymbolTable NumberedSymbols(std::string_view prefix, uint32_t count)
+{
+	SymbolTable table;
+	table.offsets.reserve(size_t(count) + 1);
+	std::string name(prefix);
+	name.resize(prefix.size() + 10);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		char* end = std::to_chars(name.data() + prefix.size(), name.data() + name.size(), i).ptr;
+		Append(table, std::string_view(name.data(), end - name.data()));
+	}
+	return table;
+}
@@ -0,0 +1,83 @@
+﻿#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+const uint32_t NO_ID = UINT32_MAX;
+
+// names interned into dense 32-bit ids, the characters of all names live in one pool
+struct SymbolTable
+{
+	std::string pool;
+	std::vector<uint32_t> offsets{ 0 }; // name of id i is pool[offsets[i], offsets[i + 1])
+	std::vector<uint32_t> slots; // open addressing index: slot -> id or NO_ID
+};
+
+// returns the id of the name, adding it if it is new
+uint32_t Intern(SymbolTable& table, std::string_view name);
+// always adds a new id, lookups by name keep returning the first one
+uint32_t Append(SymbolTable& table, std::string_view name);
+// returns NO_ID for unknown names
+uint32_t Find(const SymbolTable& table, std::string_view name);
+void RebuildIndex(SymbolTable& table);
+
+inline uint32_t SymbolCount(const SymbolTable& table)
+{
+	return static_cast<uint32_t>(table.offsets.size() - 1);
+}
+
+inline std::string_view Name(const SymbolTable& table, uint32_t id)
+{
+	return std::string_view(table.pool.data() + table.offsets[id], table.offsets[id + 1] - table.offsets[id]);
+}
+
+// transitions and outputs of both machines are stored state by state:
+// transitions[state * entryCount + entry] is the target state of the transition
+struct Mealy
+{
+	SymbolTable states;
+	SymbolTable entries;
+	SymbolTable outputs;
+	std::vector<uint32_t> transitions;
+	std::vector<uint32_t> outs; // outs[state * entryCount + entry] -> output symbol
+};
+
+struct Moore
+{
+	SymbolTable states;
+	SymbolTable entries;
+	SymbolTable outputs;
+	std::vector<uint32_t> outs; // outs[state] -> output symbol
+	std::vector<uint32_t> transitions;
+};
+
+template <typename Automaton>
+uint32_t StateCount(const Automaton& automaton)
+{
+	return SymbolCount(automaton.states);
+}
+
+template <typename Automaton>
+uint32_t EntryCount(const Automaton& automaton)
+{
+	return SymbolCount(automaton.entries);
+}
+
+// table of names prefix0, prefix1, ..., used for the states of generated machines
+SymbolTable NumberedSymbols(std::string_view prefix, uint32_t count);
+
+// the lines of entries are cut into ranges of whole lines parsed side by side (0 threads - all hardware
+// threads), the names of the outputs get the ids one pass would give them
+Mealy ReadMealy(const std::string& inFileName, unsigned threads = 0);
+Moore ReadMoore(const std::string& inFileName, unsigned threads = 0);
+// the same from csv text already in memory
+Mealy ParseMealy(std::string_view text, unsigned threads = 0);
+Moore ParseMoore(std::string_view text, unsigned threads = 0);
+// rows are formatted in parallel (0 threads - all hardware threads) and written in large blocks; a few megabytes
+// of rows are formatted on the calling thread
+void WriteMealy(const Mealy& mealy, const std::string& outFileName, unsigned threads = 0);
+void WriteMoore(const Moore& moore, const std::string& outFileName, unsigned threads = 0);
+void WriteMealy(const Mealy& mealy, std::ostream& output, unsigned threads = 0);
+void WriteMoore(const Moore& moore, std::ostream& output, unsigned threads = 0);
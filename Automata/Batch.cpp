@@ -0,0 +1,91 @@
+﻿#include "Batch.h"
+#include "Parallel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<BatchJob> ReadBatchJobs(std::istream& input)
+{
+	std::vector<BatchJob> jobs;
+	std::string line;
+	for (size_t number = 1; std::getline(input, line); number++)
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		std::istringstream fields(line);
+		BatchJob job;
+		job.line = number;
+		if (!(fields >> job.mode) || job.mode.front() == '#')
+		{
+			continue;
+		}
+		std::string extra;
+		job.valid = (fields >> job.input >> job.output) && !(fields >> extra);
+		jobs.push_back(std::move(job));
+	}
+	return jobs;
+}
+
+std::vector<BatchJob> LoadBatchJobs(const std::string& manifestFileName)
+{
+	if (manifestFileName == "-")
+	{
+		return ReadBatchJobs(std::cin);
+	}
+	std::ifstream manifest(manifestFileName);
+	if (!manifest)
+	{
+		throw std::runtime_error("Cannot open file " + manifestFileName);
+	}
+	return ReadBatchJobs(manifest);
+}
+
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, unsigned threads,
+	const std::function<void(const BatchJob&)>& run)
+{
+	std::vector<BatchResult> results(jobs.size());
+	ThreadPool pool(static_cast<unsigned>(std::min<size_t>(ThreadCount(threads), std::max<size_t>(jobs.size(), 1))));
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		pool.Submit([&jobs, &results, &run, i] {
+			try
+			{
+				if (!jobs[i].valid)
+				{
+					throw std::runtime_error("Expected <mode> <input> <output>");
+				}
+				run(jobs[i]);
+			}
+			catch (const std::exception& e)
+			{
+				results[i].ok = false;
+				results[i].error = e.what();
+			}
+		});
+	}
+	pool.Wait();
+	return results;
+}
+
+void WriteBatchSummary(std::ostream& output, const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results)
+{
+	size_t failed = 0;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (results[i].ok)
+		{
+			continue;
+		}
+		failed++;
+		output << "line " << jobs[i].line << ": " << jobs[i].mode << " " << jobs[i].input << " " << jobs[i].output
+			<< ": " << results[i].error << std::endl;
+	}
+	output << "jobs: " << jobs.size() << std::endl
+		<< "succeeded: " << jobs.size() - failed << std::endl
+		<< "failed: " << failed << std::endl;
+}
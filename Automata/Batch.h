@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// one line of a batch manifest: "<mode> <input> <output>", fields separated by spaces or tabs;
+// empty lines and lines starting with '#' are not jobs
+struct BatchJob
+{
+	size_t line = 0;
+	std::string mode;
+	std::string input;
+	std::string output;
+	bool valid = true; // false when the line does not have exactly three fields
+};
+
+struct BatchResult
+{
+	bool ok = true;
+	std::string error;
+};
+
+std::vector<BatchJob> ReadBatchJobs(std::istream& input);
+// "-" reads the jobs from stdin
+std::vector<BatchJob> LoadBatchJobs(const std::string& manifestFileName);
+
+// runs every job on a work-stealing pool (0 threads - one per hardware thread); a job fails by
+// throwing, the failure is recorded in its result and the other jobs go on
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, unsigned threads,
+	const std::function<void(const BatchJob&)>& run);
+
+// failed jobs one per line, then the totals
+void WriteBatchSummary(std::ostream& output, const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results);
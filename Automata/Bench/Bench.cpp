@@ -0,0 +1,347 @@
+﻿#include "Alphabet.h"
+#include "Analysis.h"
+#include "Automaton.h"
+#include "BinaryFormat.h"
+#include "Conversion.h"
+#include "Generator.h"
+#include "Minimization.h"
+#include "ProcessInfo.h"
+#include "Refinement.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const std::string MEALY = "mealy";
+const std::string MOORE = "moore";
+const std::string BOTH = "both";
+const std::string GENERATE_COMMAND = "generate";
+const std::string HOPCROFT_ALGORITHM = "hopcroft";
+const std::string SIGNATURE_ALGORITHM = "signature";
+const std::string REFERENCE_ALGORITHM = "reference";
+const std::string PARTIAL_ALGORITHM = "partial";
+const std::string STATES_OPTION = "--states";
+const std::string ENTRIES_OPTION = "--entries";
+const std::string OUTPUTS_OPTION = "--outputs";
+const std::string CLASSES_OPTION = "--classes";
+const std::string UNREACHABLE_OPTION = "--unreachable";
+const std::string SEED_OPTION = "--seed";
+const std::string KIND_OPTION = "--kind";
+const std::string ALGORITHM_OPTION = "--algorithm";
+const std::string THREADS_OPTION = "--threads";
+const std::string REPEAT_OPTION = "--repeat";
+const std::string DIRECTORY_OPTION = "--dir";
+const std::string OUTPUT_OPTION = "--output";
+const std::string SYMBOLS_OPTION = "--symbols";
+// the random input of the run phases is cut into streams of this many symbols
+const uint32_t RUN_STREAM_LENGTH = 1 << 12;
+
+struct Options
+{
+	GeneratorOptions generator;
+	std::string kind = BOTH;
+	std::string algorithm = HOPCROFT_ALGORITHM;
+	unsigned threads = 0;
+	unsigned repeat = 1;
+	uint64_t symbols = 1 << 24; // input symbols of the run phases
+	std::string directory; // for the csv file of the parse and write phases, the temp directory by default
+	std::string output; // json goes to stdout when empty
+};
+
+struct Phase
+{
+	std::string name;
+	double seconds = 0;
+	uint64_t transitions = 0;
+	size_t peakResidentBytes = 0;
+};
+
+struct Run
+{
+	std::string kind;
+	uint32_t stateCount = 0;
+	uint32_t entryCount = 0;
+	uint32_t reachableCount = 0;
+	uint32_t classCount = 0;
+	std::vector<Phase> phases;
+};
+
+// best wall time of options.repeat calls; the result of the last call is kept by the function itself
+template <typename Function>
+Phase Measure(const Options& options, const std::string& name, uint64_t transitions, Function function)
+{
+	Phase phase{ name, 0, transitions, 0 };
+	for (unsigned i = 0; i < std::max(1u, options.repeat); i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		phase.seconds = (i == 0) ? elapsed.count() : std::min(phase.seconds, elapsed.count());
+	}
+	phase.peakResidentBytes = PeakResidentBytes();
+	return phase;
+}
+
+std::string TempFileName(const Options& options, const std::string& kind)
+{
+	std::filesystem::path directory = options.directory.empty()
+		? std::filesystem::temp_directory_path()
+		: std::filesystem::path(options.directory);
+	return (directory / ("automata-bench-" + kind + "-" + std::to_string(options.generator.seed) + ".csv")).string();
+}
+
+// generate, write, parse on --threads, grouping the entries, reachability, refinement, the conversion to the
+// other kind and running the machine on random streams in one thread, one stream at a time and interleaved, and
+// on all of them as one stream on --threads; "transitions" of the run phases are the input symbols, so their
+// throughput is symbols per second, of one core but for run-parallel
+template <typename Automaton, typename Other>
+Run BenchKind(const Options& options, const std::string& kind, Automaton (*generate)(const GeneratorOptions&),
+	void (*write)(const Automaton&, const std::string&, unsigned), Automaton (*read)(const std::string&, unsigned),
+	Other (*convert)(const Automaton&), const std::string& conversionName)
+{
+	Run run;
+	run.kind = kind;
+	Automaton automaton;
+	run.phases.push_back(Measure(options, "generate", 0, [&] { automaton = generate(options.generator); }));
+	run.stateCount = StateCount(automaton);
+	run.entryCount = EntryCount(automaton);
+	uint64_t transitions = automaton.transitions.size();
+	run.phases.back().transitions = transitions;
+
+	std::string fileName = TempFileName(options, kind);
+	run.phases.push_back(Measure(options, "write", transitions, [&] { write(automaton, fileName, options.threads); }));
+	Automaton parsed;
+	run.phases.push_back(Measure(options, "parse", transitions, [&] { parsed = read(fileName, options.threads); }));
+	std::filesystem::remove(fileName);
+
+	run.phases.push_back(Measure(options, "alphabet", transitions, [&] { GroupEntries(parsed, options.threads); }));
+
+	Automaton reachable;
+	run.phases.push_back(Measure(options, "reachability", transitions,
+		[&] { reachable = DeleteUnreachableStates(parsed, options.threads); }));
+	run.reachableCount = StateCount(reachable);
+
+	std::vector<uint32_t> classes;
+	run.phases.push_back(Measure(options, "refinement", reachable.transitions.size(), [&] {
+		std::vector<uint32_t> initialClasses;
+		uint32_t initialCount = GroupByOutputs(reachable, initialClasses);
+		classes = RefineClasses(ParseRefinementAlgorithm(options.algorithm), reachable.transitions, run.reachableCount,
+			run.entryCount, initialClasses, initialCount, options.threads);
+	}));
+	run.classCount = CountClasses(classes);
+
+	Other converted;
+	run.phases.push_back(Measure(options, conversionName, transitions, [&] { converted = convert(parsed); }));
+
+	CompiledMachine machine;
+	run.phases.push_back(Measure(options, "compile", transitions, [&] { machine = CompileMachine(parsed); }));
+	Streams streams = GenerateStreams(run.entryCount, options.symbols, RUN_STREAM_LENGTH, options.generator.seed);
+	std::vector<uint32_t> outputs;
+	run.phases.push_back(Measure(options, "run", streams.entries.size(), [&] { RunStreams(machine, streams, &outputs, 1); }));
+	run.phases.push_back(Measure(options, "run-interleaved", streams.entries.size(),
+		[&] { RunStreams(machine, streams, &outputs); }));
+	run.phases.push_back(Measure(options, "run-parallel", streams.entries.size(),
+		[&] { RunParallel(machine, streams.entries, &outputs, options.threads); }));
+	return run;
+}
+
+Moore ConvertMealy(const Mealy& mealy)
+{
+	return MealyToMoore(mealy);
+}
+
+Run BenchMealy(const Options& options)
+{
+	return BenchKind<Mealy, Moore>(options, MEALY, GenerateMealy, WriteMealy, ReadMealy, ConvertMealy, "mealy-to-moore");
+}
+
+Run BenchMoore(const Options& options)
+{
+	return BenchKind<Moore, Mealy>(options, MOORE, GenerateMoore, WriteMoore, ReadMoore, MooreToMealy, "moore-to-mealy");
+}
+
+void WriteJson(std::ostream& output, const Options& options, const std::vector<Run>& runs)
+{
+	const GeneratorOptions& generator = options.generator;
+	output << std::fixed << std::setprecision(6)
+		<< "{\n"
+		<< "  \"config\": {\"states\": " << generator.stateCount << ", \"entries\": " << generator.entryCount
+		<< ", \"outputs\": " << generator.outputCount << ", \"classes\": " << generator.classCount
+		<< ", \"unreachable\": " << generator.unreachableFraction << ", \"seed\": " << generator.seed
+		<< ", \"algorithm\": \"" << options.algorithm << "\", \"threads\": " << options.threads
+		<< ", \"repeat\": " << options.repeat << ", \"symbols\": " << options.symbols << "},\n"
+		<< "  \"runs\": [";
+	for (size_t i = 0; i < runs.size(); i++)
+	{
+		const Run& run = runs[i];
+		output << (i == 0 ? "\n" : ",\n")
+			<< "    {\"kind\": \"" << run.kind << "\", \"states\": " << run.stateCount << ", \"entries\": " << run.entryCount
+			<< ", \"reachable\": " << run.reachableCount << ", \"classes\": " << run.classCount << ", \"phases\": [";
+		for (size_t j = 0; j < run.phases.size(); j++)
+		{
+			const Phase& phase = run.phases[j];
+			uint64_t throughput = phase.seconds > 0 ? static_cast<uint64_t>(phase.transitions / phase.seconds) : 0;
+			output << (j == 0 ? "\n" : ",\n")
+				<< "      {\"name\": \"" << phase.name << "\", \"seconds\": " << phase.seconds
+				<< ", \"transitions\": " << phase.transitions << ", \"transitions_per_second\": " << throughput
+				<< ", \"peak_rss_bytes\": " << phase.peakResidentBytes << "}";
+		}
+		output << "\n    ]}";
+	}
+	output << "\n  ]\n}\n";
+}
+
+void Bench(const Options& options)
+{
+	std::vector<Run> runs;
+	if (options.kind == MEALY || options.kind == BOTH)
+	{
+		runs.push_back(BenchMealy(options));
+	}
+	if (options.kind == MOORE || options.kind == BOTH)
+	{
+		runs.push_back(BenchMoore(options));
+	}
+
+	if (options.output.empty())
+	{
+		WriteJson(std::cout, options, runs);
+		return;
+	}
+	std::ostringstream json;
+	WriteJson(json, options, runs);
+	std::ofstream output(options.output, std::ios::binary);
+	if (!(output << json.str()))
+	{
+		throw std::runtime_error("Cannot write file " + options.output);
+	}
+}
+
+// writes one generated machine in the format of the file extension
+void Generate(const std::string& automataType, const std::string& outFileName, const Options& options)
+{
+	(automataType == MEALY) ?
+		SaveMealy(GenerateMealy(options.generator), outFileName) :
+		SaveMoore(GenerateMoore(options.generator), outFileName);
+}
+
+void WriteBadRequest(const std::string& msg)
+{
+	std::cout << msg << std::endl;
+}
+
+// reads "--name value" pairs after the positional arguments
+bool ReadOptions(int argc, char* argv[], int first, Options& options)
+{
+	for (int i = first; i < argc; i += 2)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		std::string value = argv[i + 1];
+		if (argv[i] == STATES_OPTION)
+		{
+			options.generator.stateCount = static_cast<uint32_t>(std::stoul(value));
+		}
+		else if (argv[i] == ENTRIES_OPTION)
+		{
+			options.generator.entryCount = static_cast<uint32_t>(std::stoul(value));
+		}
+		else if (argv[i] == OUTPUTS_OPTION)
+		{
+			options.generator.outputCount = static_cast<uint32_t>(std::stoul(value));
+		}
+		else if (argv[i] == CLASSES_OPTION)
+		{
+			options.generator.classCount = static_cast<uint32_t>(std::stoul(value));
+		}
+		else if (argv[i] == UNREACHABLE_OPTION)
+		{
+			options.generator.unreachableFraction = std::stod(value);
+		}
+		else if (argv[i] == SEED_OPTION)
+		{
+			options.generator.seed = std::stoull(value);
+		}
+		else if (argv[i] == KIND_OPTION && (value == MEALY || value == MOORE || value == BOTH))
+		{
+			options.kind = value;
+		}
+		else if (argv[i] == ALGORITHM_OPTION
+			&& (value == HOPCROFT_ALGORITHM || value == SIGNATURE_ALGORITHM || value == REFERENCE_ALGORITHM
+				|| value == PARTIAL_ALGORITHM))
+		{
+			options.algorithm = value;
+		}
+		else if (argv[i] == THREADS_OPTION)
+		{
+			options.threads = static_cast<unsigned>(std::stoul(value));
+		}
+		else if (argv[i] == REPEAT_OPTION)
+		{
+			options.repeat = static_cast<unsigned>(std::stoul(value));
+		}
+		else if (argv[i] == SYMBOLS_OPTION)
+		{
+			options.symbols = std::stoull(value);
+		}
+		else if (argv[i] == DIRECTORY_OPTION)
+		{
+			options.directory = value;
+		}
+		else if (argv[i] == OUTPUT_OPTION)
+		{
+			options.output = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	bool generate = argc >= 2 && argv[1] == GENERATE_COMMAND;
+	bool validOptions = false;
+	try
+	{
+		validOptions = generate
+			? argc >= 4 && (argv[2] == MEALY || argv[2] == MOORE) && ReadOptions(argc, argv, 4, options)
+			: ReadOptions(argc, argv, 1, options);
+	}
+	catch (const std::exception&)
+	{
+	}
+	if (!validOptions)
+	{
+		std::cout << "Usage: " << argv[0] << " [options] [" << KIND_OPTION << " <mealy|moore|both>]"
+			<< " [" << ALGORITHM_OPTION << " <hopcroft|signature|reference|partial>] [" << THREADS_OPTION << " <count>]"
+			<< " [" << REPEAT_OPTION << " <count>] [" << SYMBOLS_OPTION << " <count>] [" << DIRECTORY_OPTION << " <path>] [" << OUTPUT_OPTION << " <file.json>]" << std::endl
+			<< "       " << argv[0] << " " << GENERATE_COMMAND << " <mealy|moore> <output.csv|.atm> [options]" << std::endl
+			<< "options: " << STATES_OPTION << " <count> " << ENTRIES_OPTION << " <count> " << OUTPUTS_OPTION << " <count> "
+			<< CLASSES_OPTION << " <count> " << UNREACHABLE_OPTION << " <fraction> " << SEED_OPTION << " <number>" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		generate ? Generate(argv[2], argv[3], options) : Bench(options);
+	}
+	catch (const std::exception& e)
+	{
+		WriteBadRequest(e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,242 @@
+﻿#include "Generator.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// splitmix64, unlike the standard distributions it gives the same numbers with every standard library
+class Random
+{
+public:
+	explicit Random(uint64_t seed)
+		: m_state(seed)
+	{
+	}
+
+	uint64_t Next()
+	{
+		uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// in [0, bound)
+	uint32_t Below(uint32_t bound)
+	{
+		return static_cast<uint32_t>(((Next() >> 32) * bound) >> 32);
+	}
+
+private:
+	uint64_t m_state;
+};
+
+struct Skeleton
+{
+	uint32_t stateCount = 0;
+	uint32_t classCount = 0;
+	std::vector<uint32_t> transitions;
+	std::vector<uint32_t> classes; // classes[state]
+};
+
+void CheckOptions(const GeneratorOptions& options)
+{
+	if (options.stateCount == 0 || options.entryCount == 0 || options.outputCount == 0 || options.classCount == 0)
+	{
+		throw std::runtime_error("Generator needs at least one state, entry, output and class");
+	}
+	if (!(options.unreachableFraction >= 0 && options.unreachableFraction < 1))
+	{
+		throw std::runtime_error("Fraction of unreachable states must be in [0, 1)");
+	}
+}
+
+uint32_t ReachableCount(const GeneratorOptions& options)
+{
+	return std::max(1u,
+		options.stateCount - static_cast<uint32_t>(std::llround(options.stateCount * options.unreachableFraction)));
+}
+
+// every class needs a reachable state
+uint32_t ClassCount(const GeneratorOptions& options)
+{
+	return std::min(options.classCount, ReachableCount(options));
+}
+
+// quotient transitions: entry 0 walks the classes in a cycle so every class is reachable,
+// the other entries go anywhere
+std::vector<uint32_t> GenerateQuotient(Random& random, uint32_t classCount, uint32_t entryCount)
+{
+	std::vector<uint32_t> quotient(size_t(classCount) * entryCount);
+	for (uint32_t cls = 0; cls < classCount; cls++)
+	{
+		quotient[size_t(cls) * entryCount] = (cls + 1) % classCount;
+		for (uint32_t entry = 1; entry < entryCount; entry++)
+		{
+			quotient[size_t(cls) * entryCount + entry] = random.Below(classCount);
+		}
+	}
+	return quotient;
+}
+
+Skeleton GenerateSkeleton(Random& random, const GeneratorOptions& options, const std::vector<uint32_t>& quotient,
+	uint32_t classCount)
+{
+	uint32_t entryCount = options.entryCount;
+	uint32_t reachableCount = ReachableCount(options);
+
+	Skeleton skeleton;
+	skeleton.classCount = classCount;
+	skeleton.classes.reserve(options.stateCount);
+	skeleton.transitions.reserve(size_t(options.stateCount) * entryCount);
+	std::vector<std::vector<uint32_t>> members(classCount);
+	uint32_t emptyClasses = classCount;
+
+	auto addState = [&](uint32_t cls) {
+		uint32_t state = static_cast<uint32_t>(skeleton.classes.size());
+		skeleton.classes.push_back(cls);
+		if (members[cls].empty())
+		{
+			emptyClasses--;
+		}
+		members[cls].push_back(state);
+		return state;
+	};
+
+	// reachable part in BFS order: a transition creates a new state while the budget lasts,
+	// keeping one state in reserve for every class nobody has reached yet
+	addState(0);
+	for (uint32_t state = 0; state < skeleton.classes.size(); state++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t cls = quotient[size_t(skeleton.classes[state]) * entryCount + entry];
+			uint32_t stateCount = static_cast<uint32_t>(skeleton.classes.size());
+			bool create = members[cls].empty() || stateCount + emptyClasses < reachableCount;
+			uint32_t target = create ? addState(cls) : members[cls][random.Below(static_cast<uint32_t>(members[cls].size()))];
+			skeleton.transitions.push_back(target);
+		}
+	}
+	reachableCount = static_cast<uint32_t>(skeleton.classes.size());
+
+	// unreachable part: states of random classes that may lead anywhere
+	for (uint32_t state = reachableCount; state < options.stateCount; state++)
+	{
+		addState(random.Below(classCount));
+	}
+	skeleton.stateCount = static_cast<uint32_t>(skeleton.classes.size());
+	for (uint32_t state = reachableCount; state < skeleton.stateCount; state++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			const auto& targets = members[quotient[size_t(skeleton.classes[state]) * entryCount + entry]];
+			skeleton.transitions.push_back(targets[random.Below(static_cast<uint32_t>(targets.size()))]);
+		}
+	}
+
+	// shuffle everything but the start state so that the order of the rows says nothing
+	std::vector<uint32_t> order(skeleton.stateCount);
+	for (uint32_t state = 0; state < skeleton.stateCount; state++)
+	{
+		order[state] = state;
+	}
+	for (uint32_t i = skeleton.stateCount - 1; i > 1; i--)
+	{
+		std::swap(order[i], order[1 + random.Below(i)]);
+	}
+	std::vector<uint32_t> transitions(skeleton.transitions.size());
+	std::vector<uint32_t> classes(skeleton.stateCount);
+	for (uint32_t state = 0; state < skeleton.stateCount; state++)
+	{
+		classes[order[state]] = skeleton.classes[state];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			transitions[size_t(order[state]) * entryCount + entry] = order[skeleton.transitions[size_t(state) * entryCount + entry]];
+		}
+	}
+	skeleton.transitions = std::move(transitions);
+	skeleton.classes = std::move(classes);
+	return skeleton;
+}
+
+}
+
+Mealy GenerateMealy(const GeneratorOptions& options)
+{
+	CheckOptions(options);
+	Random random(options.seed);
+	uint32_t entryCount = options.entryCount;
+	uint32_t classCount = ClassCount(options);
+	auto quotient = GenerateQuotient(random, classCount, entryCount);
+	std::vector<uint32_t> quotientOuts(quotient.size());
+	for (auto& out : quotientOuts)
+	{
+		out = random.Below(options.outputCount);
+	}
+	Skeleton skeleton = GenerateSkeleton(random, options, quotient, classCount);
+
+	Mealy mealy;
+	mealy.states = NumberedSymbols("s", skeleton.stateCount);
+	mealy.entries = NumberedSymbols("x", entryCount);
+	mealy.outputs = NumberedSymbols("y", options.outputCount);
+	mealy.transitions = std::move(skeleton.transitions);
+	mealy.outs.resize(mealy.transitions.size());
+	for (uint32_t state = 0; state < skeleton.stateCount; state++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			mealy.outs[size_t(state) * entryCount + entry] = quotientOuts[size_t(skeleton.classes[state]) * entryCount + entry];
+		}
+	}
+	return mealy;
+}
+
+Moore GenerateMoore(const GeneratorOptions& options)
+{
+	CheckOptions(options);
+	Random random(options.seed);
+	uint32_t classCount = ClassCount(options);
+	auto quotient = GenerateQuotient(random, classCount, options.entryCount);
+	std::vector<uint32_t> quotientOuts(classCount);
+	for (auto& out : quotientOuts)
+	{
+		out = random.Below(options.outputCount);
+	}
+	Skeleton skeleton = GenerateSkeleton(random, options, quotient, classCount);
+
+	Moore moore;
+	moore.states = NumberedSymbols("s", skeleton.stateCount);
+	moore.entries = NumberedSymbols("x", options.entryCount);
+	moore.outputs = NumberedSymbols("y", options.outputCount);
+	moore.transitions = std::move(skeleton.transitions);
+	moore.outs.resize(skeleton.stateCount);
+	for (uint32_t state = 0; state < skeleton.stateCount; state++)
+	{
+		moore.outs[state] = quotientOuts[skeleton.classes[state]];
+	}
+	return moore;
+}
+
+Streams GenerateStreams(uint32_t entryCount, uint64_t symbolCount, uint32_t streamLength, uint64_t seed)
+{
+	Streams streams;
+	if (entryCount == 0 || streamLength == 0)
+	{
+		return streams;
+	}
+	Random random(seed);
+	streams.entries.resize(symbolCount);
+	for (auto& entry : streams.entries)
+	{
+		entry = random.Below(entryCount);
+	}
+	for (uint64_t end = streamLength; end < symbolCount + streamLength; end += streamLength)
+	{
+		streams.offsets.push_back(std::min(end, symbolCount));
+	}
+	return streams;
+}
@@ -0,0 +1,24 @@
+﻿#pragma once
+#include "Automaton.h"
+#include "Simulation.h"
+#include <cstdint>
+
+// Random machines built over a random minimal-looking "quotient" machine of classCount classes:
+// every state belongs to a class and its transitions lead to some state of the class the quotient
+// goes to, so the states of one class are equivalent and the minimal machine has at most classCount
+// states. The same options and seed always give the same machine on every platform.
+struct GeneratorOptions
+{
+	uint32_t stateCount = 1000;
+	uint32_t entryCount = 4;
+	uint32_t outputCount = 2;
+	uint32_t classCount = 100;
+	double unreachableFraction = 0; // share of the states no path from the start state reaches
+	uint64_t seed = 1;
+};
+
+Mealy GenerateMealy(const GeneratorOptions& options);
+Moore GenerateMoore(const GeneratorOptions& options);
+
+// symbolCount random entries in streams of streamLength, the last one shorter
+Streams GenerateStreams(uint32_t entryCount, uint64_t symbolCount, uint32_t streamLength, uint64_t seed);
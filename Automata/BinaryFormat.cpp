@@ -0,0 +1,524 @@
+﻿#include "BinaryFormat.h"
+#include "CodeGeneration.h"
+#include "MappedFile.h"
+#include "Stats.h"
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+const size_t HEADER_SIZE = 64;
+const size_t ALIGNMENT = 8;
+// the classes of the states follow the outs array
+const uint32_t FLAG_CLASSES = 1;
+
+struct Header
+{
+	uint16_t version = BINARY_VERSION;
+	AutomatonKind kind = AutomatonKind::Mealy;
+	uint32_t stateCount = 0;
+	uint32_t entryCount = 0;
+	uint32_t outputCount = 0;
+	uint32_t flags = 0;
+	uint64_t statesOffset = 0;
+	uint64_t entriesOffset = 0;
+	uint64_t outputsOffset = 0;
+	uint64_t transitionsOffset = 0;
+	uint64_t outsOffset = 0;
+};
+
+template <typename Number>
+Number FromLittleEndian(Number value)
+{
+	if constexpr (std::endian::native == std::endian::big)
+	{
+		Number swapped = 0;
+		for (size_t i = 0; i < sizeof(Number); i++)
+		{
+			swapped = (swapped << 8) | ((value >> (8 * i)) & 0xff);
+		}
+		return swapped;
+	}
+	return value;
+}
+
+template <typename Number>
+Number ToLittleEndian(Number value)
+{
+	return FromLittleEndian(value);
+}
+
+size_t Align(size_t size)
+{
+	return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t TableSize(const SymbolTable& table)
+{
+	return Align(8 + 4 * (size_t(SymbolCount(table)) + 1) + table.pool.size());
+}
+
+// writes in little-endian, appending zero padding up to the next section
+class Writer
+{
+public:
+	explicit Writer(const std::string& outFileName)
+		: m_output(outFileName, std::ios::binary)
+	{
+		if (!m_output)
+		{
+			throw std::runtime_error("Cannot open file " + outFileName);
+		}
+	}
+
+	template <typename Number>
+	void Write(Number value)
+	{
+		value = ToLittleEndian(value);
+		WriteBytes(&value, sizeof(value));
+	}
+
+	void WriteArray(const std::vector<uint32_t>& values)
+	{
+		if constexpr (std::endian::native == std::endian::little)
+		{
+			WriteBytes(values.data(), values.size() * sizeof(uint32_t));
+		}
+		else
+		{
+			for (uint32_t value : values)
+			{
+				Write(value);
+			}
+		}
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		m_output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		m_written += size;
+	}
+
+	void Pad()
+	{
+		static const char zeros[ALIGNMENT] = {};
+		WriteBytes(zeros, Align(m_written) - m_written);
+	}
+
+	void Finish()
+	{
+		m_output.flush();
+		if (!m_output)
+		{
+			throw std::runtime_error("Cannot write the binary automaton");
+		}
+		AddBytesWritten(m_written);
+	}
+
+private:
+	std::ofstream m_output;
+	size_t m_written = 0;
+};
+
+void WriteTable(Writer& writer, const SymbolTable& table)
+{
+	writer.Write(SymbolCount(table));
+	writer.Write(static_cast<uint32_t>(table.pool.size()));
+	writer.WriteArray(table.offsets);
+	writer.WriteBytes(table.pool.data(), table.pool.size());
+	writer.Pad();
+}
+
+void WriteHeader(Writer& writer, const Header& header)
+{
+	writer.WriteBytes(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+	writer.Write(header.version);
+	writer.Write(static_cast<uint16_t>(header.kind));
+	writer.Write(header.stateCount);
+	writer.Write(header.entryCount);
+	writer.Write(header.outputCount);
+	writer.Write(header.flags);
+	writer.Write(header.statesOffset);
+	writer.Write(header.entriesOffset);
+	writer.Write(header.outputsOffset);
+	writer.Write(header.transitionsOffset);
+	writer.Write(header.outsOffset);
+}
+
+Header MakeHeader(AutomatonKind kind, const SymbolTable& states, const SymbolTable& entries, const SymbolTable& outputs)
+{
+	Header header;
+	header.kind = kind;
+	header.stateCount = SymbolCount(states);
+	header.entryCount = SymbolCount(entries);
+	header.outputCount = SymbolCount(outputs);
+	header.statesOffset = HEADER_SIZE;
+	header.entriesOffset = header.statesOffset + TableSize(states);
+	header.outputsOffset = header.entriesOffset + TableSize(entries);
+	header.transitionsOffset = header.outputsOffset + TableSize(outputs);
+	header.outsOffset = header.transitionsOffset + 4 * uint64_t(header.stateCount) * header.entryCount;
+	return header;
+}
+
+// bounds-checked view of the mapped file
+class Reader
+{
+public:
+	Reader(std::string_view data, const std::string& fileName)
+		: m_data(data)
+		, m_fileName(fileName)
+	{
+	}
+
+	template <typename Number>
+	Number Read(uint64_t offset) const
+	{
+		Number value;
+		std::memcpy(&value, Bytes(offset, sizeof(Number)), sizeof(Number));
+		return FromLittleEndian(value);
+	}
+
+	void ReadArray(uint64_t offset, size_t count, std::vector<uint32_t>& values) const
+	{
+		const char* bytes = Bytes(offset, count * sizeof(uint32_t));
+		values.resize(count);
+		std::memcpy(values.data(), bytes, count * sizeof(uint32_t));
+		if constexpr (std::endian::native == std::endian::big)
+		{
+			for (uint32_t& value : values)
+			{
+				value = FromLittleEndian(value);
+			}
+		}
+	}
+
+	const char* Bytes(uint64_t offset, uint64_t size) const
+	{
+		if (offset > m_data.size() || size > m_data.size() - offset)
+		{
+			Fail();
+		}
+		return m_data.data() + offset;
+	}
+
+	[[noreturn]] void Fail() const
+	{
+		throw std::runtime_error("Broken binary automaton " + m_fileName);
+	}
+
+private:
+	std::string_view m_data;
+	const std::string& m_fileName;
+};
+
+Header ReadHeader(const Reader& reader)
+{
+	if (std::memcmp(reader.Bytes(0, HEADER_SIZE), BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+	{
+		reader.Fail();
+	}
+	Header header;
+	header.version = reader.Read<uint16_t>(4);
+	if (header.version != BINARY_VERSION)
+	{
+		throw std::runtime_error("Unsupported binary automaton version " + std::to_string(header.version));
+	}
+	header.kind = static_cast<AutomatonKind>(reader.Read<uint16_t>(6));
+	header.stateCount = reader.Read<uint32_t>(8);
+	header.entryCount = reader.Read<uint32_t>(12);
+	header.outputCount = reader.Read<uint32_t>(16);
+	header.flags = reader.Read<uint32_t>(20);
+	header.statesOffset = reader.Read<uint64_t>(24);
+	header.entriesOffset = reader.Read<uint64_t>(32);
+	header.outputsOffset = reader.Read<uint64_t>(40);
+	header.transitionsOffset = reader.Read<uint64_t>(48);
+	header.outsOffset = reader.Read<uint64_t>(56);
+	return header;
+}
+
+SymbolTable ReadTable(const Reader& reader, uint64_t offset, uint32_t expectedCount)
+{
+	SymbolTable table;
+	uint32_t count = reader.Read<uint32_t>(offset);
+	uint32_t poolSize = reader.Read<uint32_t>(offset + 4);
+	if (count != expectedCount)
+	{
+		reader.Fail();
+	}
+	reader.ReadArray(offset + 8, size_t(count) + 1, table.offsets);
+	const char* pool = reader.Bytes(offset + 8 + 4 * (uint64_t(count) + 1), poolSize);
+	table.pool.assign(pool, poolSize);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (table.offsets[i] > table.offsets[i + 1])
+		{
+			reader.Fail();
+		}
+	}
+	if (table.offsets[0] != 0 || table.offsets[count] != poolSize)
+	{
+		reader.Fail();
+	}
+	RebuildIndex(table);
+	return table;
+}
+
+void CheckIds(const Reader& reader, const std::vector<uint32_t>& ids, uint32_t count)
+{
+	uint32_t invalid = 0;
+	for (uint32_t id : ids)
+	{
+		invalid |= (id >= count) ? 1 : 0;
+	}
+	if (invalid)
+	{
+		reader.Fail();
+	}
+}
+
+uint64_t ClassesOffset(const Header& header)
+{
+	uint64_t outsCount = (header.kind == AutomatonKind::Mealy) ? uint64_t(header.stateCount) * header.entryCount : header.stateCount;
+	return Align(header.outsOffset + 4 * outsCount);
+}
+
+// classes is nullptr when the caller does not want them
+template <typename Automaton>
+Automaton ReadBinary(const std::string& inFileName, AutomatonKind kind, std::vector<uint32_t>* classes = nullptr)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	Reader reader(file.Data(), inFileName);
+	Header header = ReadHeader(reader);
+	if (header.kind != kind)
+	{
+		throw std::runtime_error(inFileName + " holds a " + (header.kind == AutomatonKind::Mealy ? "mealy" : "moore")
+			+ " automaton");
+	}
+
+	Automaton automaton;
+	automaton.states = ReadTable(reader, header.statesOffset, header.stateCount);
+	automaton.entries = ReadTable(reader, header.entriesOffset, header.entryCount);
+	automaton.outputs = ReadTable(reader, header.outputsOffset, header.outputCount);
+	size_t cells = size_t(header.stateCount) * header.entryCount;
+	reader.ReadArray(header.transitionsOffset, cells, automaton.transitions);
+	reader.ReadArray(header.outsOffset, kind == AutomatonKind::Mealy ? cells : header.stateCount, automaton.outs);
+	CheckIds(reader, automaton.transitions, header.stateCount);
+	CheckIds(reader, automaton.outs, header.outputCount);
+	if (classes)
+	{
+		if (!(header.flags & FLAG_CLASSES))
+		{
+			throw std::runtime_error(inFileName + " holds no partition");
+		}
+		reader.ReadArray(ClassesOffset(header), header.stateCount, *classes);
+		for (uint32_t stateClass : *classes)
+		{
+			if (stateClass != NO_ID && stateClass >= header.stateCount)
+			{
+				reader.Fail();
+			}
+		}
+	}
+	return automaton;
+}
+
+template <typename Automaton>
+void WriteBinary(const Automaton& automaton, const std::string& outFileName, AutomatonKind kind,
+	const std::vector<uint32_t>* classes = nullptr)
+{
+	Header header = MakeHeader(kind, automaton.states, automaton.entries, automaton.outputs);
+	header.flags = classes ? FLAG_CLASSES : 0;
+	Writer writer(outFileName);
+	WriteHeader(writer, header);
+	WriteTable(writer, automaton.states);
+	WriteTable(writer, automaton.entries);
+	WriteTable(writer, automaton.outputs);
+	writer.WriteArray(automaton.transitions);
+	writer.WriteArray(automaton.outs);
+	writer.Pad();
+	if (classes)
+	{
+		writer.WriteArray(*classes);
+		writer.Pad();
+	}
+	writer.Finish();
+}
+
+void CheckReadable(const std::string& inFileName, FileFormat format)
+{
+	if (format == FileFormat::Cpp || format == FileFormat::CppSwitch)
+	{
+		throw std::runtime_error("Cannot read a machine from the C++ header " + inFileName);
+	}
+}
+}
+
+FileFormat ParseFileFormat(const std::string& name)
+{
+	if (name == "csv")
+	{
+		return FileFormat::Csv;
+	}
+	if (name == "binary")
+	{
+		return FileFormat::Binary;
+	}
+	if (name == "cpp")
+	{
+		return FileFormat::Cpp;
+	}
+	if (name == "cpp-switch")
+	{
+		return FileFormat::CppSwitch;
+	}
+	throw std::invalid_argument("Invalid file format " + name);
+}
+
+FileFormat ResolveFormat(const std::string& fileName, FileFormat format)
+{
+	if (format != FileFormat::Auto)
+	{
+		return format;
+	}
+	auto hasExtension = [&fileName](const std::string& extension) {
+		return fileName.size() >= extension.size()
+			&& fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+	};
+	if (hasExtension(BINARY_EXTENSION))
+	{
+		return FileFormat::Binary;
+	}
+	return (hasExtension(".h") || hasExtension(".hpp")) ? FileFormat::Cpp : FileFormat::Csv;
+}
+
+Mealy ReadBinaryMealy(const std::string& inFileName)
+{
+	return ReadBinary<Mealy>(inFileName, AutomatonKind::Mealy);
+}
+
+Moore ReadBinaryMoore(const std::string& inFileName)
+{
+	return ReadBinary<Moore>(inFileName, AutomatonKind::Moore);
+}
+
+AutomatonKind ReadBinaryKind(const std::string& inFileName)
+{
+	MappedFile file(inFileName);
+	Header header = ReadHeader(Reader(file.Data(), inFileName));
+	if (header.kind != AutomatonKind::Mealy && header.kind != AutomatonKind::Moore)
+	{
+		throw std::runtime_error("Broken binary automaton " + inFileName);
+	}
+	return header.kind;
+}
+
+void WriteBinaryMealy(const Mealy& mealy, const std::string& outFileName)
+{
+	WriteBinary(mealy, outFileName, AutomatonKind::Mealy);
+}
+
+void WriteBinaryMoore(const Moore& moore, const std::string& outFileName)
+{
+	WriteBinary(moore, outFileName, AutomatonKind::Moore);
+}
+
+MappedAutomaton MapBinary(const std::string& inFileName)
+{
+	if (std::endian::native != std::endian::little)
+	{
+		throw std::runtime_error("Binary automata are read in place on little-endian hosts only");
+	}
+	auto file = std::make_shared<MappedFile>(inFileName);
+	Reader reader(file->Data(), inFileName);
+	Header header = ReadHeader(reader);
+	if (header.kind != AutomatonKind::Mealy && header.kind != AutomatonKind::Moore)
+	{
+		reader.Fail();
+	}
+
+	MappedAutomaton automaton;
+	automaton.kind = header.kind;
+	automaton.stateCount = header.stateCount;
+	automaton.entryCount = header.entryCount;
+	automaton.entries = ReadTable(reader, header.entriesOffset, header.entryCount);
+	automaton.outputs = ReadTable(reader, header.outputsOffset, header.outputCount);
+	uint64_t cells = uint64_t(header.stateCount) * header.entryCount;
+	uint64_t outsCount = (header.kind == AutomatonKind::Mealy) ? cells : header.stateCount;
+	automaton.transitions = reinterpret_cast<const uint32_t*>(reader.Bytes(header.transitionsOffset, 4 * cells));
+	automaton.outs = reinterpret_cast<const uint32_t*>(reader.Bytes(header.outsOffset, 4 * outsCount));
+	automaton.file = std::move(file);
+	return automaton;
+}
+
+Mealy ReadBinaryMealy(const std::string& inFileName, std::vector<uint32_t>& classes)
+{
+	return ReadBinary<Mealy>(inFileName, AutomatonKind::Mealy, &classes);
+}
+
+Moore ReadBinaryMoore(const std::string& inFileName, std::vector<uint32_t>& classes)
+{
+	return ReadBinary<Moore>(inFileName, AutomatonKind::Moore, &classes);
+}
+
+void WriteBinaryMealy(const Mealy& mealy, const std::vector<uint32_t>& classes, const std::string& outFileName)
+{
+	WriteBinary(mealy, outFileName, AutomatonKind::Mealy, &classes);
+}
+
+void WriteBinaryMoore(const Moore& moore, const std::vector<uint32_t>& classes, const std::string& outFileName)
+{
+	WriteBinary(moore, outFileName, AutomatonKind::Moore, &classes);
+}
+
+Mealy LoadMealy(const std::string& inFileName, FileFormat format, unsigned threads)
+{
+	format = ResolveFormat(inFileName, format);
+	CheckReadable(inFileName, format);
+	return format == FileFormat::Binary ? ReadBinaryMealy(inFileName) : ReadMealy(inFileName, threads);
+}
+
+Moore LoadMoore(const std::string& inFileName, FileFormat format, unsigned threads)
+{
+	format = ResolveFormat(inFileName, format);
+	CheckReadable(inFileName, format);
+	return format == FileFormat::Binary ? ReadBinaryMoore(inFileName) : ReadMoore(inFileName, threads);
+}
+
+void SaveMealy(const Mealy& mealy, const std::string& outFileName, FileFormat format, unsigned threads)
+{
+	switch (ResolveFormat(outFileName, format))
+	{
+	case FileFormat::Binary:
+		WriteBinaryMealy(mealy, outFileName);
+		break;
+	case FileFormat::Cpp:
+		WriteCppMealy(mealy, outFileName, CppStyle::Tables);
+		break;
+	case FileFormat::CppSwitch:
+		WriteCppMealy(mealy, outFileName, CppStyle::Switch);
+		break;
+	default:
+		WriteMealy(mealy, outFileName, threads);
+	}
+}
+
+void SaveMoore(const Moore& moore, const std::string& outFileName, FileFormat format, unsigned threads)
+{
+	switch (ResolveFormat(outFileName, format))
+	{
+	case FileFormat::Binary:
+		WriteBinaryMoore(moore, outFileName);
+		break;
+	case FileFormat::Cpp:
+		WriteCppMoore(moore, outFileName, CppStyle::Tables);
+		break;
+	case FileFormat::CppSwitch:
+		WriteCppMoore(moore, outFileName, CppStyle::Switch);
+		break;
+	default:
+		WriteMoore(moore, outFileName, threads);
+	}
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <memory>
+#include <string>
+
+// Binary automaton file, all numbers little-endian:
+//   header: "AUTM", u16 version, u16 kind, u32 state/entry/output counts, u32 flags,
+//           u64 offsets of the state, entry and output tables and of the transitions and outs arrays
+//   symbol table: u32 count, u32 pool size, u32 offsets[count + 1], pool characters
+//   transitions: u32[states * entries], state by state
+//   outs: u32[states * entries] for Mealy machines, u32[states] for Moore machines
+//   classes (flag 1): u32[states], the saved partition of an earlier minimization
+// Every section starts at a multiple of 8 bytes.
+const char BINARY_MAGIC[4] = { 'A', 'U', 'T', 'M' };
+const uint16_t BINARY_VERSION = 1;
+const std::string BINARY_EXTENSION = ".atm";
+
+class MappedFile;
+
+enum class AutomatonKind : uint16_t
+{
+	Mealy = 1,
+	Moore = 2,
+};
+
+enum class FileFormat
+{
+	Auto, // binary for the .atm extension, a C++ header for .h and .hpp, csv otherwise
+	Csv,
+	Binary,
+	Cpp, // a header with tables, written only
+	CppSwitch, // a header with switches for tiny machines, written only
+};
+
+// "csv", "binary", "cpp" or "cpp-switch"
+FileFormat ParseFileFormat(const std::string& name);
+FileFormat ResolveFormat(const std::string& fileName, FileFormat format);
+
+// the file is mapped once, the arrays are copied out of the mapping as they are
+Mealy ReadBinaryMealy(const std::string& inFileName);
+Moore ReadBinaryMoore(const std::string& inFileName);
+AutomatonKind ReadBinaryKind(const std::string& inFileName);
+void WriteBinaryMealy(const Mealy& mealy, const std::string& outFileName);
+void WriteBinaryMoore(const Moore& moore, const std::string& outFileName);
+// the same with the classes of the states (NO_ID - unreachable), the reading ones throw when there are none
+Mealy ReadBinaryMealy(const std::string& inFileName, std::vector<uint32_t>& classes);
+Moore ReadBinaryMoore(const std::string& inFileName, std::vector<uint32_t>& classes);
+void WriteBinaryMealy(const Mealy& mealy, const std::vector<uint32_t>& classes, const std::string& outFileName);
+void WriteBinaryMoore(const Moore& moore, const std::vector<uint32_t>& classes, const std::string& outFileName);
+
+// a binary machine read in place: the entries and outputs are copied out, the arrays stay in the mapping and
+// are paged in from the file as they are read, the state names are never read
+struct MappedAutomaton
+{
+	AutomatonKind kind = AutomatonKind::Mealy;
+	uint32_t stateCount = 0;
+	uint32_t entryCount = 0;
+	SymbolTable entries;
+	SymbolTable outputs;
+	const uint32_t* transitions = nullptr; // stateCount * entryCount, state by state
+	const uint32_t* outs = nullptr; // stateCount * entryCount for Mealy machines, stateCount for Moore machines
+	std::shared_ptr<MappedFile> file;
+};
+
+// throws on big-endian hosts, where the arrays cannot be used in place; the ids in the arrays are not checked
+MappedAutomaton MapBinary(const std::string& inFileName);
+
+// threads parse csv files, see ReadMealy
+Mealy LoadMealy(const std::string& inFileName, FileFormat format = FileFormat::Auto, unsigned threads = 0);
+Moore LoadMoore(const std::string& inFileName, FileFormat format = FileFormat::Auto, unsigned threads = 0);
+// threads format csv files, see WriteMealy
+void SaveMealy(const Mealy& mealy, const std::string& outFileName, FileFormat format = FileFormat::Auto,
+	unsigned threads = 0);
+void SaveMoore(const Moore& moore, const std::string& outFileName, FileFormat format = FileFormat::Auto,
+	unsigned threads = 0);
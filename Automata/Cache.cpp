@@ -0,0 +1,404 @@
+﻿#include "Cache.h"
+#include "BinaryFormat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// part of every key, changed whenever the stored results of an operation change
+const uint64_t CACHE_VERSION = 2;
+const std::string TEMPORARY_EXTENSION = ".tmp";
+// temporary files left by a crashed process are removed after this time
+const auto TEMPORARY_LIFETIME = std::chrono::hours(1);
+
+uint64_t Mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EB;
+	return x ^ (x >> 31);
+}
+
+// two independent 64-bit lanes
+class Hasher
+{
+public:
+	explicit Hasher(uint64_t seed)
+		: m_high(Mix(seed ^ 0x243F6A8885A308D3))
+		, m_low(Mix(seed + 0x13198A2E03707344))
+	{
+	}
+
+	void Add(uint64_t value)
+	{
+		m_high = Mix(m_high ^ value);
+		m_low = Mix(m_low + value * 0x9E3779B97F4A7C15 + 0xA4093822299F31D0);
+	}
+
+	void Add(std::string_view text)
+	{
+		Add(uint64_t(text.size()));
+		size_t i = 0;
+		for (; i + 8 <= text.size(); i += 8)
+		{
+			uint64_t chunk;
+			std::memcpy(&chunk, text.data() + i, 8);
+			Add(chunk);
+		}
+		uint64_t tail = 0;
+		std::memcpy(&tail, text.data() + i, text.size() - i);
+		Add(tail);
+	}
+
+	CacheKey Key() const
+	{
+		return { m_high, m_low };
+	}
+
+private:
+	uint64_t m_high;
+	uint64_t m_low;
+};
+
+// states numbered in the order a BFS from the start state reaches them, outputs in the order they show up
+class Canonical
+{
+public:
+	Canonical(uint32_t stateCount, uint32_t outputCount)
+		: m_states(stateCount, NO_ID)
+		, m_outputs(outputCount, NO_ID)
+	{
+		m_order.reserve(stateCount);
+	}
+
+	uint32_t State(uint32_t state)
+	{
+		if (m_states[state] == NO_ID)
+		{
+			m_states[state] = static_cast<uint32_t>(m_order.size());
+			m_order.push_back(state);
+		}
+		return m_states[state];
+	}
+
+	uint32_t Output(uint32_t output)
+	{
+		if (m_outputs[output] == NO_ID)
+		{
+			m_outputs[output] = static_cast<uint32_t>(m_outputOrder.size());
+			m_outputOrder.push_back(output);
+		}
+		return m_outputs[output];
+	}
+
+	// states in canonical order, grows while the search runs
+	const std::vector<uint32_t>& Order() const
+	{
+		return m_order;
+	}
+
+	const std::vector<uint32_t>& OutputOrder() const
+	{
+		return m_outputOrder;
+	}
+
+private:
+	std::vector<uint32_t> m_states;
+	std::vector<uint32_t> m_order;
+	std::vector<uint32_t> m_outputs;
+	std::vector<uint32_t> m_outputOrder;
+};
+
+Hasher StartKey(AutomatonKind kind, CacheOperation operation, const SymbolTable& entries)
+{
+	Hasher hasher(CACHE_VERSION);
+	hasher.Add(uint64_t(kind));
+	hasher.Add(uint64_t(operation));
+	hasher.Add(uint64_t(SymbolCount(entries)));
+	for (uint32_t entry = 0; entry < SymbolCount(entries); entry++)
+	{
+		hasher.Add(Name(entries, entry));
+	}
+	return hasher;
+}
+
+void FinishKey(Hasher& hasher, const Canonical& canonical, const SymbolTable& outputs)
+{
+	hasher.Add(uint64_t(canonical.Order().size()));
+	hasher.Add(uint64_t(canonical.OutputOrder().size()));
+	for (uint32_t output : canonical.OutputOrder())
+	{
+		hasher.Add(Name(outputs, output));
+	}
+}
+
+std::string Hex(const CacheKey& key)
+{
+	const char digits[] = "0123456789abcdef";
+	std::string text(32, '0');
+	for (int i = 0; i < 16; i++)
+	{
+		text[15 - i] = digits[(key.high >> (4 * i)) & 15];
+		text[31 - i] = digits[(key.low >> (4 * i)) & 15];
+	}
+	return text;
+}
+
+// moves the outputs of a stored result into the output table of the input; only the outputs the
+// result uses are looked up, so names missing from the input are appended as the operation itself does
+template <typename Automaton>
+Automaton Translate(Automaton stored, const SymbolTable& entries, const SymbolTable& outputs)
+{
+	if (SymbolCount(stored.entries) != SymbolCount(entries))
+	{
+		throw std::runtime_error("Cache entry does not match the input");
+	}
+	std::vector<uint32_t> newIds(SymbolCount(stored.outputs), NO_ID);
+	SymbolTable translated = outputs;
+	for (uint32_t& out : stored.outs)
+	{
+		if (newIds[out] == NO_ID)
+		{
+			newIds[out] = Intern(translated, Name(stored.outputs, out));
+		}
+		out = newIds[out];
+	}
+	stored.entries = entries;
+	stored.outputs = std::move(translated);
+	return stored;
+}
+
+}
+
+CacheKey StructuralKey(const Mealy& mealy, CacheOperation operation)
+{
+	uint32_t entryCount = EntryCount(mealy);
+	Hasher hasher = StartKey(AutomatonKind::Mealy, operation, mealy.entries);
+	Canonical canonical(StateCount(mealy), SymbolCount(mealy.outputs));
+	canonical.State(0);
+	for (size_t i = 0; i < canonical.Order().size(); i++)
+	{
+		uint32_t state = canonical.Order()[i];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t index = size_t(state) * entryCount + entry;
+			hasher.Add((uint64_t(canonical.State(mealy.transitions[index])) << 32) | canonical.Output(mealy.outs[index]));
+		}
+	}
+	FinishKey(hasher, canonical, mealy.outputs);
+	return hasher.Key();
+}
+
+CacheKey StructuralKey(const Moore& moore, CacheOperation operation)
+{
+	uint32_t entryCount = EntryCount(moore);
+	Hasher hasher = StartKey(AutomatonKind::Moore, operation, moore.entries);
+	Canonical canonical(StateCount(moore), SymbolCount(moore.outputs));
+	canonical.State(0);
+	for (size_t i = 0; i < canonical.Order().size(); i++)
+	{
+		uint32_t state = canonical.Order()[i];
+		hasher.Add(canonical.Output(moore.outs[state]));
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			hasher.Add(canonical.State(moore.transitions[size_t(state) * entryCount + entry]));
+		}
+	}
+	FinishKey(hasher, canonical, moore.outputs);
+	return hasher.Key();
+}
+
+uint64_t ParseByteSize(const std::string& text)
+{
+	size_t end = 0;
+	uint64_t count = std::stoull(text, &end);
+	std::string suffix = text.substr(end);
+	int shift = suffix.empty() ? 0
+		: (suffix == "K" || suffix == "k") ? 10
+		: (suffix == "M" || suffix == "m") ? 20
+		: (suffix == "G" || suffix == "g") ? 30
+		: -1;
+	if (shift < 0 || (shift > 0 && count > (UINT64_MAX >> shift)))
+	{
+		throw std::runtime_error("Invalid size " + text);
+	}
+	return count << shift;
+}
+
+ResultCache::ResultCache(const std::string& directory, uint64_t maxBytes)
+	: m_directory(directory)
+	, m_maxBytes(maxBytes)
+{
+	std::error_code error;
+	fs::create_directories(m_directory, error);
+	if (!fs::is_directory(m_directory, error))
+	{
+		throw std::runtime_error("Cannot use cache directory " + directory);
+	}
+}
+
+std::optional<Mealy> ResultCache::FindMealy(const CacheKey& key, const SymbolTable& entries,
+	const SymbolTable& outputs) const
+{
+	fs::path path = EntryPath(key);
+	if (!Touch(path))
+	{
+		return std::nullopt;
+	}
+	try
+	{
+		return Translate(ReadBinaryMealy(path.string()), entries, outputs);
+	}
+	catch (const std::exception&)
+	{
+		std::error_code error;
+		fs::remove(path, error);
+		return std::nullopt;
+	}
+}
+
+std::optional<Moore> ResultCache::FindMoore(const CacheKey& key, const SymbolTable& entries,
+	const SymbolTable& outputs) const
+{
+	fs::path path = EntryPath(key);
+	if (!Touch(path))
+	{
+		return std::nullopt;
+	}
+	try
+	{
+		return Translate(ReadBinaryMoore(path.string()), entries, outputs);
+	}
+	catch (const std::exception&)
+	{
+		std::error_code error;
+		fs::remove(path, error);
+		return std::nullopt;
+	}
+}
+
+void ResultCache::StoreMealy(const CacheKey& key, const Mealy& mealy) const
+{
+	fs::path temporaryPath = TemporaryPath(key);
+	std::error_code error;
+	try
+	{
+		WriteBinaryMealy(mealy, temporaryPath.string());
+	}
+	catch (const std::exception&)
+	{
+		fs::remove(temporaryPath, error);
+		return;
+	}
+	fs::rename(temporaryPath, EntryPath(key), error);
+	if (error)
+	{
+		fs::remove(temporaryPath, error);
+		return;
+	}
+	Evict();
+}
+
+void ResultCache::StoreMoore(const CacheKey& key, const Moore& moore) const
+{
+	fs::path temporaryPath = TemporaryPath(key);
+	std::error_code error;
+	try
+	{
+		WriteBinaryMoore(moore, temporaryPath.string());
+	}
+	catch (const std::exception&)
+	{
+		fs::remove(temporaryPath, error);
+		return;
+	}
+	fs::rename(temporaryPath, EntryPath(key), error);
+	if (error)
+	{
+		fs::remove(temporaryPath, error);
+		return;
+	}
+	Evict();
+}
+
+fs::path ResultCache::EntryPath(const CacheKey& key) const
+{
+	return m_directory / (Hex(key) + BINARY_EXTENSION);
+}
+
+// unique among the processes and threads writing the same key
+fs::path ResultCache::TemporaryPath(const CacheKey& key) const
+{
+	static const uint64_t processTag = (uint64_t(std::random_device{}()) << 32) ^ std::random_device{}();
+	static std::atomic<uint64_t> counter{ 0 };
+	uint64_t tag = Mix(processTag ^ Mix(std::hash<std::thread::id>{}(std::this_thread::get_id()) + counter++));
+	return m_directory / (Hex(key) + "." + Hex({ 0, tag }).substr(16) + TEMPORARY_EXTENSION);
+}
+
+// marks the entry as recently used, false when there is none
+bool ResultCache::Touch(const fs::path& path) const
+{
+	std::error_code error;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+	return !error;
+}
+
+// removes the least recently used entries until the directory fits the limit again
+void ResultCache::Evict() const
+{
+	struct Entry
+	{
+		fs::path path;
+		fs::file_time_type time;
+		uint64_t size;
+	};
+	std::vector<Entry> entries;
+	uint64_t totalBytes = 0;
+	auto now = fs::file_time_type::clock::now();
+	std::error_code error;
+	for (fs::directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error))
+	{
+		std::error_code entryError;
+		std::string extension = it->path().extension().string();
+		uint64_t size = it->file_size(entryError);
+		fs::file_time_type time = it->last_write_time(entryError);
+		if (entryError)
+		{
+			continue; // removed by another process meanwhile
+		}
+		if (extension == TEMPORARY_EXTENSION && now - time > TEMPORARY_LIFETIME)
+		{
+			fs::remove(it->path(), entryError);
+		}
+		else if (extension == BINARY_EXTENSION)
+		{
+			entries.push_back({ it->path(), time, size });
+			totalBytes += size;
+		}
+	}
+	if (totalBytes <= m_maxBytes)
+	{
+		return;
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+	for (const Entry& entry : entries)
+	{
+		if (totalBytes <= m_maxBytes)
+		{
+			break;
+		}
+		fs::remove(entry.path, error);
+		totalBytes -= entry.size;
+	}
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// On-disk cache of minimization and conversion results, shared by concurrent processes.
+// A result is stored as an .atm file named by the structural key of the input: files are written
+// under a temporary name and renamed into place, a hit refreshes the modification time and the
+// least recently used files are removed once the directory grows past its size limit.
+enum class CacheOperation : uint32_t
+{
+	MinimizeMealy = 1,
+	MinimizeMoore = 2,
+	MealyToMoore = 3,
+	MealyToMinimalMoore = 4,
+};
+
+// 128-bit hash of the states reachable from the start state, numbered in the order a breadth-first
+// search over the entries finds them, and of the outputs, numbered as they first appear: names of the
+// states and the column order do not count, entry and output names do
+struct CacheKey
+{
+	uint64_t high = 0;
+	uint64_t low = 0;
+};
+
+CacheKey StructuralKey(const Mealy& mealy, CacheOperation operation);
+CacheKey StructuralKey(const Moore& moore, CacheOperation operation);
+
+const uint64_t DEFAULT_CACHE_BYTES = uint64_t(1) << 30;
+
+// "<count>" with an optional K, M or G suffix
+uint64_t ParseByteSize(const std::string& text);
+
+class ResultCache
+{
+public:
+	ResultCache(const std::string& directory, uint64_t maxBytes = DEFAULT_CACHE_BYTES);
+
+	// nullopt on a miss, unreadable entries count as misses and are removed; the result is expressed
+	// in the entry and output tables of the input the key was computed for
+	std::optional<Mealy> FindMealy(const CacheKey& key, const SymbolTable& entries, const SymbolTable& outputs) const;
+	std::optional<Moore> FindMoore(const CacheKey& key, const SymbolTable& entries, const SymbolTable& outputs) const;
+	// a result that cannot be stored is only a lost cache entry, no errors are reported
+	void StoreMealy(const CacheKey& key, const Mealy& mealy) const;
+	void StoreMoore(const CacheKey& key, const Moore& moore) const;
+
+private:
+	std::filesystem::path EntryPath(const CacheKey& key) const;
+	std::filesystem::path TemporaryPath(const CacheKey& key) const;
+	bool Touch(const std::filesystem::path& path) const;
+	void Evict() const;
+
+	std::filesystem::path m_directory;
+	uint64_t m_maxBytes;
+};
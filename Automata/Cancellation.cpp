@@ -0,0 +1,63 @@
+﻿#include "Cancellation.h"
+
+namespace
+{
+thread_local const CancelToken* currentToken = nullptr;
+}
+
+OperationCancelled::OperationCancelled(bool timedOut)
+	: std::runtime_error(timedOut ? "Timeout" : "Cancelled")
+	, m_timedOut(timedOut)
+{
+}
+
+bool OperationCancelled::TimedOut() const
+{
+	return m_timedOut;
+}
+
+void CancelToken::Cancel()
+{
+	m_cancelled.store(true, std::memory_order_relaxed);
+}
+
+void CancelToken::SetDeadline(std::chrono::steady_clock::time_point deadline)
+{
+	m_deadline = deadline;
+}
+
+void CancelToken::Check() const
+{
+	if (m_cancelled.load(std::memory_order_relaxed))
+	{
+		throw OperationCancelled(false);
+	}
+	if (m_deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > m_deadline)
+	{
+		throw OperationCancelled(true);
+	}
+}
+
+CancelScope::CancelScope(const CancelToken* token)
+	: m_previous(currentToken)
+{
+	currentToken = token;
+}
+
+CancelScope::~CancelScope()
+{
+	currentToken = m_previous;
+}
+
+void CheckCancelled()
+{
+	if (currentToken)
+	{
+		currentToken->Check();
+	}
+}
+
+const CancelToken* CurrentCancelToken()
+{
+	return currentToken;
+}
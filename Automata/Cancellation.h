@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+// thrown by CheckCancelled when the job of the thread was cancelled or ran past its deadline
+class OperationCancelled : public std::runtime_error
+{
+public:
+	explicit OperationCancelled(bool timedOut);
+	bool TimedOut() const;
+
+private:
+	bool m_timedOut;
+};
+
+class CancelToken
+{
+public:
+	void Cancel();
+	void SetDeadline(std::chrono::steady_clock::time_point deadline);
+	// throws OperationCancelled
+	void Check() const;
+
+private:
+	std::atomic<bool> m_cancelled{ false };
+	std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+};
+
+// makes token the one CheckCancelled looks at on this thread until destroyed
+class CancelScope
+{
+public:
+	explicit CancelScope(const CancelToken* token);
+	~CancelScope();
+	CancelScope(const CancelScope&) = delete;
+	CancelScope& operator=(const CancelScope&) = delete;
+
+private:
+	const CancelToken* m_previous;
+};
+
+// called between rounds, levels and blocks of the long loops; does nothing without a token
+void CheckCancelled();
+// the token of this thread (nullptr - none), for worker threads to open a CancelScope with
+const CancelToken* CurrentCancelToken();
@@ -0,0 +1,177 @@
+﻿#include "MappedFile.h"
+#include "Socket.h"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+const std::string RAW_MODE = "-";
+const std::string SHUTDOWN_COMMAND = "shutdown";
+const std::string INLINE_OPTION = "--inline";
+const std::string OUTPUT_OPTION = "--output";
+const std::string TIMEOUT_OPTION = "--timeout";
+const std::string REQUEST_ID = "1";
+
+struct Request
+{
+	std::string socketPath;
+	std::string command;
+	std::string inputFileName;
+	std::string outputFileName;
+	std::string timeoutMs;
+	std::string parameters; // " key=value" pairs passed through
+	bool sendInline = false;
+};
+
+// the service may run in another directory
+std::string AbsolutePath(const std::string& fileName)
+{
+	return std::filesystem::absolute(fileName).string();
+}
+
+// stdin goes to the service as it is, everything the service answers goes to stdout
+void RunRaw(const std::string& socketPath)
+{
+	Socket socket = ConnectUnix(socketPath);
+	std::thread writer([&socket] {
+		std::string line;
+		while (std::getline(std::cin, line) && socket.SendAll(line + "\n"))
+		{
+		}
+		socket.ShutdownWrite();
+	});
+	char buffer[1 << 16];
+	while (size_t received = socket.Receive(buffer, sizeof(buffer)))
+	{
+		std::cout.write(buffer, static_cast<std::streamsize>(received));
+		std::cout.flush();
+	}
+	writer.join();
+}
+
+// sends one request, the streamed result goes to stdout; returns false when the request failed
+bool RunRequest(const Request& request)
+{
+	Socket socket = ConnectUnix(request.socketPath);
+	std::string line = REQUEST_ID + " " + request.command;
+	std::string body;
+	if (request.command != SHUTDOWN_COMMAND)
+	{
+		if (request.sendInline)
+		{
+			MappedFile file(request.inputFileName);
+			body.assign(file.Data());
+			line += " inline=" + std::to_string(body.size());
+		}
+		else
+		{
+			line += " input=" + AbsolutePath(request.inputFileName);
+		}
+		if (!request.outputFileName.empty())
+		{
+			line += " output=" + AbsolutePath(request.outputFileName);
+		}
+		if (!request.timeoutMs.empty())
+		{
+			line += " timeout=" + request.timeoutMs;
+		}
+		line += request.parameters;
+	}
+	if (!socket.SendAll(line + "\n") || !socket.SendAll(body))
+	{
+		throw std::runtime_error("Cannot send the request");
+	}
+
+	SocketReader reader(socket);
+	std::string response;
+	std::string data;
+	while (reader.ReadLine(response))
+	{
+		std::istringstream fields(response);
+		std::string id;
+		std::string status;
+		fields >> id >> status;
+		if (status == "data")
+		{
+			size_t size = 0;
+			fields >> size;
+			if (!reader.ReadBytes(size, data))
+			{
+				break;
+			}
+			std::cout.write(data.data(), static_cast<std::streamsize>(data.size()));
+			continue;
+		}
+		std::cout.flush();
+		if (status == "ok")
+		{
+			return true;
+		}
+		std::string message;
+		std::getline(fields >> std::ws, message);
+		std::cerr << (status == "error" ? message : status) << std::endl;
+		return false;
+	}
+	throw std::runtime_error("The service closed the connection");
+}
+
+// reads "--name [value]" options and key=value parameters after the positional arguments
+bool ReadOptions(int argc, char* argv[], int first, Request& request)
+{
+	for (int i = first; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == INLINE_OPTION)
+		{
+			request.sendInline = true;
+		}
+		else if ((argument == OUTPUT_OPTION || argument == TIMEOUT_OPTION) && i + 1 < argc)
+		{
+			(argument == OUTPUT_OPTION ? request.outputFileName : request.timeoutMs) = argv[++i];
+		}
+		else if (argument.find('=') != std::string::npos && argument.find(' ') == std::string::npos)
+		{
+			request.parameters += " " + argument;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	Request request;
+	bool raw = argc == 3 && argv[2] == RAW_MODE;
+	bool shutdown = argc == 3 && argv[2] == SHUTDOWN_COMMAND;
+	if (!raw && !shutdown && !(argc >= 4 && ReadOptions(argc, argv, 4, request)))
+	{
+		std::cout << "Usage: " << argv[0] << " <socket> <command> <input.csv|.atm>"
+			<< " [--inline] [--output <file>] [--timeout <ms>] [key=value ...]" << std::endl
+			<< "       " << argv[0] << " <socket> shutdown" << std::endl
+			<< "       " << argv[0] << " <socket> -   (requests from stdin, responses to stdout)" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		if (raw)
+		{
+			RunRaw(argv[1]);
+			return 0;
+		}
+		request.socketPath = argv[1];
+		request.command = argv[2];
+		request.inputFileName = shutdown ? std::string() : argv[3];
+		return RunRequest(request) ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+}
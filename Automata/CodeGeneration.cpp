@@ -0,0 +1,356 @@
+﻿#include "CodeGeneration.h"
+#include "Stats.h"
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// a case per transition, more than this is no tiny machine and belongs in tables
+const size_t SWITCH_TRANSITION_LIMIT = 1 << 12;
+const size_t FLUSH_BYTES = 1 << 20;
+
+const std::set<std::string_view> KEYWORDS = { "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+	"bool", "break", "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept", "const",
+	"consteval", "constexpr", "constinit", "const_cast", "continue", "co_await", "co_return", "co_yield", "decltype",
+	"default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float",
+	"for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+	"nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "requires",
+	"return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "template",
+	"this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+	"virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq" };
+
+bool IsIdentifierChar(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// other characters become '_', without "__" that is reserved; names that cannot start an identifier get the prefix
+std::string Identifier(std::string_view name, std::string_view prefix)
+{
+	std::string identifier;
+	for (char c : name)
+	{
+		char next = IsIdentifierChar(c) ? c : '_';
+		if (next != '_' || identifier.empty() || identifier.back() != '_')
+		{
+			identifier.push_back(next);
+		}
+	}
+	if (identifier.empty() || (identifier[0] >= '0' && identifier[0] <= '9')
+		|| identifier[0] == '_' || KEYWORDS.count(identifier) != 0)
+	{
+		identifier = std::string(prefix) + (identifier.empty() || identifier[0] != '_' ? "_" : "") + identifier;
+	}
+	return identifier;
+}
+
+// unique identifiers of all names of the table, a repeated one gets the id
+std::vector<std::string> Identifiers(const SymbolTable& table, std::string_view prefix)
+{
+	std::vector<std::string> identifiers;
+	std::set<std::string> used;
+	for (uint32_t id = 0; id < SymbolCount(table); id++)
+	{
+		std::string identifier = Identifier(Name(table, id), prefix);
+		if (used.count(identifier) != 0)
+		{
+			identifier += "_" + std::to_string(id);
+		}
+		while (used.count(identifier) != 0)
+		{
+			identifier += "_";
+		}
+		used.insert(identifier);
+		identifiers.push_back(identifier);
+	}
+	return identifiers;
+}
+
+// the smallest type for the values [0, count)
+std::string IntegerType(uint32_t count)
+{
+	return count <= 0x100 ? "std::uint8_t" : (count <= 0x10000 ? "std::uint16_t" : "std::uint32_t");
+}
+
+void AppendLiteral(std::string& buffer, std::string_view text)
+{
+	buffer.push_back('"');
+	for (char c : text)
+	{
+		unsigned char code = static_cast<unsigned char>(c);
+		if (c == '"' || c == '\\')
+		{
+			buffer.push_back('\\');
+			buffer.push_back(c);
+		}
+		else if (code < 0x20 || code >= 0x7f)
+		{
+			// three octal digits always end the escape
+			buffer += { '\\', char('0' + (code >> 6)), char('0' + ((code >> 3) & 7)), char('0' + (code & 7)) };
+		}
+		else
+		{
+			buffer.push_back(c);
+		}
+	}
+	buffer.push_back('"');
+}
+
+class Emitter
+{
+public:
+	explicit Emitter(std::ostream& output)
+		: m_output(output)
+	{
+	}
+
+	Emitter& operator<<(std::string_view text)
+	{
+		m_buffer.append(text.data(), text.size());
+		if (m_buffer.size() >= FLUSH_BYTES)
+		{
+			Flush();
+		}
+		return *this;
+	}
+
+	Emitter& operator<<(uint64_t number)
+	{
+		return *this << std::string_view(std::to_string(number));
+	}
+
+	Emitter& Literal(std::string_view text)
+	{
+		AppendLiteral(m_buffer, text);
+		return *this;
+	}
+
+	void Flush()
+	{
+		if (!m_output.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size())))
+		{
+			throw std::runtime_error("Cannot write the output file");
+		}
+		AddBytesWritten(m_buffer.size());
+		m_buffer.clear();
+	}
+
+private:
+	std::ostream& m_output;
+	std::string m_buffer;
+};
+
+struct Enums
+{
+	std::vector<std::string> states;
+	std::vector<std::string> inputs;
+	std::vector<std::string> outputs;
+};
+
+void EmitEnum(Emitter& emitter, std::string_view type, const std::vector<std::string>& identifiers)
+{
+	emitter << "enum class " << type << " : " << IntegerType(static_cast<uint32_t>(identifiers.size())) << "\n{\n";
+	for (const auto& identifier : identifiers)
+	{
+		emitter << "\t" << identifier << ",\n";
+	}
+	emitter << "};\n\n";
+}
+
+void EmitNames(Emitter& emitter, std::string_view arrayName, std::string_view countName, const SymbolTable& table)
+{
+	emitter << "inline constexpr const char* " << arrayName << "[" << countName << "] = {";
+	for (uint32_t id = 0; id < SymbolCount(table); id++)
+	{
+		emitter << (id % 16 == 0 ? "\n\t" : " ");
+		emitter.Literal(Name(table, id)) << ",";
+	}
+	emitter << "\n};\n";
+}
+
+// the enums, counts, start state and names
+template <typename Automaton>
+Enums EmitHead(Emitter& emitter, const Automaton& automaton, const std::string& namespaceName, std::string_view kind)
+{
+	if (StateCount(automaton) == 0 || EntryCount(automaton) == 0)
+	{
+		throw std::runtime_error("Cannot generate code for a machine without states or inputs");
+	}
+	Enums enums{ Identifiers(automaton.states, "s"), Identifiers(automaton.entries, "x"), Identifiers(automaton.outputs, "y") };
+	emitter << "// " << kind << " machine, generated file. Needs C++17, allocates nothing and works in constant expressions.\n"
+		<< "#pragma once\n#include <cstddef>\n#include <cstdint>\n\n"
+		<< "namespace " << Identifier(namespaceName, "machine") << "\n{\n";
+	EmitEnum(emitter, "State", enums.states);
+	EmitEnum(emitter, "Input", enums.inputs);
+	EmitEnum(emitter, "Output", enums.outputs);
+	emitter << "inline constexpr std::size_t STATE_COUNT = " << uint64_t(enums.states.size()) << ";\n"
+		<< "inline constexpr std::size_t INPUT_COUNT = " << uint64_t(enums.inputs.size()) << ";\n"
+		<< "inline constexpr std::size_t OUTPUT_COUNT = " << uint64_t(enums.outputs.size()) << ";\n"
+		<< "inline constexpr State START = State::" << enums.states[0] << ";\n\n";
+	EmitNames(emitter, "STATE_NAMES", "STATE_COUNT", automaton.states);
+	EmitNames(emitter, "INPUT_NAMES", "INPUT_COUNT", automaton.entries);
+	EmitNames(emitter, "OUTPUT_NAMES", "OUTPUT_COUNT", automaton.outputs);
+	emitter << "\n"
+		<< "constexpr const char* name(State value) noexcept\n{\n\treturn STATE_NAMES[static_cast<std::size_t>(value)];\n}\n\n"
+		<< "constexpr const char* name(Input value) noexcept\n{\n\treturn INPUT_NAMES[static_cast<std::size_t>(value)];\n}\n\n"
+		<< "constexpr const char* name(Output value) noexcept\n{\n\treturn OUTPUT_NAMES[static_cast<std::size_t>(value)];\n}\n\n"
+		<< "struct Transition\n{\n\tState state;\n\tOutput output;\n};\n\n";
+	return enums;
+}
+
+// values[state][entry] or values[state] with entryCount 0
+void EmitTable(Emitter& emitter, std::string_view tableName, uint32_t valueCount, const std::vector<uint32_t>& values,
+	uint32_t entryCount)
+{
+	emitter << "inline constexpr " << IntegerType(valueCount) << " " << tableName << "[STATE_COUNT]"
+		<< (entryCount != 0 ? "[INPUT_COUNT]" : "") << " = {";
+	if (entryCount == 0)
+	{
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			emitter << (i % 16 == 0 ? "\n\t" : " ") << uint64_t(values[i]) << ",";
+		}
+	}
+	for (size_t row = 0; entryCount != 0 && row < values.size(); row += entryCount)
+	{
+		emitter << "\n\t{";
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			emitter << (entry == 0 ? " " : ", ") << uint64_t(values[row + entry]);
+		}
+		emitter << " },";
+	}
+	emitter << "\n};\n\n";
+}
+
+void EmitRun(Emitter& emitter)
+{
+	emitter << "// runs the inputs from the state and returns the state it ends in\n"
+		<< "constexpr State run(const Input* inputs, std::size_t count, State state = START) noexcept\n{\n"
+		<< "\tfor (std::size_t i = 0; i < count; i++)\n\t{\n\t\tstate = step(state, inputs[i]).state;\n\t}\n"
+		<< "\treturn state;\n}\n\n"
+		<< "// the same with the output of every step in outputs[i]\n"
+		<< "constexpr State run(const Input* inputs, std::size_t count, Output* outputs, State state = START) noexcept\n{\n"
+		<< "\tfor (std::size_t i = 0; i < count; i++)\n\t{\n\t\tTransition transition = step(state, inputs[i]);\n"
+		<< "\t\toutputs[i] = transition.output;\n\t\tstate = transition.state;\n\t}\n"
+		<< "\treturn state;\n}\n"
+		<< "}\n";
+}
+
+// switch (state) { case: switch (input) { case: return { next, output }; } }
+template <typename TransitionOf>
+void EmitSwitchStep(Emitter& emitter, const Enums& enums, TransitionOf transitionOf)
+{
+	emitter << "constexpr Transition step(State state, Input input) noexcept\n{\n\tswitch (state)\n\t{\n";
+	uint32_t entryCount = static_cast<uint32_t>(enums.inputs.size());
+	for (uint32_t state = 0; state < enums.states.size(); state++)
+	{
+		emitter << "\tcase State::" << enums.states[state] << ":\n\t\tswitch (input)\n\t\t{\n";
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			auto [target, out] = transitionOf(state * entryCount + entry);
+			emitter << "\t\tcase Input::" << enums.inputs[entry] << ":\n\t\t\treturn { State::" << enums.states[target]
+				<< ", Output::" << enums.outputs[out] << " };\n";
+		}
+		emitter << "\t\t}\n\t\tbreak;\n";
+	}
+	emitter << "\t}\n\treturn { state, static_cast<Output>(0) };\n}\n\n";
+}
+
+template <typename Automaton>
+void CheckSwitchSize(const Automaton& automaton)
+{
+	if (automaton.transitions.size() > SWITCH_TRANSITION_LIMIT)
+	{
+		throw std::runtime_error("The machine is too large for switches, generate tables");
+	}
+}
+
+std::ofstream OpenOutput(const std::string& outFileName)
+{
+	std::ofstream output(outFileName, std::ios::binary);
+	if (!output)
+	{
+		throw std::runtime_error("Cannot open file " + outFileName);
+	}
+	return output;
+}
+
+std::string NamespaceName(const std::string& outFileName)
+{
+	return std::filesystem::path(outFileName).stem().string();
+}
+}
+
+void WriteCppMealy(const Mealy& mealy, std::ostream& output, const std::string& namespaceName, CppStyle style)
+{
+	Emitter emitter(output);
+	Enums enums = EmitHead(emitter, mealy, namespaceName, "Mealy");
+	if (style == CppStyle::Switch)
+	{
+		CheckSwitchSize(mealy);
+		EmitSwitchStep(emitter, enums, [&mealy](size_t transition) {
+			return std::pair(mealy.transitions[transition], mealy.outs[transition]);
+		});
+	}
+	else
+	{
+		EmitTable(emitter, "NEXT", StateCount(mealy), mealy.transitions, EntryCount(mealy));
+		EmitTable(emitter, "OUTPUTS", static_cast<uint32_t>(enums.outputs.size()), mealy.outs, EntryCount(mealy));
+		emitter << "constexpr Transition step(State state, Input input) noexcept\n{\n"
+			<< "\tstd::size_t s = static_cast<std::size_t>(state);\n\tstd::size_t i = static_cast<std::size_t>(input);\n"
+			<< "\treturn { static_cast<State>(NEXT[s][i]), static_cast<Output>(OUTPUTS[s][i]) };\n}\n\n";
+	}
+	EmitRun(emitter);
+	emitter.Flush();
+}
+
+void WriteCppMoore(const Moore& moore, std::ostream& output, const std::string& namespaceName, CppStyle style)
+{
+	Emitter emitter(output);
+	Enums enums = EmitHead(emitter, moore, namespaceName, "Moore");
+	if (style == CppStyle::Switch)
+	{
+		CheckSwitchSize(moore);
+		emitter << "constexpr Output output(State state) noexcept\n{\n\tswitch (state)\n\t{\n";
+		for (uint32_t state = 0; state < StateCount(moore); state++)
+		{
+			emitter << "\tcase State::" << enums.states[state] << ":\n\t\treturn Output::" << enums.outputs[moore.outs[state]]
+				<< ";\n";
+		}
+		emitter << "\t}\n\treturn static_cast<Output>(0);\n}\n\n";
+		EmitSwitchStep(emitter, enums, [&moore](size_t transition) {
+			return std::pair(moore.transitions[transition], moore.outs[moore.transitions[transition]]);
+		});
+	}
+	else
+	{
+		EmitTable(emitter, "NEXT", StateCount(moore), moore.transitions, EntryCount(moore));
+		EmitTable(emitter, "OUTPUTS", static_cast<uint32_t>(enums.outputs.size()), moore.outs, 0);
+		emitter << "constexpr Output output(State state) noexcept\n{\n"
+			<< "\treturn static_cast<Output>(OUTPUTS[static_cast<std::size_t>(state)]);\n}\n\n"
+			<< "// the output is the one of the state the step enters\n"
+			<< "constexpr Transition step(State state, Input input) noexcept\n{\n"
+			<< "\tState next = static_cast<State>(NEXT[static_cast<std::size_t>(state)][static_cast<std::size_t>(input)]);\n"
+			<< "\treturn { next, output(next) };\n}\n\n";
+	}
+	EmitRun(emitter);
+	emitter.Flush();
+}
+
+void WriteCppMealy(const Mealy& mealy, const std::string& outFileName, CppStyle style)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteCppMealy(mealy, output, NamespaceName(outFileName), style);
+}
+
+void WriteCppMoore(const Moore& moore, const std::string& outFileName, CppStyle style)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteCppMoore(moore, output, NamespaceName(outFileName), style);
+}
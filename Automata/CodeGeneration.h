@@ -0,0 +1,21 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <ostream>
+#include <string>
+
+enum class CppStyle
+{
+	Tables, // constexpr next-state and output tables, a step is two loads without branches
+	Switch, // nested switches over the state and the input, for tiny machines
+};
+
+// A self-contained C++17 header in namespaceName: enums of the states, inputs and outputs on the smallest
+// unsigned types that hold them, their names, the constexpr step(state, input) and run(inputs, count[, outputs])
+// from the start state. Nothing is allocated and all of it works in constant expressions. Names that are no
+// identifiers are mangled, the original ones stay in the name tables. A Moore machine also gets output(state),
+// its steps output the signal of the state they enter.
+void WriteCppMealy(const Mealy& mealy, std::ostream& output, const std::string& namespaceName, CppStyle style);
+void WriteCppMoore(const Moore& moore, std::ostream& output, const std::string& namespaceName, CppStyle style);
+// the namespace is the name of the file without its extension
+void WriteCppMealy(const Mealy& mealy, const std::string& outFileName, CppStyle style);
+void WriteCppMoore(const Moore& moore, const std::string& outFileName, CppStyle style);
@@ -0,0 +1,156 @@
+﻿#include "Conversion.h"
+#include "Alphabet.h"
+#include "Analysis.h"
+#include "Cancellation.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// the conversion looks for cancellation after this many new states
+const size_t CANCEL_CHECK_STATES = 1 << 16;
+
+// the first output by name of the transitions from the kept states into the start state
+template <typename Keep>
+uint32_t FindStartOutput(const Mealy& mealy, Keep keep, SymbolTable& outputs)
+{
+	uint32_t entryCount = EntryCount(mealy);
+	uint32_t startOutput = NO_ID;
+	for (size_t i = 0; i < mealy.transitions.size(); i++)
+	{
+		if (mealy.transitions[i] == 0 && keep(static_cast<uint32_t>(i / entryCount))
+			&& (startOutput == NO_ID || Name(mealy.outputs, mealy.outs[i]) < Name(mealy.outputs, startOutput)))
+		{
+			startOutput = mealy.outs[i];
+		}
+	}
+	return (startOutput != NO_ID) ? startOutput : Intern(outputs, "");
+}
+
+// moore states {state, output} in the order they were added, with an open addressing index of their ids
+class PairIndex
+{
+public:
+	// the id of the pair, adding it if it is new
+	uint32_t Add(uint32_t state, uint32_t output)
+	{
+		if (m_slots.size() < 2 * (m_pairs.size() + 1))
+		{
+			Grow();
+		}
+		size_t mask = m_slots.size() - 1;
+		size_t slot = Hash(state, output) & mask;
+		for (; m_slots[slot] != NO_ID; slot = (slot + 1) & mask)
+		{
+			if (m_pairs[m_slots[slot]] == std::make_pair(state, output))
+			{
+				return m_slots[slot];
+			}
+		}
+		m_slots[slot] = static_cast<uint32_t>(m_pairs.size());
+		m_pairs.emplace_back(state, output);
+		return m_slots[slot];
+	}
+
+	const std::vector<std::pair<uint32_t, uint32_t>>& Pairs() const
+	{
+		return m_pairs;
+	}
+
+private:
+	static size_t Hash(uint32_t state, uint32_t output)
+	{
+		uint64_t x = (uint64_t(state) << 32 | output) * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(x ^ (x >> 29));
+	}
+
+	void Grow()
+	{
+		m_slots.assign(std::max<size_t>(16, m_slots.size() * 2), NO_ID);
+		size_t mask = m_slots.size() - 1;
+		for (uint32_t id = 0; id < m_pairs.size(); id++)
+		{
+			size_t slot = Hash(m_pairs[id].first, m_pairs[id].second) & mask;
+			while (m_slots[slot] != NO_ID)
+			{
+				slot = (slot + 1) & mask;
+			}
+			m_slots[slot] = id;
+		}
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> m_pairs;
+	std::vector<uint32_t> m_slots;
+};
+
+// the Moore machine of all the pairs reachable from the start
+Moore BuildMoore(const Mealy& mealy, unsigned threads)
+{
+	uint32_t entryCount = EntryCount(mealy);
+	Moore moore;
+	moore.entries = mealy.entries;
+	moore.outputs = mealy.outputs;
+	if (StateCount(mealy) == 0)
+	{
+		return moore;
+	}
+	StateBits reachable = FindReachableStates(mealy.transitions, StateCount(mealy), entryCount, threads);
+	uint32_t startOutput = FindStartOutput(mealy, [&reachable](uint32_t state) { return TestBit(reachable, state); },
+		moore.outputs);
+
+	// moore states {s, y} get their ids as the BFS finds them, state {s, y} goes where s goes
+	PairIndex index;
+	index.Add(0, startOutput);
+	for (size_t head = 0; head < index.Pairs().size(); head++)
+	{
+		if (head % CANCEL_CHECK_STATES == 0)
+		{
+			CheckCancelled();
+		}
+		auto [state, out] = index.Pairs()[head];
+		moore.outs.push_back(out);
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t cell = size_t(state) * entryCount + entry;
+			moore.transitions.push_back(index.Add(mealy.transitions[cell], mealy.outs[cell]));
+		}
+	}
+	moore.states = NumberedSymbols("q", static_cast<uint32_t>(index.Pairs().size()));
+	return moore;
+}
+
+}
+
+uint32_t StartOutput(const Mealy& mealy, SymbolTable& outputs)
+{
+	return FindStartOutput(mealy, [](uint32_t) { return true; }, outputs);
+}
+
+// the pairs are found over one entry per class of equal columns, the other entries copy the row of their class
+Moore MealyToMoore(const Mealy& mealy, unsigned threads)
+{
+	EntryClasses entryClasses = GroupEntries(mealy, threads);
+	if (ClassCount(entryClasses) == EntryCount(mealy))
+	{
+		return BuildMoore(mealy, threads);
+	}
+	return ExpandEntries(BuildMoore(CompressEntries(mealy, entryClasses), threads), entryClasses, mealy.entries, threads);
+}
+
+Mealy MooreToMealy(const Moore& moore)
+{
+	// выходной символ перехода - выходной символ состояния, в которое он ведёт
+	Mealy mealy;
+	mealy.states = moore.states;
+	mealy.entries = moore.entries;
+	mealy.outputs = moore.outputs;
+	mealy.transitions = moore.transitions;
+	mealy.outs.resize(mealy.transitions.size());
+	for (size_t i = 0; i < mealy.transitions.size(); i++)
+	{
+		mealy.outs[i] = moore.outs[mealy.transitions[i]];
+	}
+
+	return mealy;
+}
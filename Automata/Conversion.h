@@ -0,0 +1,16 @@
+﻿#pragma once
+#include "Automaton.h"
+
+// equivalent Moore machine over the states reachable from the start state: one Moore state per pair
+// {target state, output} of the Mealy transitions, named q0, q1, ... in the order a BFS from the start finds
+// them. q0 is the start state with the output of StartOutput. Every row is filled once, O(Moore states * entries),
+// and only the entries with distinct columns look their pairs up.
+Moore MealyToMoore(const Mealy& mealy, unsigned threads = 0);
+
+// output of the Moore state the start state becomes, for a machine whose states are all reachable:
+// the first output by name of the transitions into the start state, or an empty output added to outputs
+// when no transition leads there
+uint32_t StartOutput(const Mealy& mealy, SymbolTable& outputs);
+
+// equivalent Mealy machine with the same states: a transition outputs the signal of its target
+Mealy MooreToMealy(const Moore& moore);
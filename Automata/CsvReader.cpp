@@ -0,0 +1,491 @@
+﻿#include "Automaton.h"
+#include "Cancellation.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Scanner.h"
+#include "Sparse.h"
+#include "Stats.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace
+{
+const char DELIMETER = ';';
+const char SLASH = '/';
+const size_t TRANSPOSE_TILE = 64;
+// lines of entries shorter than this are parsed on the calling thread
+const size_t PARALLEL_PARSE_BYTES = 1 << 20;
+
+uint32_t FindState(const SymbolTable& states, std::string_view name)
+{
+	uint32_t id = Find(states, name);
+	if (id == NO_ID)
+	{
+		throw std::runtime_error("Unknown state " + std::string(name));
+	}
+	return id;
+}
+
+void CheckRowSize(std::string_view entry, size_t cellCount, uint32_t stateCount)
+{
+	if (cellCount != stateCount)
+	{
+		throw std::runtime_error("Entry " + std::string(entry) + " has " + std::to_string(cellCount)
+			+ " transitions, expected " + std::to_string(stateCount));
+	}
+}
+
+// the rows of one range of lines, entry by entry; outs are ids in outputs, the outputs met in the range
+struct ParsedRows
+{
+	std::vector<std::string_view> entries;
+	std::vector<uint32_t> transitions;
+	std::vector<uint32_t> outs;
+	SymbolTable outputs;
+	std::vector<uint32_t> sources; // partial rows: the state of every defined cell
+	std::vector<uint32_t> rowEnds; // partial rows: the end of the defined cells of every entry
+	std::exception_ptr error;
+};
+
+// the text cut into ranges of whole lines, one per thread unless it is small
+std::vector<std::string_view> SplitLines(std::string_view text, unsigned threads)
+{
+	size_t pieceCount = (text.size() < PARALLEL_PARSE_BYTES) ? 1 : ThreadCount(threads);
+	std::vector<std::string_view> pieces;
+	for (size_t piece = 1, begin = 0; begin < text.size(); piece++)
+	{
+		size_t end = text.size();
+		if (piece < pieceCount)
+		{
+			size_t lineEnd = text.find('\n', std::max(begin, text.size() * piece / pieceCount));
+			end = (lineEnd != std::string_view::npos) ? lineEnd + 1 : text.size();
+		}
+		pieces.push_back(text.substr(begin, end - begin));
+		begin = end;
+	}
+	return pieces;
+}
+
+// parseRows(range, rows) on every range; the error of the first range that failed is thrown, which is
+// the one reading the lines in order would have thrown
+template <typename ParseRows>
+std::vector<ParsedRows> ParseRanges(std::string_view text, unsigned threads, ParseRows parseRows)
+{
+	std::vector<std::string_view> pieces = SplitLines(text, threads);
+	std::vector<ParsedRows> parsed(pieces.size());
+	const CancelToken* token = CurrentCancelToken();
+	ParallelFor(pieces.size(), threads, [&](size_t begin, size_t end, unsigned) {
+		CancelScope cancelScope(token);
+		for (size_t piece = begin; piece < end; piece++)
+		{
+			try
+			{
+				parseRows(pieces[piece], parsed[piece]);
+			}
+			catch (...)
+			{
+				parsed[piece].error = std::current_exception();
+				return;
+			}
+		}
+	});
+	for (const ParsedRows& rows : parsed)
+	{
+		if (rows.error)
+		{
+			std::rethrow_exception(rows.error);
+		}
+	}
+	return parsed;
+}
+
+// the rows of a range into their place in the tables stored state by state, tile by tile to stay in cache;
+// ids, when not null, maps the values
+void TransposeInto(const std::vector<uint32_t>& rows, size_t rowCount, size_t columnCount, std::vector<uint32_t>& columns,
+	size_t totalRows, size_t firstRow, const std::vector<uint32_t>* ids)
+{
+	for (size_t rowTile = 0; rowTile < rowCount; rowTile += TRANSPOSE_TILE)
+	{
+		for (size_t columnTile = 0; columnTile < columnCount; columnTile += TRANSPOSE_TILE)
+		{
+			size_t rowEnd = std::min(rowCount, rowTile + TRANSPOSE_TILE);
+			size_t columnEnd = std::min(columnCount, columnTile + TRANSPOSE_TILE);
+			for (size_t row = rowTile; row < rowEnd; row++)
+			{
+				for (size_t column = columnTile; column < columnEnd; column++)
+				{
+					uint32_t value = rows[row * columnCount + column];
+					columns[column * totalRows + firstRow + row] = ids ? (*ids)[value] : value;
+				}
+			}
+		}
+	}
+}
+
+// the entries of all ranges in order and the first row of every range; outputs, when not null, get their ids
+// in the order one pass over the lines would have met them, so the result does not depend on the ranges
+std::vector<size_t> MergeSymbols(const std::vector<ParsedRows>& parsed, SymbolTable& entries, SymbolTable* outputs,
+	std::vector<std::vector<uint32_t>>& outputIds)
+{
+	std::vector<size_t> firstRows{ 0 };
+	outputIds.assign(parsed.size(), {});
+	for (size_t piece = 0; piece < parsed.size(); piece++)
+	{
+		for (std::string_view entry : parsed[piece].entries)
+		{
+			Append(entries, entry);
+		}
+		firstRows.push_back(firstRows.back() + parsed[piece].entries.size());
+		for (uint32_t id = 0; outputs && id < SymbolCount(parsed[piece].outputs); id++)
+		{
+			outputIds[piece].push_back(Intern(*outputs, Name(parsed[piece].outputs, id)));
+		}
+	}
+	return firstRows;
+}
+
+// the tables of all ranges state by state
+void MergeRows(const std::vector<ParsedRows>& parsed, uint32_t stateCount, SymbolTable& entries,
+	std::vector<uint32_t>& transitions, std::vector<uint32_t>* outs, SymbolTable* outputs, unsigned threads)
+{
+	std::vector<std::vector<uint32_t>> outputIds;
+	std::vector<size_t> firstRows = MergeSymbols(parsed, entries, outputs, outputIds);
+
+	size_t rowCount = firstRows.back();
+	transitions.resize(rowCount * stateCount);
+	if (outs)
+	{
+		outs->resize(rowCount * stateCount);
+	}
+	ParallelFor(parsed.size(), threads, [&](size_t begin, size_t end, unsigned) {
+		for (size_t piece = begin; piece < end; piece++)
+		{
+			const ParsedRows& rows = parsed[piece];
+			TransposeInto(rows.transitions, rows.entries.size(), stateCount, transitions, rowCount, firstRows[piece], nullptr);
+			if (outs)
+			{
+				TransposeInto(rows.outs, rows.entries.size(), stateCount, *outs, rowCount, firstRows[piece], &outputIds[piece]);
+			}
+		}
+	});
+}
+
+// the defined cells of all ranges grouped state by state, the transitions of a state in the order of the entries
+void MergeSparseRows(const std::vector<ParsedRows>& parsed, uint32_t stateCount, SymbolTable& entries,
+	std::vector<uint32_t>& offsets, std::vector<uint32_t>& labels, std::vector<uint32_t>& targets,
+	std::vector<uint32_t>* outs, SymbolTable* outputs)
+{
+	std::vector<std::vector<uint32_t>> outputIds;
+	std::vector<size_t> firstRows = MergeSymbols(parsed, entries, outputs, outputIds);
+
+	std::vector<size_t> counts(size_t(stateCount) + 1, 0);
+	for (const ParsedRows& rows : parsed)
+	{
+		for (uint32_t source : rows.sources)
+		{
+			counts[source + 1]++;
+		}
+	}
+	for (uint32_t state = 1; state <= stateCount; state++)
+	{
+		counts[state] += counts[state - 1];
+	}
+	if (counts.back() > UINT32_MAX)
+	{
+		throw std::runtime_error("Automata has more than " + std::to_string(UINT32_MAX) + " transitions");
+	}
+	offsets.assign(counts.begin(), counts.end());
+	labels.resize(counts.back());
+	targets.resize(counts.back());
+	if (outs)
+	{
+		outs->resize(counts.back());
+	}
+
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t piece = 0; piece < parsed.size(); piece++)
+	{
+		const ParsedRows& rows = parsed[piece];
+		size_t cell = 0;
+		for (size_t row = 0; row < rows.rowEnds.size(); row++)
+		{
+			for (; cell < rows.rowEnds[row]; cell++)
+			{
+				uint32_t t = fill[rows.sources[cell]]++;
+				labels[t] = static_cast<uint32_t>(firstRows[piece] + row);
+				targets[t] = rows.transitions[cell];
+				if (outs)
+				{
+					(*outs)[t] = outputIds[piece][rows.outs[cell]];
+				}
+			}
+		}
+	}
+}
+
+// header line ";name;name;..." without its first cell
+void ReadHeader(std::string_view line, std::vector<std::string_view>& cells)
+{
+	cells.clear();
+	std::string_view cell;
+	NextCell(line, cell);
+	while (NextCell(line, cell))
+	{
+		cells.push_back(cell);
+	}
+}
+
+// the states of mealy from its header line
+template <typename Automaton>
+void ReadMealyHeader(std::string_view& text, Automaton& mealy)
+{
+	std::string_view line;
+	std::vector<std::string_view> cells;
+	NextLine(text, line);
+	ReadHeader(line, cells);
+	for (std::string_view state : cells)
+	{
+		Append(mealy.states, state);
+	}
+}
+
+// the output signals and states of moore from its two header lines
+template <typename Automaton>
+void ReadMooreHeader(std::string_view& text, Automaton& moore)
+{
+	std::string_view outLine;
+	std::string_view stateLine;
+	NextLine(text, outLine);
+	NextLine(text, stateLine);
+	std::vector<std::string_view> outCells;
+	std::vector<std::string_view> stateCells;
+	ReadHeader(outLine, outCells);
+	ReadHeader(stateLine, stateCells);
+	for (size_t i = 0; i < outCells.size() && i < stateCells.size(); i++)
+	{
+		Append(moore.states, stateCells[i]);
+		moore.outs.push_back(Intern(moore.outputs, outCells[i]));
+	}
+}
+
+// cuts the next "state/output" cell off the line
+void NextTransition(std::string_view& line, std::string_view& state, std::string_view& out)
+{
+	const char* begin = line.data();
+	const char* end = begin + line.size();
+	const char* delimiter = FindAny(begin, end, DELIMETER, SLASH);
+	state = std::string_view(begin, delimiter - begin);
+	out = state; // a cell without a slash is used as both, as substr did before
+	if (delimiter != end && *delimiter == SLASH)
+	{
+		const char* outEnd = FindChar(delimiter + 1, end, DELIMETER);
+		out = std::string_view(delimiter + 1, outEnd - delimiter - 1);
+		delimiter = outEnd;
+	}
+	line.remove_prefix(delimiter - begin + (delimiter != end ? 1 : 0));
+}
+
+bool IsUndefined(std::string_view state)
+{
+	return state.empty() || state == UNDEFINED_CELL;
+}
+
+// entries and transitions of mealy, every cell is "state/output"
+void ParseMealyRows(std::string_view text, const SymbolTable& states, ParsedRows& rows)
+{
+	std::string_view line;
+	while (NextLine(text, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		CheckCancelled();
+		std::string_view entry;
+		NextCell(line, entry);
+		rows.entries.push_back(entry);
+
+		size_t cellCount = 0;
+		std::string_view state;
+		std::string_view out;
+		while (!line.empty())
+		{
+			NextTransition(line, state, out);
+			rows.transitions.push_back(FindState(states, state));
+			rows.outs.push_back(Intern(rows.outputs, out));
+			cellCount++;
+		}
+		CheckRowSize(entry, cellCount, SymbolCount(states));
+	}
+}
+
+// entries and transitions of moore
+void ParseMooreRows(std::string_view text, const SymbolTable& states, ParsedRows& rows)
+{
+	std::string_view line;
+	while (NextLine(text, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		CheckCancelled();
+		std::string_view entry;
+		NextCell(line, entry);
+		rows.entries.push_back(entry);
+
+		size_t cellCount = 0;
+		std::string_view cell;
+		while (NextCell(line, cell))
+		{
+			rows.transitions.push_back(FindState(states, cell));
+			cellCount++;
+		}
+		CheckRowSize(entry, cellCount, SymbolCount(states));
+	}
+}
+
+// entries and defined transitions of a partial mealy, rows may end before the last state
+void ParseSparseMealyRows(std::string_view text, const SymbolTable& states, ParsedRows& rows)
+{
+	std::string_view line;
+	while (NextLine(text, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		CheckCancelled();
+		std::string_view entry;
+		NextCell(line, entry);
+		rows.entries.push_back(entry);
+
+		uint32_t cellCount = 0;
+		std::string_view state;
+		std::string_view out;
+		for (; !line.empty(); cellCount++)
+		{
+			NextTransition(line, state, out);
+			if (!IsUndefined(state))
+			{
+				rows.sources.push_back(cellCount);
+				rows.transitions.push_back(FindState(states, state));
+				rows.outs.push_back(Intern(rows.outputs, out));
+			}
+		}
+		if (cellCount > SymbolCount(states))
+		{
+			CheckRowSize(entry, cellCount, SymbolCount(states));
+		}
+		rows.rowEnds.push_back(static_cast<uint32_t>(rows.sources.size()));
+	}
+}
+
+// entries and defined transitions of a partial moore, rows may end before the last state
+void ParseSparseMooreRows(std::string_view text, const SymbolTable& states, ParsedRows& rows)
+{
+	std::string_view line;
+	while (NextLine(text, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+		CheckCancelled();
+		std::string_view entry;
+		NextCell(line, entry);
+		rows.entries.push_back(entry);
+
+		uint32_t cellCount = 0;
+		std::string_view cell;
+		for (; NextCell(line, cell); cellCount++)
+		{
+			if (!IsUndefined(cell))
+			{
+				rows.sources.push_back(cellCount);
+				rows.transitions.push_back(FindState(states, cell));
+			}
+		}
+		if (cellCount > SymbolCount(states))
+		{
+			CheckRowSize(entry, cellCount, SymbolCount(states));
+		}
+		rows.rowEnds.push_back(static_cast<uint32_t>(rows.sources.size()));
+	}
+}
+}
+
+Mealy ParseMealy(std::string_view text, unsigned threads)
+{
+	Mealy mealy;
+	ReadMealyHeader(text, mealy);
+
+	// the lines of entries are parsed in ranges side by side
+	std::vector<ParsedRows> parsed = ParseRanges(text, threads,
+		[&mealy](std::string_view range, ParsedRows& rows) { ParseMealyRows(range, mealy.states, rows); });
+	MergeRows(parsed, StateCount(mealy), mealy.entries, mealy.transitions, &mealy.outs, &mealy.outputs, threads);
+	return mealy;
+}
+
+Moore ParseMoore(std::string_view text, unsigned threads)
+{
+	Moore moore;
+	ReadMooreHeader(text, moore);
+
+	// the lines of entries are parsed in ranges side by side
+	std::vector<ParsedRows> parsed = ParseRanges(text, threads,
+		[&moore](std::string_view range, ParsedRows& rows) { ParseMooreRows(range, moore.states, rows); });
+	MergeRows(parsed, StateCount(moore), moore.entries, moore.transitions, nullptr, nullptr, threads);
+	return moore;
+}
+
+Mealy ReadMealy(const std::string& inFileName, unsigned threads)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	return ParseMealy(file.Data(), threads);
+}
+
+Moore ReadMoore(const std::string& inFileName, unsigned threads)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	return ParseMoore(file.Data(), threads);
+}
+
+SparseMealy ParseSparseMealy(std::string_view text, unsigned threads)
+{
+	SparseMealy mealy;
+	ReadMealyHeader(text, mealy);
+	std::vector<ParsedRows> parsed = ParseRanges(text, threads,
+		[&mealy](std::string_view range, ParsedRows& rows) { ParseSparseMealyRows(range, mealy.states, rows); });
+	MergeSparseRows(parsed, StateCount(mealy), mealy.entries, mealy.offsets, mealy.labels, mealy.targets, &mealy.outs,
+		&mealy.outputs);
+	return mealy;
+}
+
+SparseMoore ParseSparseMoore(std::string_view text, unsigned threads)
+{
+	SparseMoore moore;
+	ReadMooreHeader(text, moore);
+	std::vector<ParsedRows> parsed = ParseRanges(text, threads,
+		[&moore](std::string_view range, ParsedRows& rows) { ParseSparseMooreRows(range, moore.states, rows); });
+	MergeSparseRows(parsed, StateCount(moore), moore.entries, moore.offsets, moore.labels, moore.targets, nullptr,
+		nullptr);
+	return moore;
+}
+
+SparseMealy ReadSparseMealy(const std::string& inFileName, unsigned threads)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	return ParseSparseMealy(file.Data(), threads);
+}
+
+SparseMoore ReadSparseMoore(const std::string& inFileName, unsigned threads)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	return ParseSparseMoore(file.Data(), threads);
+}
@@ -0,0 +1,246 @@
+﻿#include "Automaton.h"
+#include "Cancellation.h"
+#include "Parallel.h"
+#include "Sparse.h"
+#include "Stats.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+const char DELIMETER = ';';
+const char SLASH = '/';
+// rows are cut into pieces of about this many bytes, every thread formats a run of pieces
+const size_t PIECE_BYTES = 1 << 20;
+const size_t PIECES_PER_THREAD = 4;
+// batches of fewer bytes are formatted on the calling thread
+const size_t PARALLEL_WRITE_BYTES = PIECES_PER_THREAD * PIECE_BYTES;
+
+// cells [begin, end) of one entry row
+struct Piece
+{
+	uint32_t entry;
+	uint32_t begin;
+	uint32_t end;
+};
+
+void AppendText(std::string& buffer, std::string_view text)
+{
+	buffer.append(text.data(), text.size());
+}
+
+std::ofstream OpenOutput(const std::string& outFileName)
+{
+	std::ofstream output(outFileName);
+	if (!output)
+	{
+		throw std::runtime_error("Cannot open file " + outFileName);
+	}
+	return output;
+}
+
+// the transition of the state by the entry, NO_ID when it is undefined
+template <typename Sparse>
+uint32_t FindTransition(const Sparse& automaton, uint32_t state, uint32_t entry)
+{
+	auto begin = automaton.labels.begin() + automaton.offsets[state];
+	auto end = automaton.labels.begin() + automaton.offsets[state + 1];
+	auto found = std::lower_bound(begin, end, entry);
+	return (found != end && *found == entry) ? static_cast<uint32_t>(found - automaton.labels.begin()) : NO_ID;
+}
+
+void Flush(std::ostream& output, const std::string& buffer)
+{
+	output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	if (!output)
+	{
+		throw std::runtime_error("Cannot write the output file");
+	}
+	AddBytesWritten(buffer.size());
+}
+
+size_t AverageLength(const SymbolTable& table)
+{
+	return SymbolCount(table) == 0 ? 0 : table.pool.size() / SymbolCount(table);
+}
+
+// writes the entry rows "entry;cell;cell;...\n", formatCell(buffer, state, entry) appends a cell: the rows are
+// cut into pieces, pieces are formatted in parallel into per-thread buffers and the buffers are written out in order
+template <typename FormatCell>
+void WriteRows(std::ostream& output, const SymbolTable& entries, uint32_t stateCount, size_t cellBytes,
+	unsigned threads, FormatCell formatCell)
+{
+	threads = ThreadCount(threads);
+	uint32_t columnsPerPiece = static_cast<uint32_t>(std::clamp<size_t>(PIECE_BYTES / std::max<size_t>(cellBytes, 1), 1, UINT32_MAX));
+	std::vector<Piece> pieces;
+	for (uint32_t entry = 0; entry < SymbolCount(entries); entry++)
+	{
+		uint32_t begin = 0;
+		do
+		{
+			uint32_t end = static_cast<uint32_t>(std::min<size_t>(stateCount, size_t(begin) + columnsPerPiece));
+			pieces.push_back({ entry, begin, end });
+			begin = end;
+		} while (begin < stateCount);
+	}
+
+	std::vector<std::string> buffers(threads);
+	size_t batchSize = size_t(threads) * PIECES_PER_THREAD;
+	for (size_t batch = 0; batch < pieces.size(); batch += batchSize)
+	{
+		CheckCancelled();
+		size_t batchEnd = std::min(pieces.size(), batch + batchSize);
+		size_t batchBytes = 0;
+		for (size_t i = batch; i < batchEnd; i++)
+		{
+			batchBytes += size_t(pieces[i].end - pieces[i].begin) * cellBytes;
+		}
+		ParallelFor(batchEnd - batch, (batchBytes < PARALLEL_WRITE_BYTES) ? 1 : threads, [&](size_t begin, size_t end, unsigned thread) {
+			std::string& buffer = buffers[thread];
+			buffer.clear();
+			for (size_t i = batch + begin; i < batch + end; i++)
+			{
+				const Piece& piece = pieces[i];
+				if (piece.begin == 0)
+				{
+					AppendText(buffer, Name(entries, piece.entry));
+					buffer.push_back(DELIMETER);
+				}
+				for (uint32_t state = piece.begin; state < piece.end; state++)
+				{
+					if (state != 0)
+					{
+						buffer.push_back(DELIMETER);
+					}
+					formatCell(buffer, state, piece.entry);
+				}
+				if (piece.end == stateCount)
+				{
+					buffer.push_back('\n');
+				}
+			}
+		});
+		for (unsigned thread = 0; thread < threads; thread++)
+		{
+			Flush(output, buffers[thread]);
+			buffers[thread].clear();
+		}
+	}
+}
+
+// ";name;name;...\n"
+template <typename NameOf>
+void WriteHeader(std::ostream& output, uint32_t stateCount, NameOf nameOf)
+{
+	std::string buffer;
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		buffer.push_back(DELIMETER);
+		AppendText(buffer, nameOf(state));
+		if (buffer.size() >= PIECE_BYTES)
+		{
+			Flush(output, buffer);
+			buffer.clear();
+		}
+	}
+	buffer.push_back('\n');
+	Flush(output, buffer);
+}
+}
+
+void WriteMealy(const Mealy& mealy, std::ostream& output, unsigned threads)
+{
+	uint32_t stateCount = StateCount(mealy);
+
+	// writing states of mealy
+	WriteHeader(output, stateCount, [&mealy](uint32_t state) { return Name(mealy.states, state); });
+
+	// writing entries and transitions of mealy
+	size_t cellBytes = AverageLength(mealy.states) + AverageLength(mealy.outputs) + 2;
+	uint32_t entryCount = EntryCount(mealy);
+	WriteRows(output, mealy.entries, stateCount, cellBytes, threads, [&](std::string& buffer, uint32_t state, uint32_t entry) {
+		size_t cell = size_t(state) * entryCount + entry;
+		AppendText(buffer, Name(mealy.states, mealy.transitions[cell]));
+		buffer.push_back(SLASH);
+		AppendText(buffer, Name(mealy.outputs, mealy.outs[cell]));
+	});
+	output.flush();
+}
+
+void WriteMoore(const Moore& moore, std::ostream& output, unsigned threads)
+{
+	uint32_t stateCount = StateCount(moore);
+
+	// writing output signals and states of moore
+	WriteHeader(output, stateCount, [&moore](uint32_t state) { return Name(moore.outputs, moore.outs[state]); });
+	WriteHeader(output, stateCount, [&moore](uint32_t state) { return Name(moore.states, state); });
+
+	// writing entries and transitions of moore
+	size_t cellBytes = AverageLength(moore.states) + 1;
+	uint32_t entryCount = EntryCount(moore);
+	WriteRows(output, moore.entries, stateCount, cellBytes, threads, [&](std::string& buffer, uint32_t state, uint32_t entry) {
+		AppendText(buffer, Name(moore.states, moore.transitions[size_t(state) * entryCount + entry]));
+	});
+	output.flush();
+}
+
+void WriteMealy(const Mealy& mealy, const std::string& outFileName, unsigned threads)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteMealy(mealy, output, threads);
+}
+
+void WriteMoore(const Moore& moore, const std::string& outFileName, unsigned threads)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteMoore(moore, output, threads);
+}
+
+void WriteSparseMealy(const SparseMealy& mealy, std::ostream& output, unsigned threads)
+{
+	uint32_t stateCount = StateCount(mealy);
+	WriteHeader(output, stateCount, [&mealy](uint32_t state) { return Name(mealy.states, state); });
+
+	// undefined transitions are written as UNDEFINED_CELL
+	size_t cellBytes = AverageLength(mealy.states) + AverageLength(mealy.outputs) + 2;
+	WriteRows(output, mealy.entries, stateCount, cellBytes, threads, [&](std::string& buffer, uint32_t state, uint32_t entry) {
+		uint32_t t = FindTransition(mealy, state, entry);
+		if (t == NO_ID)
+		{
+			AppendText(buffer, UNDEFINED_CELL);
+			return;
+		}
+		AppendText(buffer, Name(mealy.states, mealy.targets[t]));
+		buffer.push_back(SLASH);
+		AppendText(buffer, Name(mealy.outputs, mealy.outs[t]));
+	});
+	output.flush();
+}
+
+void WriteSparseMoore(const SparseMoore& moore, std::ostream& output, unsigned threads)
+{
+	uint32_t stateCount = StateCount(moore);
+	WriteHeader(output, stateCount, [&moore](uint32_t state) { return Name(moore.outputs, moore.outs[state]); });
+	WriteHeader(output, stateCount, [&moore](uint32_t state) { return Name(moore.states, state); });
+
+	size_t cellBytes = AverageLength(moore.states) + 1;
+	WriteRows(output, moore.entries, stateCount, cellBytes, threads, [&](std::string& buffer, uint32_t state, uint32_t entry) {
+		uint32_t t = FindTransition(moore, state, entry);
+		AppendText(buffer, (t == NO_ID) ? std::string_view(UNDEFINED_CELL) : Name(moore.states, moore.targets[t]));
+	});
+	output.flush();
+}
+
+void WriteSparseMealy(const SparseMealy& mealy, const std::string& outFileName, unsigned threads)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteSparseMealy(mealy, output, threads);
+}
+
+void WriteSparseMoore(const SparseMoore& moore, const std::string& outFileName, unsigned threads)
+{
+	std::ofstream output = OpenOutput(outFileName);
+	WriteSparseMoore(moore, output, threads);
+}
@@ -0,0 +1,278 @@
+﻿#include "Equivalence.h"
+#include "Cancellation.h"
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+// the walks look for cancellation after this many pairs
+const size_t CANCEL_CHECK_PAIRS = 1 << 16;
+
+// both machines as transition tables over the entries of the first machine, with an output on every
+// transition in the output ids of the first machine; outputs only the second machine has get ids above them
+struct Product
+{
+	uint32_t entryCount = 0;
+	uint32_t firstStateCount = 0;
+	std::vector<uint32_t> firstTransitions;
+	std::vector<uint32_t> firstOuts;
+	std::vector<uint32_t> secondTransitions;
+	std::vector<uint32_t> secondOuts;
+};
+
+// entry of the second machine for every entry of the first one
+std::vector<uint32_t> MatchEntries(const SymbolTable& first, const SymbolTable& second)
+{
+	if (SymbolCount(first) != SymbolCount(second))
+	{
+		throw std::runtime_error("Machines have different entries");
+	}
+	std::vector<uint32_t> entries(SymbolCount(first));
+	for (uint32_t entry = 0; entry < SymbolCount(first); entry++)
+	{
+		entries[entry] = Find(second, Name(first, entry));
+		if (entries[entry] == NO_ID)
+		{
+			throw std::runtime_error("Machines have different entries");
+		}
+	}
+	return entries;
+}
+
+std::vector<uint32_t> MatchOutputs(const SymbolTable& first, const SymbolTable& second)
+{
+	std::vector<uint32_t> outputs(SymbolCount(second));
+	for (uint32_t output = 0; output < SymbolCount(second); output++)
+	{
+		uint32_t firstOutput = Find(first, Name(second, output));
+		outputs[output] = (firstOutput == NO_ID) ? SymbolCount(first) + output : firstOutput;
+	}
+	return outputs;
+}
+
+// rows of the second machine reordered to the entries of the first one
+void AddSecond(Product& product, const std::vector<uint32_t>& transitions, uint32_t stateCount,
+	const std::vector<uint32_t>& entries, const std::vector<uint32_t>& outputOf)
+{
+	uint32_t entryCount = product.entryCount;
+	product.secondTransitions.resize(size_t(stateCount) * entryCount);
+	product.secondOuts.resize(size_t(stateCount) * entryCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t from = size_t(state) * entryCount + entries[entry];
+			size_t to = size_t(state) * entryCount + entry;
+			product.secondTransitions[to] = transitions[from];
+			product.secondOuts[to] = outputOf[from];
+		}
+	}
+}
+
+void CheckStates(uint32_t firstCount, uint32_t secondCount)
+{
+	if (firstCount == 0 || secondCount == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+}
+
+Product MakeProduct(const Mealy& first, const Mealy& second)
+{
+	CheckStates(StateCount(first), StateCount(second));
+	Product product;
+	product.entryCount = EntryCount(first);
+	product.firstStateCount = StateCount(first);
+	product.firstTransitions = first.transitions;
+	product.firstOuts = first.outs;
+
+	std::vector<uint32_t> outputs = MatchOutputs(first.outputs, second.outputs);
+	std::vector<uint32_t> outputOf(second.outs.size());
+	for (size_t i = 0; i < second.outs.size(); i++)
+	{
+		outputOf[i] = outputs[second.outs[i]];
+	}
+	AddSecond(product, second.transitions, StateCount(second), MatchEntries(first.entries, second.entries), outputOf);
+	return product;
+}
+
+// a Moore transition outputs the signal of its target
+Product MakeProduct(const Moore& first, const Moore& second)
+{
+	CheckStates(StateCount(first), StateCount(second));
+	Product product;
+	product.entryCount = EntryCount(first);
+	product.firstStateCount = StateCount(first);
+	product.firstTransitions = first.transitions;
+	product.firstOuts.resize(first.transitions.size());
+	for (size_t i = 0; i < first.transitions.size(); i++)
+	{
+		product.firstOuts[i] = first.outs[first.transitions[i]];
+	}
+
+	std::vector<uint32_t> outputs = MatchOutputs(first.outputs, second.outputs);
+	std::vector<uint32_t> outputOf(second.transitions.size());
+	for (size_t i = 0; i < second.transitions.size(); i++)
+	{
+		outputOf[i] = outputs[second.outs[second.transitions[i]]];
+	}
+	AddSecond(product, second.transitions, StateCount(second), MatchEntries(first.entries, second.entries), outputOf);
+	return product;
+}
+
+class UnionFind
+{
+public:
+	explicit UnionFind(size_t size)
+		: m_parents(size)
+		, m_sizes(size, 1)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			m_parents[i] = static_cast<uint32_t>(i);
+		}
+	}
+
+	uint32_t Root(uint32_t item)
+	{
+		while (m_parents[item] != item)
+		{
+			m_parents[item] = m_parents[m_parents[item]];
+			item = m_parents[item];
+		}
+		return item;
+	}
+
+	// false when both were in one set already
+	bool Unite(uint32_t a, uint32_t b)
+	{
+		a = Root(a);
+		b = Root(b);
+		if (a == b)
+		{
+			return false;
+		}
+		if (m_sizes[a] < m_sizes[b])
+		{
+			std::swap(a, b);
+		}
+		m_parents[b] = a;
+		m_sizes[a] += m_sizes[b];
+		return true;
+	}
+
+private:
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_sizes;
+};
+
+// states of the second machine follow the states of the first one in the union-find
+bool Equivalent(const Product& product, uint32_t secondStateCount)
+{
+	uint32_t entryCount = product.entryCount;
+	uint32_t offset = product.firstStateCount;
+	UnionFind sets(size_t(offset) + secondStateCount);
+	std::vector<std::pair<uint32_t, uint32_t>> pairs{ { 0, 0 } };
+	sets.Unite(0, offset);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		if (i % CANCEL_CHECK_PAIRS == 0)
+		{
+			CheckCancelled();
+		}
+		auto [first, second] = pairs[i];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t firstIndex = size_t(first) * entryCount + entry;
+			size_t secondIndex = size_t(second) * entryCount + entry;
+			if (product.firstOuts[firstIndex] != product.secondOuts[secondIndex])
+			{
+				return false;
+			}
+			uint32_t firstTarget = product.firstTransitions[firstIndex];
+			uint32_t secondTarget = product.secondTransitions[secondIndex];
+			if (sets.Unite(firstTarget, offset + secondTarget))
+			{
+				pairs.push_back({ firstTarget, secondTarget });
+			}
+		}
+	}
+	return true;
+}
+
+// breadth-first search over the pairs themselves, it stops at the first pair of different outputs
+std::vector<uint32_t> ShortestWord(const Product& product)
+{
+	struct Node
+	{
+		uint32_t first;
+		uint32_t second;
+		uint32_t previous;
+		uint32_t entry;
+	};
+	uint32_t entryCount = product.entryCount;
+	std::vector<Node> nodes{ { 0, 0, NO_ID, NO_ID } };
+	std::unordered_map<uint64_t, uint32_t> visited{ { 0, 0 } };
+	auto wordTo = [&nodes](uint32_t node, uint32_t lastEntry) {
+		std::vector<uint32_t> word{ lastEntry };
+		for (; nodes[node].previous != NO_ID; node = nodes[node].previous)
+		{
+			word.push_back(nodes[node].entry);
+		}
+		return std::vector<uint32_t>(word.rbegin(), word.rend());
+	};
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (i % CANCEL_CHECK_PAIRS == 0)
+		{
+			CheckCancelled();
+		}
+		Node node = nodes[i];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t firstIndex = size_t(node.first) * entryCount + entry;
+			size_t secondIndex = size_t(node.second) * entryCount + entry;
+			if (product.firstOuts[firstIndex] != product.secondOuts[secondIndex])
+			{
+				return wordTo(static_cast<uint32_t>(i), entry);
+			}
+			uint32_t firstTarget = product.firstTransitions[firstIndex];
+			uint32_t secondTarget = product.secondTransitions[secondIndex];
+			uint64_t key = (uint64_t(firstTarget) << 32) | secondTarget;
+			if (visited.emplace(key, static_cast<uint32_t>(nodes.size())).second)
+			{
+				nodes.push_back({ firstTarget, secondTarget, static_cast<uint32_t>(i), entry });
+			}
+		}
+	}
+	return {};
+}
+
+EquivalenceResult Check(const Product& product, uint32_t secondStateCount)
+{
+	EquivalenceResult result;
+	result.equivalent = Equivalent(product, secondStateCount);
+	if (!result.equivalent)
+	{
+		result.word = ShortestWord(product);
+	}
+	return result;
+}
+
+}
+
+EquivalenceResult CheckEquivalence(const Mealy& first, const Mealy& second)
+{
+	return Check(MakeProduct(first, second), StateCount(second));
+}
+
+EquivalenceResult CheckEquivalence(const Moore& first, const Moore& second)
+{
+	Product product = MakeProduct(first, second);
+	if (Name(first.outputs, first.outs[0]) != Name(second.outputs, second.outs[0]))
+	{
+		return { false, {} };
+	}
+	return Check(product, StateCount(second));
+}
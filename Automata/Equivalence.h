@@ -0,0 +1,18 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <vector>
+
+struct EquivalenceResult
+{
+	bool equivalent = true;
+	std::vector<uint32_t> word; // entries of the first machine, a shortest input with different outputs
+};
+
+// Hopcroft-Karp check: pairs of states reached by the same input from the two start states are merged
+// in a union-find and every merge is visited once, so the cost is near-linear in the states of both
+// machines. The machines need the same entry names; outputs and entries are matched by name.
+// Only when they differ the reachable pairs are searched breadth-first for a shortest word.
+EquivalenceResult CheckEquivalence(const Mealy& first, const Mealy& second);
+// a Moore machine outputs the signal of its start state on the empty word too
+EquivalenceResult CheckEquivalence(const Moore& first, const Moore& second);
@@ -0,0 +1,1125 @@
+﻿#include "Incremental.h"
+#include "Analysis.h"
+#include "Cancellation.h"
+#include "Refinement.h"
+#include "Stats.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+// the splitting looks for cancellation after this many splitters, the merging after this many blocks
+const uint64_t CANCEL_CHECK_SPLITTERS = 1 << 10;
+const size_t CANCEL_CHECK_BLOCKS = 1 << 10;
+// an update reads the whole machine at most this many times besides finding the reachable states
+const uint32_t UPDATE_PASSES = 8;
+
+using Edit = std::vector<std::string>;
+
+uint32_t FindSymbol(const SymbolTable& table, const std::string& name, const std::string& kind)
+{
+	uint32_t id = Find(table, name);
+	if (id == NO_ID)
+	{
+		throw std::runtime_error("Unknown " + kind + " " + name);
+	}
+	return id;
+}
+
+// calls apply for every edit, which returns the edited state
+template <typename Apply>
+std::vector<uint32_t> ReadDelta(const std::string& deltaFileName, Apply apply)
+{
+	std::ifstream input(deltaFileName);
+	if (!input)
+	{
+		throw std::runtime_error("Cannot open file " + deltaFileName);
+	}
+	std::vector<uint32_t> editedStates;
+	std::string line;
+	for (size_t lineNumber = 1; std::getline(input, line); lineNumber++)
+	{
+		std::istringstream words(line);
+		Edit edit{ std::istream_iterator<std::string>(words), std::istream_iterator<std::string>() };
+		if (edit.empty() || edit[0][0] == '#')
+		{
+			continue;
+		}
+		try
+		{
+			editedStates.push_back(apply(edit));
+		}
+		catch (const std::exception& e)
+		{
+			throw std::runtime_error(deltaFileName + ":" + std::to_string(lineNumber) + ": " + e.what());
+		}
+	}
+	return editedStates;
+}
+
+template <typename Automaton>
+uint32_t AddState(Automaton& automaton, const std::string& name)
+{
+	if (Find(automaton.states, name) != NO_ID)
+	{
+		throw std::runtime_error("State " + name + " already exists");
+	}
+	uint32_t state = Append(automaton.states, name);
+	automaton.transitions.insert(automaton.transitions.end(), EntryCount(automaton), state);
+	return state;
+}
+
+// blocks of states are ranges [first, end) of elements, split by Hopcroft's rule; marked states are moved to
+// [first, mid) and the smaller half of a split block gets the new block number
+class Partition
+{
+public:
+	// states of block NO_ID are left out, no state of the partition may lead to them
+	Partition(const std::vector<uint32_t>& transitions, uint32_t entryCount, const std::vector<uint32_t>& blocks,
+		uint32_t blockCount)
+		: m_entryCount(entryCount)
+		, m_rowSize(blocks.size() + 1)
+		, m_blockOf(blocks)
+	{
+		// predecessors of target t by entry e are inverseStates[inverseStart[e * rowSize + t] .. inverseStart[e * rowSize + t + 1])
+		uint32_t stateCount = static_cast<uint32_t>(blocks.size());
+		m_inverseStart.assign(entryCount * m_rowSize + 1, 0);
+		for (uint32_t s = 0; s < stateCount; s++)
+		{
+			for (uint32_t e = 0; e < entryCount && blocks[s] != NO_ID; e++)
+			{
+				m_inverseStart[e * m_rowSize + transitions[size_t(s) * entryCount + e] + 1]++;
+			}
+		}
+		for (size_t i = 1; i < m_inverseStart.size(); i++)
+		{
+			m_inverseStart[i] += m_inverseStart[i - 1];
+		}
+		std::vector<size_t> fill(m_inverseStart.begin(), m_inverseStart.end() - 1);
+		m_inverseStates.resize(m_inverseStart.back());
+		for (uint32_t s = 0; s < stateCount; s++)
+		{
+			for (uint32_t e = 0; e < entryCount && blocks[s] != NO_ID; e++)
+			{
+				m_inverseStates[fill[e * m_rowSize + transitions[size_t(s) * entryCount + e]]++] = s;
+			}
+		}
+
+		m_first.assign(size_t(blockCount) + 1, 0);
+		for (uint32_t block : blocks)
+		{
+			if (block != NO_ID)
+			{
+				m_first[block + 1]++;
+			}
+		}
+		for (uint32_t b = 1; b <= blockCount; b++)
+		{
+			m_first[b] += m_first[b - 1];
+		}
+		m_end.assign(m_first.begin() + 1, m_first.end());
+		m_first.pop_back();
+		std::vector<uint32_t> position(m_first);
+		m_elements.resize(m_first.empty() ? 0 : m_end.back());
+		m_location.assign(stateCount, NO_ID);
+		for (uint32_t s = 0; s < stateCount; s++)
+		{
+			if (blocks[s] != NO_ID)
+			{
+				m_location[s] = position[blocks[s]]++;
+				m_elements[m_location[s]] = s;
+			}
+		}
+		m_mid = m_first;
+		m_inWorklist.assign(size_t(blockCount) * entryCount, false);
+	}
+
+	// the block with every entry
+	void AddSplitter(uint32_t block)
+	{
+		for (uint32_t e = 0; e < m_entryCount; e++)
+		{
+			Push(block, e);
+		}
+	}
+
+	// splits until no splitter is left; false when the splitters held more than budget states before that
+	bool Refine(uint64_t budget = UINT64_MAX)
+	{
+		std::vector<uint32_t> splitter;
+		std::vector<uint32_t> touched;
+		uint64_t splitterCount = 0;
+		uint64_t splitterStates = 0;
+		while (!m_worklist.empty())
+		{
+			auto [splitterBlock, entry] = m_worklist.back();
+			m_worklist.pop_back();
+			if (++splitterCount % CANCEL_CHECK_SPLITTERS == 0)
+			{
+				CheckCancelled();
+			}
+			m_inWorklist[size_t(splitterBlock) * m_entryCount + entry] = false;
+			splitterStates += Size(splitterBlock);
+			if (splitterStates > budget)
+			{
+				m_splitterCount += splitterCount;
+				return false;
+			}
+
+			splitter.assign(m_elements.begin() + m_first[splitterBlock], m_elements.begin() + m_end[splitterBlock]);
+			for (uint32_t target : splitter)
+			{
+				ForPredecessors(target, entry, [&](uint32_t state) {
+					if (Mark(state))
+					{
+						touched.push_back(m_blockOf[state]);
+					}
+				});
+			}
+			for (uint32_t block : touched)
+			{
+				Split(block);
+			}
+			touched.clear();
+		}
+		m_splitterCount += splitterCount;
+		return true;
+	}
+
+	// moves the states, all of one block, to a block of their own unless they are the whole block
+	void Separate(const std::vector<uint32_t>& states)
+	{
+		uint32_t block = m_blockOf[states[0]];
+		if (states.size() == Size(block))
+		{
+			return;
+		}
+		for (uint32_t state : states)
+		{
+			Mark(state);
+		}
+		Split(block);
+	}
+
+	uint64_t SplitterCount() const
+	{
+		return m_splitterCount;
+	}
+
+	uint32_t BlockCount() const
+	{
+		return static_cast<uint32_t>(m_first.size());
+	}
+
+	uint32_t BlockOf(uint32_t state) const
+	{
+		return m_blockOf[state];
+	}
+
+	uint32_t Size(uint32_t block) const
+	{
+		return m_end[block] - m_first[block];
+	}
+
+	uint32_t Element(uint32_t block, uint32_t index) const
+	{
+		return m_elements[m_first[block] + index];
+	}
+
+	template <typename Visit>
+	void ForPredecessors(uint32_t target, uint32_t entry, Visit visit) const
+	{
+		size_t offset = entry * m_rowSize + target;
+		for (size_t i = m_inverseStart[offset]; i < m_inverseStart[offset + 1]; i++)
+		{
+			visit(m_inverseStates[i]);
+		}
+	}
+
+private:
+	// moves the state to the marked front of its block, true for the first one
+	bool Mark(uint32_t state)
+	{
+		uint32_t block = m_blockOf[state];
+		if (m_location[state] < m_mid[block])
+		{
+			return false;
+		}
+		bool first = m_mid[block] == m_first[block];
+		uint32_t other = m_elements[m_mid[block]];
+		std::swap(m_elements[m_location[state]], m_elements[m_mid[block]]);
+		m_location[other] = m_location[state];
+		m_location[state] = m_mid[block]++;
+		return first;
+	}
+
+	void Push(uint32_t block, uint32_t entry)
+	{
+		if (!m_inWorklist[size_t(block) * m_entryCount + entry])
+		{
+			m_worklist.push_back({ block, entry });
+			m_inWorklist[size_t(block) * m_entryCount + entry] = true;
+		}
+	}
+
+	void Split(uint32_t block)
+	{
+		if (m_mid[block] == m_end[block])
+		{
+			m_mid[block] = m_first[block];
+			return;
+		}
+		uint32_t newBlock = BlockCount();
+		if (m_mid[block] - m_first[block] <= m_end[block] - m_mid[block])
+		{
+			m_first.push_back(m_first[block]);
+			m_end.push_back(m_mid[block]);
+			m_first[block] = m_mid[block];
+		}
+		else
+		{
+			m_first.push_back(m_mid[block]);
+			m_end.push_back(m_end[block]);
+			m_end[block] = m_mid[block];
+		}
+		m_mid[block] = m_first[block];
+		m_mid.push_back(m_first[newBlock]);
+		m_inWorklist.resize(m_first.size() * m_entryCount, false);
+		for (uint32_t i = m_first[newBlock]; i < m_end[newBlock]; i++)
+		{
+			m_blockOf[m_elements[i]] = newBlock;
+		}
+
+		for (uint32_t e = 0; e < m_entryCount; e++)
+		{
+			if (m_inWorklist[size_t(block) * m_entryCount + e])
+			{
+				Push(newBlock, e);
+			}
+			else
+			{
+				Push(Size(block) < Size(newBlock) ? block : newBlock, e);
+			}
+		}
+	}
+
+	uint32_t m_entryCount;
+	size_t m_rowSize;
+	std::vector<size_t> m_inverseStart;
+	std::vector<uint32_t> m_inverseStates;
+	std::vector<uint32_t> m_elements;
+	std::vector<uint32_t> m_location;
+	std::vector<uint32_t> m_blockOf;
+	std::vector<uint32_t> m_first;
+	std::vector<uint32_t> m_end;
+	std::vector<uint32_t> m_mid;
+	std::vector<std::pair<uint32_t, uint32_t>> m_worklist;
+	std::vector<bool> m_inWorklist;
+	uint64_t m_splitterCount = 0;
+};
+
+// the output row of a Mealy state or the signal of a Moore state
+std::vector<uint32_t> OutputsOf(const Mealy& mealy, uint32_t state)
+{
+	auto row = mealy.outs.begin() + size_t(state) * EntryCount(mealy);
+	return std::vector<uint32_t>(row, row + EntryCount(mealy));
+}
+
+std::vector<uint32_t> OutputsOf(const Moore& moore, uint32_t state)
+{
+	return { moore.outs[state] };
+}
+
+// marks every reachable state that leads to a marked one, sweeping the states up and down in turn until a sweep
+// marks nothing; false once more than budget states are marked or the sweeps use up the passes
+bool MarkAffected(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const StateBits& reachable, StateBits& affected, uint64_t markedCount, uint64_t budget, uint32_t& passes)
+{
+	for (bool marked = markedCount != 0; marked;)
+	{
+		if (passes++ == UPDATE_PASSES)
+		{
+			return false;
+		}
+		CheckCancelled();
+		marked = false;
+		bool up = passes % 2 != 0;
+		for (uint32_t i = 0; i < stateCount; i++)
+		{
+			uint32_t state = up ? i : stateCount - 1 - i;
+			if (!TestBit(reachable, state) || TestBit(affected, state))
+			{
+				continue;
+			}
+			auto row = transitions.begin() + size_t(state) * entryCount;
+			if (std::any_of(row, row + entryCount, [&](uint32_t target) { return TestBit(affected, target); }))
+			{
+				SetBit(affected, state);
+				marked = true;
+				if (++markedCount > budget)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Merging the blocks of a stable partition of the local machine into the classes of the minimal machine. The
+// blocks without an affected state behave as their old classes, which are pairwise different. An affected block
+// can only be equal to one of the unaffected classes of the whole machine, found as the greatest set of candidates
+// consistent with the transitions, or to other affected blocks, which are refined among themselves.
+template <typename Automaton>
+class Merger
+{
+public:
+	// states[local] - the state of the machine behind every state of the local machine, classes - the old classes
+	Merger(const Automaton& automaton, const std::vector<uint32_t>& classes, const StateBits& reachable,
+		const StateBits& affected, const std::vector<uint32_t>& states, const std::vector<uint32_t>& transitions,
+		const Partition& partition)
+		: m_automaton(automaton)
+		, m_classes(classes)
+		, m_reachable(reachable)
+		, m_affectedStates(affected)
+		, m_states(states)
+		, m_transitions(transitions)
+		, m_entryCount(EntryCount(automaton))
+		, m_partition(partition)
+		, m_affected(partition.BlockCount(), false)
+		, m_slots(partition.BlockCount(), NO_ID)
+		, m_stamps(partition.BlockCount(), 0)
+	{
+		for (uint32_t local = 0; local < states.size(); local++)
+		{
+			if (TestBit(affected, states[local]))
+			{
+				m_affected[partition.BlockOf(local)] = true;
+			}
+		}
+	}
+
+	// the label of every block, equal for the blocks of one class: the old class of an unaffected block or of the
+	// class an affected block equals, labelBase and up for the others. False when some affected block cannot be
+	// matched within the passes
+	bool Labels(uint32_t labelBase, uint32_t& passes, std::vector<uint32_t>& labels)
+	{
+		m_classCount = labelBase;
+		uint32_t blockCount = m_partition.BlockCount();
+		labels.assign(blockCount, NO_ID);
+		std::vector<uint32_t> affectedBlocks;
+		for (uint32_t block = 0; block < blockCount; block++)
+		{
+			if (m_affected[block])
+			{
+				m_slots[block] = static_cast<uint32_t>(affectedBlocks.size());
+				affectedBlocks.push_back(block);
+			}
+			else
+			{
+				labels[block] = ClassOf(block);
+			}
+		}
+		m_known.assign(affectedBlocks.size(), false);
+		m_candidates.resize(affectedBlocks.size());
+		if (!MatchUnaffected(affectedBlocks, passes))
+		{
+			return false;
+		}
+
+		std::vector<uint32_t> group;
+		for (uint32_t block : affectedBlocks)
+		{
+			if (m_candidates[m_slots[block]].empty())
+			{
+				group.push_back(block);
+			}
+			else
+			{
+				labels[block] = m_candidates[m_slots[block]][0];
+			}
+		}
+		std::vector<uint32_t> groupClasses = MergeGroup(group, labels);
+		for (size_t i = 0; i < group.size(); i++)
+		{
+			labels[group[i]] = labelBase + groupClasses[i];
+		}
+		return true;
+	}
+
+private:
+	enum class Search
+	{
+		NoAnchor,
+		Waiting, // for the predecessors of some class
+		Found,
+	};
+
+	uint32_t Representative(uint32_t block) const
+	{
+		return m_partition.Element(block, 0);
+	}
+
+	// the old class of an unaffected block
+	uint32_t ClassOf(uint32_t block) const
+	{
+		return m_classes[m_states[Representative(block)]];
+	}
+
+	uint32_t Successor(uint32_t block, uint32_t entry) const
+	{
+		return m_partition.BlockOf(m_transitions[size_t(Representative(block)) * m_entryCount + entry]);
+	}
+
+	bool Known(uint32_t block) const
+	{
+		return m_known[m_slots[block]];
+	}
+
+	const std::vector<uint32_t>& Candidates(uint32_t block) const
+	{
+		return m_candidates[m_slots[block]];
+	}
+
+	static uint64_t Key(uint32_t stateClass, uint32_t entry)
+	{
+		return uint64_t(stateClass) << 32 | entry;
+	}
+
+	// blocks with a state leading to a state of block by entry (any entry for NO_ID), without repeats
+	template <typename Keep>
+	std::vector<uint32_t> Predecessors(uint32_t block, uint32_t entry, Keep keep)
+	{
+		std::vector<uint32_t> predecessors;
+		m_stamp++;
+		for (uint32_t i = 0; i < m_partition.Size(block); i++)
+		{
+			for (uint32_t e = 0; e < m_entryCount; e++)
+			{
+				if (entry != NO_ID && e != entry)
+				{
+					continue;
+				}
+				m_partition.ForPredecessors(m_partition.Element(block, i), e, [&](uint32_t state) {
+					uint32_t predecessor = m_partition.BlockOf(state);
+					if (m_stamps[predecessor] != m_stamp && keep(predecessor))
+					{
+						m_stamps[predecessor] = m_stamp;
+						predecessors.push_back(predecessor);
+					}
+				});
+			}
+		}
+		return predecessors;
+	}
+
+	// one pass over the machine: the classes of the unaffected states that lead to the requested classes
+	void IndexPredecessors()
+	{
+		CheckCancelled();
+		uint32_t stateCount = StateCount(m_automaton);
+		auto unaffected = [this](uint32_t state) {
+			return TestBit(m_reachable, state) && !TestBit(m_affectedStates, state);
+		};
+		std::vector<bool> requested(m_classCount, false);
+		for (uint32_t stateClass : m_requested)
+		{
+			requested[stateClass] = true;
+		}
+		StateBits targets(m_reachable.size(), 0);
+		for (uint32_t state = 0; state < stateCount; state++)
+		{
+			if (unaffected(state) && requested[m_classes[state]])
+			{
+				SetBit(targets, state);
+			}
+		}
+		for (uint32_t state = 0; state < stateCount; state++)
+		{
+			for (uint32_t entry = 0; entry < m_entryCount && unaffected(state); entry++)
+			{
+				uint32_t target = m_automaton.transitions[size_t(state) * m_entryCount + entry];
+				if (TestBit(targets, target))
+				{
+					m_predecessors[Key(m_classes[target], entry)].push_back(m_classes[state]);
+					m_representatives.emplace(m_classes[state], state);
+				}
+			}
+		}
+		for (uint32_t stateClass : m_requested)
+		{
+			for (uint32_t entry = 0; entry < m_entryCount; entry++)
+			{
+				auto found = m_predecessors.find(Key(stateClass, entry));
+				if (found != m_predecessors.end())
+				{
+					std::sort(found->second.begin(), found->second.end());
+					found->second.erase(std::unique(found->second.begin(), found->second.end()), found->second.end());
+				}
+			}
+			m_indexed.insert(stateClass);
+		}
+		m_requested.clear();
+	}
+
+	bool Matches(uint32_t block, uint32_t candidate) const
+	{
+		uint32_t candidateState = m_representatives.at(candidate);
+		if (OutputsOf(m_automaton, m_states[Representative(block)]) != OutputsOf(m_automaton, candidateState))
+		{
+			return false;
+		}
+		for (uint32_t entry = 0; entry < m_entryCount; entry++)
+		{
+			uint32_t target = Successor(block, entry);
+			uint32_t candidateTarget = m_classes[m_automaton.transitions[size_t(candidateState) * m_entryCount + entry]];
+			if (!m_affected[target] ? candidateTarget != ClassOf(target)
+				: Known(target) && !std::binary_search(Candidates(target).begin(), Candidates(target).end(), candidateTarget))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// unaffected classes that may equal the block given the candidates of its targets
+	Search FindCandidates(uint32_t block, std::vector<uint32_t>& found)
+	{
+		uint32_t anchorEntry = NO_ID;
+		for (uint32_t entry = 0; entry < m_entryCount; entry++)
+		{
+			uint32_t target = Successor(block, entry);
+			if (!m_affected[target])
+			{
+				anchorEntry = entry;
+				break;
+			}
+			if (Known(target) && (anchorEntry == NO_ID
+				|| Candidates(target).size() < Candidates(Successor(block, anchorEntry)).size()))
+			{
+				anchorEntry = entry;
+			}
+		}
+		if (anchorEntry == NO_ID)
+		{
+			return Search::NoAnchor;
+		}
+		uint32_t anchor = Successor(block, anchorEntry);
+		std::vector<uint32_t> anchorClasses = !m_affected[anchor] ? std::vector<uint32_t>{ ClassOf(anchor) } : Candidates(anchor);
+		bool waiting = false;
+		for (uint32_t anchorClass : anchorClasses)
+		{
+			if (m_indexed.count(anchorClass) == 0)
+			{
+				m_requested.insert(anchorClass);
+				waiting = true;
+			}
+		}
+		if (waiting)
+		{
+			return Search::Waiting;
+		}
+		found.clear();
+		for (uint32_t anchorClass : anchorClasses)
+		{
+			auto predecessors = m_predecessors.find(Key(anchorClass, anchorEntry));
+			if (predecessors == m_predecessors.end())
+			{
+				continue;
+			}
+			for (uint32_t candidate : predecessors->second)
+			{
+				if (Matches(block, candidate))
+				{
+					found.push_back(candidate);
+				}
+			}
+		}
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+		return Search::Found;
+	}
+
+	// candidate sets only shrink, so the loop ends at the greatest consistent sets; the blocks waiting for
+	// predecessors go on after a pass indexes them. False when some block has no anchor at all or more than one
+	// candidate, or the passes run out
+	bool MatchUnaffected(const std::vector<uint32_t>& affectedBlocks, uint32_t& passes)
+	{
+		std::vector<uint32_t> queue(affectedBlocks.rbegin(), affectedBlocks.rend());
+		std::vector<bool> queued(m_partition.BlockCount(), false);
+		for (uint32_t block : queue)
+		{
+			queued[block] = true;
+		}
+		std::vector<uint32_t> waiting;
+		std::vector<uint32_t> found;
+		for (size_t steps = 1; !queue.empty() || !waiting.empty(); steps++)
+		{
+			if (queue.empty())
+			{
+				if (passes++ == UPDATE_PASSES)
+				{
+					return false;
+				}
+				IndexPredecessors();
+				queue.swap(waiting);
+				continue;
+			}
+			if (steps % CANCEL_CHECK_BLOCKS == 0)
+			{
+				CheckCancelled();
+			}
+			uint32_t block = queue.back();
+			queue.pop_back();
+			Search search = FindCandidates(block, found);
+			if (search == Search::Waiting)
+			{
+				waiting.push_back(block);
+				continue;
+			}
+			queued[block] = false;
+			if (search == Search::NoAnchor || (Known(block) && found == Candidates(block)))
+			{
+				continue;
+			}
+			m_known[m_slots[block]] = true;
+			m_candidates[m_slots[block]].swap(found);
+			auto affected = [this](uint32_t predecessor) { return m_affected[predecessor]; };
+			for (uint32_t predecessor : Predecessors(block, NO_ID, affected))
+			{
+				if (!queued[predecessor])
+				{
+					queued[predecessor] = true;
+					queue.push_back(predecessor);
+				}
+			}
+		}
+		return std::all_of(affectedBlocks.begin(), affectedBlocks.end(), [this](uint32_t block) {
+			return Known(block) && Candidates(block).size() <= 1;
+		});
+	}
+
+	// coarsest partition of the blocks of the group; a transition that leaves the group goes to a
+	// state of its own for every label it reaches. Returns the class of every block of the group.
+	std::vector<uint32_t> MergeGroup(const std::vector<uint32_t>& group, const std::vector<uint32_t>& labels) const
+	{
+		uint32_t groupSize = static_cast<uint32_t>(group.size());
+		std::vector<uint32_t> indexes(m_partition.BlockCount(), NO_ID);
+		for (uint32_t i = 0; i < groupSize; i++)
+		{
+			indexes[group[i]] = i;
+		}
+		std::unordered_map<uint32_t, uint32_t> outside;
+		std::vector<uint32_t> transitions(size_t(groupSize) * m_entryCount);
+		for (uint32_t i = 0; i < groupSize; i++)
+		{
+			for (uint32_t entry = 0; entry < m_entryCount; entry++)
+			{
+				uint32_t target = Successor(group[i], entry);
+				transitions[size_t(i) * m_entryCount + entry] = (indexes[target] != NO_ID)
+					? indexes[target]
+					: groupSize + outside.emplace(labels[target], static_cast<uint32_t>(outside.size())).first->second;
+			}
+		}
+		uint32_t stateCount = groupSize + static_cast<uint32_t>(outside.size());
+		for (uint32_t state = groupSize; state < stateCount; state++)
+		{
+			transitions.insert(transitions.end(), m_entryCount, state);
+		}
+
+		// blocks of the group by their outputs, every outside state alone
+		std::map<std::vector<uint32_t>, uint32_t> numbers;
+		std::vector<uint32_t> blocks(stateCount);
+		std::vector<uint32_t> sizes;
+		for (uint32_t i = 0; i < groupSize; i++)
+		{
+			auto [number, added] = numbers.emplace(OutputsOf(m_automaton, m_states[Representative(group[i])]),
+				static_cast<uint32_t>(sizes.size()));
+			if (added)
+			{
+				sizes.push_back(0);
+			}
+			blocks[i] = number->second;
+			sizes[number->second]++;
+		}
+		uint32_t blockCount = static_cast<uint32_t>(sizes.size());
+		for (uint32_t state = groupSize; state < stateCount; state++)
+		{
+			blocks[state] = blockCount++;
+		}
+
+		// every block but the largest one is a splitter
+		Partition partition(transitions, m_entryCount, blocks, blockCount);
+		uint32_t largest = static_cast<uint32_t>(std::max_element(sizes.begin(), sizes.end()) - sizes.begin());
+		for (uint32_t block = 0; block < blockCount; block++)
+		{
+			if (block != largest)
+			{
+				partition.AddSplitter(block);
+			}
+		}
+		partition.Refine();
+		std::vector<uint32_t> classes(groupSize);
+		for (uint32_t i = 0; i < groupSize; i++)
+		{
+			classes[i] = partition.BlockOf(i);
+		}
+		return classes;
+	}
+
+	const Automaton& m_automaton;
+	const std::vector<uint32_t>& m_classes;
+	const StateBits& m_reachable;
+	const StateBits& m_affectedStates;
+	const std::vector<uint32_t>& m_states;
+	const std::vector<uint32_t>& m_transitions;
+	uint32_t m_entryCount;
+	const Partition& m_partition;
+	std::vector<bool> m_affected;
+	// affected blocks only: their slots, whether their candidates are known and the candidates
+	std::vector<uint32_t> m_slots;
+	std::vector<bool> m_known;
+	std::vector<std::vector<uint32_t>> m_candidates;
+	std::vector<uint32_t> m_stamps;
+	uint32_t m_stamp = 0;
+	// predecessors of the indexed classes by Key(class, entry) and a state of every class met there
+	uint32_t m_classCount = 0;
+	std::unordered_set<uint32_t> m_requested;
+	std::unordered_set<uint32_t> m_indexed;
+	std::unordered_map<uint64_t, std::vector<uint32_t>> m_predecessors;
+	std::unordered_map<uint32_t, uint32_t> m_representatives;
+};
+
+// the whole reachable part minimized again from its outputs
+template <typename Automaton>
+uint32_t MinimizeReachable(const Automaton& automaton, std::vector<uint32_t>& classes, const StateBits& reachable)
+{
+	Automaton kept = KeepStates(automaton, reachable);
+	std::vector<uint32_t> initialClasses;
+	uint32_t groupCount = GroupByOutputs(kept, initialClasses);
+	std::vector<uint32_t> keptClasses = RefineHopcroft(kept.transitions, StateCount(kept), EntryCount(kept), initialClasses, groupCount);
+	uint32_t classCount = 0;
+	uint32_t keptState = 0;
+	for (uint32_t state = 0; state < StateCount(automaton); state++)
+	{
+		classes[state] = TestBit(reachable, state) ? keptClasses[keptState++] : NO_ID;
+		classCount = (classes[state] != NO_ID) ? std::max(classCount, classes[state] + 1) : classCount;
+	}
+	return classCount;
+}
+
+template <typename Automaton>
+uint32_t Update(const Automaton& automaton, std::vector<uint32_t>& classes, const std::vector<uint32_t>& editedStates,
+	unsigned threads)
+{
+	uint32_t stateCount = StateCount(automaton);
+	uint32_t entryCount = EntryCount(automaton);
+	if (stateCount == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	classes.resize(stateCount, NO_ID);
+	StateBits reachable = FindReachableStates(automaton.transitions, stateCount, entryCount, threads);
+
+	// states keep their old classes as blocks, the states that were unreachable share a new block
+	uint32_t blockCount = 0;
+	for (uint32_t stateClass : classes)
+	{
+		blockCount = (stateClass != NO_ID) ? std::max(blockCount, stateClass + 1) : blockCount;
+	}
+	StateBits seeded(reachable.size(), 0);
+	std::vector<uint32_t> seeds;
+	for (uint32_t state : editedStates)
+	{
+		if (TestBit(reachable, state) && SetBit(seeded, state))
+		{
+			seeds.push_back(state);
+		}
+	}
+	uint32_t newBlock = NO_ID;
+	uint64_t reachableCount = 0;
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		if (TestBit(reachable, state))
+		{
+			reachableCount++;
+		}
+		if (TestBit(reachable, state) && classes[state] == NO_ID)
+		{
+			newBlock = (newBlock == NO_ID) ? blockCount++ : newBlock;
+			SetBit(seeded, state);
+			seeds.push_back(state);
+		}
+	}
+	auto blockOf = [&](uint32_t state) { return (classes[state] != NO_ID) ? classes[state] : newBlock; };
+
+	// only the states that can reach a seed may behave differently; once they, the states of their blocks or
+	// the splitters hold a sixteenth of the machine, the edits have reached too much of it and it is minimized again
+	uint64_t budget = reachableCount / 16;
+	uint32_t passes = 0;
+	StateBits affected = seeded;
+	if (!MarkAffected(automaton.transitions, stateCount, entryCount, reachable, affected, seeds.size(), budget, passes))
+	{
+		return MinimizeReachable(automaton, classes, reachable);
+	}
+
+	// the blocks with an affected state are split and merged on a local machine: their states, and a state of its
+	// own for every other block they lead to, which keeps its class
+	std::vector<uint32_t> localBlocks(blockCount, NO_ID);
+	uint32_t localBlockCount = 0;
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		if (TestBit(affected, state) && localBlocks[blockOf(state)] == NO_ID)
+		{
+			localBlocks[blockOf(state)] = localBlockCount++;
+		}
+	}
+	std::vector<uint32_t> states; // the state of the machine behind every local state
+	std::vector<uint32_t> localStates(stateCount, NO_ID);
+	std::vector<uint32_t> blocks;
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		if (TestBit(reachable, state) && localBlocks[blockOf(state)] != NO_ID)
+		{
+			if (states.size() == budget)
+			{
+				return MinimizeReachable(automaton, classes, reachable);
+			}
+			localStates[state] = static_cast<uint32_t>(states.size());
+			states.push_back(state);
+			blocks.push_back(localBlocks[blockOf(state)]);
+		}
+	}
+	uint32_t blockStateCount = static_cast<uint32_t>(states.size());
+	std::unordered_map<uint32_t, uint32_t> outside;
+	std::vector<uint32_t> transitions(size_t(blockStateCount) * entryCount);
+	for (uint32_t local = 0; local < blockStateCount; local++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t target = automaton.transitions[size_t(states[local]) * entryCount + entry];
+			if (localStates[target] == NO_ID)
+			{
+				auto [found, added] = outside.emplace(classes[target], static_cast<uint32_t>(states.size()));
+				if (added)
+				{
+					states.push_back(target);
+					blocks.push_back(localBlockCount++);
+				}
+				target = found->second;
+			}
+			else
+			{
+				target = localStates[target];
+			}
+			transitions[size_t(local) * entryCount + entry] = target;
+		}
+	}
+	for (uint32_t local = blockStateCount; local < states.size(); local++)
+	{
+		transitions.insert(transitions.end(), entryCount, local);
+	}
+	Partition partition(transitions, entryCount, blocks, localBlockCount);
+	if (newBlock != NO_ID)
+	{
+		partition.AddSplitter(localBlocks[newBlock]);
+	}
+
+	// the states of an old class that were not edited still agree on their outputs and the blocks
+	// they lead to; the seeds that differ from them are split off, and the parts start the refinement
+	auto signature = [&](uint32_t state) {
+		uint32_t local = localStates[state];
+		std::vector<uint32_t> key = OutputsOf(automaton, state);
+		key.push_back(partition.BlockOf(local));
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			key.push_back(partition.BlockOf(transitions[size_t(local) * entryCount + entry]));
+		}
+		return key;
+	};
+	std::map<std::vector<uint32_t>, std::vector<uint32_t>> parts;
+	std::set<std::vector<uint32_t>> unchanged;
+	std::vector<bool> checked(localBlockCount, false);
+	for (uint32_t seed : seeds)
+	{
+		uint32_t block = partition.BlockOf(localStates[seed]);
+		if (!checked[block])
+		{
+			checked[block] = true;
+			for (uint32_t i = 0; i < partition.Size(block); i++)
+			{
+				if (!TestBit(seeded, states[partition.Element(block, i)]))
+				{
+					unchanged.insert(signature(states[partition.Element(block, i)]));
+					break;
+				}
+			}
+		}
+		parts[signature(seed)].push_back(localStates[seed]);
+	}
+	for (const auto& [key, part] : parts)
+	{
+		if (unchanged.count(key) == 0)
+		{
+			partition.Separate(part);
+		}
+	}
+
+	bool split = partition.Refine(budget);
+	if (Stats* stats = CurrentStats())
+	{
+		stats->splitterCount += partition.SplitterCount();
+	}
+	if (!split)
+	{
+		return MinimizeReachable(automaton, classes, reachable);
+	}
+
+	Merger<Automaton> merger(automaton, classes, reachable, affected, states, transitions, partition);
+	std::vector<uint32_t> labels;
+	if (!merger.Labels(blockCount, passes, labels))
+	{
+		return MinimizeReachable(automaton, classes, reachable);
+	}
+
+	// classes numbered in BFS order from the start; the states outside the local machine are labeled by their
+	// old classes
+	auto label = [&](uint32_t state) {
+		return (localStates[state] != NO_ID) ? labels[partition.BlockOf(localStates[state])] : classes[state];
+	};
+	uint32_t labelCount = blockCount;
+	for (uint32_t blockLabel : labels)
+	{
+		labelCount = std::max(labelCount, blockLabel + 1);
+	}
+	std::vector<uint32_t> numbers(labelCount, NO_ID);
+	std::vector<uint32_t> queue{ 0 };
+	uint32_t classCount = 0;
+	numbers[label(0)] = classCount++;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t target = automaton.transitions[size_t(queue[head]) * entryCount + entry];
+			if (numbers[label(target)] == NO_ID)
+			{
+				numbers[label(target)] = classCount++;
+				queue.push_back(target);
+			}
+		}
+	}
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		classes[state] = TestBit(reachable, state) ? numbers[label(state)] : NO_ID;
+	}
+	AddRefinementRound(classCount);
+	return classCount;
+}
+
+template <typename Automaton>
+std::vector<uint32_t> Match(const Automaton& automaton, const Automaton& minimal)
+{
+	uint32_t entryCount = EntryCount(automaton);
+	std::vector<uint32_t> classes(StateCount(automaton), NO_ID);
+	std::vector<uint32_t> queue{ 0 };
+	classes[0] = 0;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		uint32_t state = queue[head];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t target = automaton.transitions[size_t(state) * entryCount + entry];
+			if (classes[target] == NO_ID)
+			{
+				classes[target] = minimal.transitions[size_t(classes[state]) * entryCount + entry];
+				queue.push_back(target);
+			}
+		}
+	}
+	return classes;
+}
+
+}
+
+std::vector<uint32_t> ApplyDelta(Mealy& mealy, const std::string& deltaFileName)
+{
+	return ReadDelta(deltaFileName, [&mealy](const Edit& edit) {
+		uint32_t entryCount = EntryCount(mealy);
+		if (edit[0] == "state" && edit.size() == 3)
+		{
+			uint32_t state = AddState(mealy, edit[1]);
+			mealy.outs.insert(mealy.outs.end(), entryCount, Intern(mealy.outputs, edit[2]));
+			return state;
+		}
+		if (edit[0] == "move" && edit.size() == 4)
+		{
+			uint32_t state = FindSymbol(mealy.states, edit[1], "state");
+			size_t index = size_t(state) * entryCount + FindSymbol(mealy.entries, edit[2], "entry");
+			size_t slash = edit[3].find('/');
+			if (slash == std::string::npos)
+			{
+				throw std::runtime_error("Transition " + edit[3] + " has no output");
+			}
+			mealy.transitions[index] = FindSymbol(mealy.states, edit[3].substr(0, slash), "state");
+			mealy.outs[index] = Intern(mealy.outputs, edit[3].substr(slash + 1));
+			return state;
+		}
+		throw std::runtime_error("Invalid edit " + edit[0]);
+	});
+}
+
+std::vector<uint32_t> ApplyDelta(Moore& moore, const std::string& deltaFileName)
+{
+	return ReadDelta(deltaFileName, [&moore](const Edit& edit) {
+		uint32_t entryCount = EntryCount(moore);
+		if (edit[0] == "state" && edit.size() == 3)
+		{
+			uint32_t state = AddState(moore, edit[1]);
+			moore.outs.push_back(Intern(moore.outputs, edit[2]));
+			return state;
+		}
+		if (edit[0] == "move" && edit.size() == 4)
+		{
+			uint32_t state = FindSymbol(moore.states, edit[1], "state");
+			size_t index = size_t(state) * entryCount + FindSymbol(moore.entries, edit[2], "entry");
+			moore.transitions[index] = FindSymbol(moore.states, edit[3], "state");
+			return state;
+		}
+		if (edit[0] == "output" && edit.size() == 3)
+		{
+			uint32_t state = FindSymbol(moore.states, edit[1], "state");
+			moore.outs[state] = Intern(moore.outputs, edit[2]);
+			return state;
+		}
+		throw std::runtime_error("Invalid edit " + edit[0]);
+	});
+}
+
+uint32_t UpdateClasses(const Mealy& mealy, std::vector<uint32_t>& classes, const std::vector<uint32_t>& editedStates,
+	unsigned threads)
+{
+	return Update(mealy, classes, editedStates, threads);
+}
+
+uint32_t UpdateClasses(const Moore& moore, std::vector<uint32_t>& classes, const std::vector<uint32_t>& editedStates,
+	unsigned threads)
+{
+	return Update(moore, classes, editedStates, threads);
+}
+
+std::vector<uint32_t> MatchClasses(const Mealy& mealy, const Mealy& minimal)
+{
+	return Match(mealy, minimal);
+}
+
+std::vector<uint32_t> MatchClasses(const Moore& moore, const Moore& minimal)
+{
+	return Match(moore, minimal);
+}
@@ -0,0 +1,35 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Incremental re-minimization. A machine is saved together with its partition: classes[state] is the
+// state's class in the minimal machine, numbered from the start like the engines do, or NO_ID for an
+// unreachable state.
+
+// Delta files hold one edit per line, names as in the csv files; empty lines and lines starting with # are skipped:
+//   state <name> <output>                       new state whose transitions lead back to it; the output is the
+//                                               signal of a Moore state or the output of the Mealy loops
+//   move <state> <entry> <target>[/<output>]    redirects a transition, Mealy transitions name their output
+//   output <state> <output>                     new signal of a Moore state
+// The machines are complete, so adding or removing a transition is a move. Returns the edited states.
+std::vector<uint32_t> ApplyDelta(Mealy& mealy, const std::string& deltaFileName);
+std::vector<uint32_t> ApplyDelta(Moore& moore, const std::string& deltaFileName);
+
+// The edited states that no longer agree with their classes and the states that became reachable are split
+// off, and only their predecessors are split further; the classes that can reach an edit are then merged
+// again, with one another and with the untouched classes, which stay minimal. The splitting and merging run on
+// the classes that can reach an edit, with inverse transitions of their own states only; the states that can
+// reach an edit and the predecessors of the untouched classes they are matched with are found by a few passes
+// over the machine. When the states that can reach an edit, their classes or the splitting hold a sixteenth of
+// the machine, some class cannot be matched or the passes run out, it is minimized from scratch.
+// Returns the number of classes.
+uint32_t UpdateClasses(const Mealy& mealy, std::vector<uint32_t>& classes, const std::vector<uint32_t>& editedStates,
+	unsigned threads = 0);
+uint32_t UpdateClasses(const Moore& moore, std::vector<uint32_t>& classes, const std::vector<uint32_t>& editedStates,
+	unsigned threads = 0);
+
+// classes of the states of a machine given its minimal machine, found by walking both from the start
+std::vector<uint32_t> MatchClasses(const Mealy& mealy, const Mealy& minimal);
+std::vector<uint32_t> MatchClasses(const Moore& moore, const Moore& minimal);
@@ -0,0 +1,32 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& fileName);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	std::string_view Data() const
+	{
+		return std::string_view(m_data, m_size);
+	}
+
+private:
+	void Close();
+
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,320 @@
+﻿#include "Minimization.h"
+#include "Alphabet.h"
+#include "Analysis.h"
+#include "Cancellation.h"
+#include "Conversion.h"
+#include "Refinement.h"
+#include "Stats.h"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+const std::string HOPCROFT_ALGORITHM = "hopcroft";
+const std::string SIGNATURE_ALGORITHM = "signature";
+const std::string REFERENCE_ALGORITHM = "reference";
+const std::string PARTIAL_ALGORITHM = "partial";
+
+// the building of the Moore machine looks for cancellation after this many new states
+const size_t CANCEL_CHECK_STATES = 1 << 16;
+
+// refine runs on the machine over one entry per class of equal columns and its result gets every entry back;
+// a machine whose columns all differ goes through as it is
+template <typename Automaton, typename Result>
+Result OnEntryClasses(Automaton automaton, const MinimizeOptions& options,
+	Result (*refine)(Automaton, const MinimizeOptions&))
+{
+	std::optional<Automaton> compressed;
+	EntryClasses entryClasses = InPhase("alphabet", [&] {
+		EntryClasses found = GroupEntries(automaton, options.threads);
+		if (ClassCount(found) != EntryCount(automaton))
+		{
+			compressed = CompressEntries(automaton, found);
+		}
+		return found;
+	});
+	if (!compressed)
+	{
+		return refine(std::move(automaton), options);
+	}
+	SymbolTable entries = std::move(automaton.entries);
+	automaton = Automaton();
+	Result result = refine(std::move(*compressed), options);
+	return InPhase("expand", [&] { return ExpandEntries(result, entryClasses, entries, options.threads); });
+}
+
+Mealy RefinedMealy(Mealy mealy, const MinimizeOptions& options)
+{
+	if (StateCount(mealy) == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	mealy = InPhase("reachability", [&] { return DeleteUnreachableStates(mealy, options.threads); });
+	uint32_t stateCount = StateCount(mealy);
+	uint32_t entryCount = EntryCount(mealy);
+
+	// states with equal outputs form the starting partition
+	std::vector<uint32_t> classes = InPhase("refinement", [&] {
+		std::vector<uint32_t> initialClasses;
+		uint32_t groupCount = GroupByOutputs(mealy, initialClasses);
+		return RefineClasses(options.algorithm, mealy.transitions, stateCount, entryCount, initialClasses, groupCount,
+			options.threads);
+	});
+
+	return InPhase("build", [&] { return BuildMinimalMealy(mealy, classes); });
+}
+
+Moore RefinedMoore(Moore moore, const MinimizeOptions& options)
+{
+	if (StateCount(moore) == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	moore = InPhase("reachability", [&] { return DeleteUnreachableStates(moore, options.threads); });
+	uint32_t stateCount = StateCount(moore);
+	uint32_t entryCount = EntryCount(moore);
+
+	// states with equal output signals form the starting partition
+	std::vector<uint32_t> classes = InPhase("refinement", [&] {
+		std::vector<uint32_t> initialClasses;
+		uint32_t groupCount = GroupByOutputs(moore, initialClasses);
+		return RefineClasses(options.algorithm, moore.transitions, stateCount, entryCount, initialClasses, groupCount,
+			options.threads);
+	});
+
+	return InPhase("build", [&] { return BuildMinimalMoore(moore, classes); });
+}
+
+// Moore states {class, output} found by a BFS from the start, so they come out in the order of
+// the classes of a minimized Moore machine
+Moore BuildMinimalMooreFromMealy(const Mealy& mealy, const std::vector<uint32_t>& classes)
+{
+	uint32_t entryCount = EntryCount(mealy);
+	std::vector<uint32_t> representatives(CountClasses(classes), NO_ID);
+	for (uint32_t state = 0; state < StateCount(mealy); state++)
+	{
+		if (representatives[classes[state]] == NO_ID)
+		{
+			representatives[classes[state]] = state;
+		}
+	}
+
+	Moore moore;
+	moore.entries = mealy.entries;
+	moore.outputs = mealy.outputs;
+	std::vector<std::pair<uint32_t, uint32_t>> pairs{ { classes[0], StartOutput(mealy, moore.outputs) } };
+	std::unordered_map<uint64_t, uint32_t> ids{ { uint64_t(pairs[0].first) << 32 | pairs[0].second, 0 } };
+	for (size_t head = 0; head < pairs.size(); head++)
+	{
+		if (head % CANCEL_CHECK_STATES == 0)
+		{
+			CheckCancelled();
+		}
+		auto [stateClass, output] = pairs[head];
+		moore.outs.push_back(output);
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			size_t cell = size_t(representatives[stateClass]) * entryCount + entry;
+			std::pair<uint32_t, uint32_t> target{ classes[mealy.transitions[cell]], mealy.outs[cell] };
+			auto [found, added] = ids.emplace(uint64_t(target.first) << 32 | target.second, static_cast<uint32_t>(pairs.size()));
+			if (added)
+			{
+				pairs.push_back(target);
+			}
+			moore.transitions.push_back(found->second);
+		}
+	}
+	moore.states = NumberedSymbols("X", static_cast<uint32_t>(pairs.size()));
+	return moore;
+}
+
+Moore RefinedMealyToMoore(Mealy mealy, const MinimizeOptions& options)
+{
+	if (StateCount(mealy) == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	mealy = InPhase("reachability", [&] { return DeleteUnreachableStates(mealy, options.threads); });
+	std::vector<uint32_t> classes = InPhase("refinement", [&] {
+		std::vector<uint32_t> initialClasses;
+		uint32_t groupCount = GroupByOutputs(mealy, initialClasses);
+		return RefineClasses(options.algorithm, mealy.transitions, StateCount(mealy), EntryCount(mealy), initialClasses,
+			groupCount, options.threads);
+	});
+	return InPhase("build", [&] { return BuildMinimalMooreFromMealy(mealy, classes); });
+}
+
+}
+
+RefinementAlgorithm ParseRefinementAlgorithm(const std::string& name)
+{
+	if (name == HOPCROFT_ALGORITHM)
+	{
+		return RefinementAlgorithm::Hopcroft;
+	}
+	if (name == SIGNATURE_ALGORITHM)
+	{
+		return RefinementAlgorithm::Signatures;
+	}
+	if (name == REFERENCE_ALGORITHM)
+	{
+		return RefinementAlgorithm::Reference;
+	}
+	if (name == PARTIAL_ALGORITHM)
+	{
+		return RefinementAlgorithm::Partial;
+	}
+	throw std::runtime_error("Unknown algorithm " + name);
+}
+
+std::vector<uint32_t> RefineClasses(RefinementAlgorithm algorithm, const std::vector<uint32_t>& transitions,
+	uint32_t stateCount, uint32_t entryCount, const std::vector<uint32_t>& initialClasses, uint32_t classCount,
+	unsigned threads)
+{
+	if (algorithm == RefinementAlgorithm::Signatures)
+	{
+		return RefineSignatures(transitions, stateCount, entryCount, initialClasses, classCount, threads);
+	}
+	if (algorithm == RefinementAlgorithm::Partial)
+	{
+		// a complete machine is a partial one with every entry defined in every state
+		std::vector<uint32_t> offsets(size_t(stateCount) + 1);
+		std::vector<uint32_t> labels(transitions.size());
+		for (uint32_t state = 0; state <= stateCount; state++)
+		{
+			offsets[state] = state * entryCount;
+		}
+		for (size_t t = 0; t < labels.size(); t++)
+		{
+			labels[t] = static_cast<uint32_t>(t % entryCount);
+		}
+		return RefinePartial(offsets, transitions, labels, entryCount, initialClasses, classCount);
+	}
+	return (algorithm == RefinementAlgorithm::Reference)
+		? RefineReference(transitions, stateCount, entryCount, initialClasses, classCount)
+		: RefineHopcroft(transitions, stateCount, entryCount, initialClasses, classCount);
+}
+
+uint32_t CountClasses(const std::vector<uint32_t>& classes)
+{
+	uint32_t classCount = 0;
+	for (uint32_t stateClass : classes)
+	{
+		classCount = (stateClass != NO_ID) ? std::max(classCount, stateClass + 1) : classCount;
+	}
+	return classCount;
+}
+
+Mealy BuildMinimalMealy(const Mealy& mealy, const std::vector<uint32_t>& classes)
+{
+	uint32_t stateCount = StateCount(mealy);
+	uint32_t entryCount = EntryCount(mealy);
+
+	Mealy minMealy;
+	uint32_t classCount = CountClasses(classes);
+	minMealy.states = NumberedSymbols("X", classCount);
+	minMealy.entries = mealy.entries;
+	minMealy.outputs = mealy.outputs;
+	minMealy.transitions.resize(size_t(classCount) * entryCount, NO_ID);
+	minMealy.outs.resize(size_t(classCount) * entryCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		size_t row = size_t(classes[state]) * entryCount;
+		if (classes[state] == NO_ID || entryCount == 0 || minMealy.transitions[row] != NO_ID)
+		{
+			continue;
+		}
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			minMealy.transitions[row + entry] = classes[mealy.transitions[size_t(state) * entryCount + entry]];
+			minMealy.outs[row + entry] = mealy.outs[size_t(state) * entryCount + entry];
+		}
+	}
+	return minMealy;
+}
+
+Moore BuildMinimalMoore(const Moore& moore, const std::vector<uint32_t>& classes)
+{
+	uint32_t stateCount = StateCount(moore);
+	uint32_t entryCount = EntryCount(moore);
+
+	Moore minMoore;
+	uint32_t classCount = CountClasses(classes);
+	minMoore.states = NumberedSymbols("X", classCount);
+	minMoore.entries = moore.entries;
+	minMoore.outputs = moore.outputs;
+	minMoore.outs.resize(classCount, NO_ID);
+	minMoore.transitions.resize(size_t(classCount) * entryCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		uint32_t minState = classes[state];
+		if (minState == NO_ID || minMoore.outs[minState] != NO_ID)
+		{
+			continue;
+		}
+		minMoore.outs[minState] = moore.outs[state];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			minMoore.transitions[size_t(minState) * entryCount + entry] = classes[moore.transitions[size_t(state) * entryCount + entry]];
+		}
+	}
+	return minMoore;
+}
+
+// the refinement runs only when the cache of the options has no result for the machine yet
+Mealy MinimizedMealy(Mealy mealy, const MinimizeOptions& options)
+{
+	if (options.cacheDirectory.empty() || StateCount(mealy) == 0)
+	{
+		return OnEntryClasses(std::move(mealy), options, RefinedMealy);
+	}
+	ResultCache cache(options.cacheDirectory, options.cacheBytes);
+	CacheKey key = InPhase("cache-key", [&] { return StructuralKey(mealy, CacheOperation::MinimizeMealy); });
+	std::optional<Mealy> cached = InPhase("cache-lookup", [&] { return cache.FindMealy(key, mealy.entries, mealy.outputs); });
+	if (cached)
+	{
+		return std::move(*cached);
+	}
+	Mealy minMealy = OnEntryClasses(std::move(mealy), options, RefinedMealy);
+	InPhase("cache-store", [&] { cache.StoreMealy(key, minMealy); });
+	return minMealy;
+}
+
+Moore MinimizedMoore(Moore moore, const MinimizeOptions& options)
+{
+	if (options.cacheDirectory.empty() || StateCount(moore) == 0)
+	{
+		return OnEntryClasses(std::move(moore), options, RefinedMoore);
+	}
+	ResultCache cache(options.cacheDirectory, options.cacheBytes);
+	CacheKey key = InPhase("cache-key", [&] { return StructuralKey(moore, CacheOperation::MinimizeMoore); });
+	std::optional<Moore> cached = InPhase("cache-lookup", [&] { return cache.FindMoore(key, moore.entries, moore.outputs); });
+	if (cached)
+	{
+		return std::move(*cached);
+	}
+	Moore minMoore = OnEntryClasses(std::move(moore), options, RefinedMoore);
+	InPhase("cache-store", [&] { cache.StoreMoore(key, minMoore); });
+	return minMoore;
+}
+
+Moore MealyToMinimalMoore(Mealy mealy, const MinimizeOptions& options)
+{
+	if (options.cacheDirectory.empty() || StateCount(mealy) == 0)
+	{
+		return OnEntryClasses(std::move(mealy), options, RefinedMealyToMoore);
+	}
+	ResultCache cache(options.cacheDirectory, options.cacheBytes);
+	CacheKey key = InPhase("cache-key", [&] { return StructuralKey(mealy, CacheOperation::MealyToMinimalMoore); });
+	std::optional<Moore> cached = InPhase("cache-lookup", [&] { return cache.FindMoore(key, mealy.entries, mealy.outputs); });
+	if (cached)
+	{
+		return std::move(*cached);
+	}
+	Moore moore = OnEntryClasses(std::move(mealy), options, RefinedMealyToMoore);
+	InPhase("cache-store", [&] { cache.StoreMoore(key, moore); });
+	return moore;
+}
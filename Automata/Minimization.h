@@ -0,0 +1,52 @@
+﻿#pragma once
+#include "Automaton.h"
+#include "Cache.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimization of machines in memory: the machines are taken and returned by value, so a caller that
+// moves its machine in and the result out copies nothing.
+
+enum class RefinementAlgorithm
+{
+	Hopcroft,
+	Signatures,
+	Reference,
+	Partial, // Valmari and Lehtinen's engine, the one of the machines with undefined transitions (see Sparse.h)
+};
+
+// "hopcroft", "signature", "reference" or "partial"
+RefinementAlgorithm ParseRefinementAlgorithm(const std::string& name);
+
+struct MinimizeOptions
+{
+	RefinementAlgorithm algorithm = RefinementAlgorithm::Hopcroft;
+	unsigned threads = 0; // for reachability and the signature engine, 0 - all hardware threads
+	std::string cacheDirectory; // the only files touched, no cache when empty
+	uint64_t cacheBytes = DEFAULT_CACHE_BYTES;
+};
+
+// the engine of the algorithm, see Refinement.h
+std::vector<uint32_t> RefineClasses(RefinementAlgorithm algorithm, const std::vector<uint32_t>& transitions,
+	uint32_t stateCount, uint32_t entryCount, const std::vector<uint32_t>& initialClasses, uint32_t classCount,
+	unsigned threads = 0);
+
+// unreachable states have no class (NO_ID)
+uint32_t CountClasses(const std::vector<uint32_t>& classes);
+
+// one state per class, named X0, X1, ..., built from the first state of the class
+Mealy BuildMinimalMealy(const Mealy& mealy, const std::vector<uint32_t>& classes);
+Moore BuildMinimalMoore(const Moore& moore, const std::vector<uint32_t>& classes);
+
+// minimal machine of the states reachable from the start, refined from the states with equal outputs;
+// entries with equal columns are one entry for the reachability and the refinement (see Alphabet.h).
+// Throws for a machine without states
+Mealy MinimizedMealy(Mealy mealy, const MinimizeOptions& options = {});
+Moore MinimizedMoore(Moore moore, const MinimizeOptions& options = {});
+
+// minimal Moore machine equivalent to the Mealy machine, without the Moore machine of all its pairs:
+// the Mealy machine is minimized first and a Moore state is made for every pair {class, output} reachable
+// from the start. The start takes the output of StartOutput, the states are named X0, X1, ... in the order
+// Minimize numbers them, so the result is the one of MealyToMoore followed by MinimizedMoore.
+Moore MealyToMinimalMoore(Mealy mealy, const MinimizeOptions& options = {});
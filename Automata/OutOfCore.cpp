@@ -0,0 +1,497 @@
+﻿#include "OutOfCore.h"
+#include "Analysis.h"
+#include "BinaryFormat.h"
+#include "Cancellation.h"
+#include "Minimization.h"
+#include "Refinement.h"
+#include "Stats.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+const char CHECKPOINT_MAGIC[4] = { 'A', 'U', 'T', 'P' };
+const uint32_t CHECKPOINT_VERSION = 1;
+// the sort gets at least this much of the budget
+const uint64_t MIN_SORT_BYTES = 1 << 20;
+// the sort buffer grows by this many records up to its share of the budget
+const size_t RECORD_GROWTH = 1 << 16;
+
+// the partition after a round, with the size and the time of the input it belongs to
+struct Checkpoint
+{
+	uint32_t round = 0;
+	uint32_t classCount = 0;
+	uint64_t fileSize = 0;
+	int64_t writeTime = 0;
+};
+
+// the name of the input file with the suffix, in the work directory
+std::string WorkFileName(const std::string& inFileName, const OutOfCoreOptions& options, const std::string& suffix)
+{
+	std::filesystem::path directory(options.workDirectory.empty() ? "." : options.workDirectory);
+	return (directory / (std::filesystem::path(inFileName).filename().string() + suffix)).string();
+}
+
+[[noreturn]] void FailBroken(const std::string& inFileName)
+{
+	throw std::runtime_error("Broken binary automaton " + inFileName);
+}
+
+// records of recordWords words in lexicographic order: sorted in memory while they fit into the buffer,
+// otherwise every full buffer is sorted into a run file and the runs are merged at the end
+class RecordSorter
+{
+public:
+	RecordSorter(size_t recordWords, uint64_t bufferBytes, std::string runPrefix)
+		: m_recordWords(recordWords)
+		, m_capacity(static_cast<size_t>(std::clamp<uint64_t>(bufferBytes / ((recordWords + 1) * sizeof(uint32_t)), 1, UINT32_MAX)))
+		, m_bufferBytes(bufferBytes)
+		, m_runPrefix(std::move(runPrefix))
+	{
+	}
+
+	~RecordSorter()
+	{
+		for (const std::string& runName : m_runNames)
+		{
+			std::error_code error;
+			std::filesystem::remove(runName, error);
+		}
+	}
+
+	RecordSorter(const RecordSorter&) = delete;
+	RecordSorter& operator=(const RecordSorter&) = delete;
+
+	// the words of the next record
+	uint32_t* Add()
+	{
+		if (m_count == m_capacity)
+		{
+			Spill();
+		}
+		if (m_records.size() < (m_count + 1) * m_recordWords)
+		{
+			m_records.resize(std::min(m_count + RECORD_GROWTH, m_capacity) * m_recordWords);
+		}
+		return m_records.data() + m_count++ * m_recordWords;
+	}
+
+	// calls visit(record) for every record in order
+	template <typename Visit>
+	void Finish(Visit visit)
+	{
+		if (m_runNames.empty())
+		{
+			SortBuffer();
+			for (uint32_t index : m_order)
+			{
+				visit(Record(index));
+			}
+			return;
+		}
+		Spill();
+		std::vector<uint32_t>().swap(m_records);
+		std::vector<uint32_t>().swap(m_order);
+		Merge(visit);
+	}
+
+private:
+	struct Run
+	{
+		std::ifstream input;
+		std::vector<uint32_t> block;
+		size_t position = 0;
+		size_t size = 0;
+	};
+
+	const uint32_t* Record(size_t index) const
+	{
+		return m_records.data() + index * m_recordWords;
+	}
+
+	bool Less(const uint32_t* first, const uint32_t* second) const
+	{
+		return std::lexicographical_compare(first, first + m_recordWords, second, second + m_recordWords);
+	}
+
+	void SortBuffer()
+	{
+		m_order.resize(m_count);
+		std::iota(m_order.begin(), m_order.end(), 0);
+		std::sort(m_order.begin(), m_order.end(),
+			[this](uint32_t first, uint32_t second) { return Less(Record(first), Record(second)); });
+	}
+
+	void Spill()
+	{
+		CheckCancelled();
+		SortBuffer();
+		std::string runName = m_runPrefix + std::to_string(m_runNames.size());
+		m_runNames.push_back(runName);
+		std::ofstream output(runName, std::ios::binary);
+		for (uint32_t index : m_order)
+		{
+			output.write(reinterpret_cast<const char*>(Record(index)), std::streamsize(m_recordWords * sizeof(uint32_t)));
+		}
+		output.flush();
+		if (!output)
+		{
+			throw std::runtime_error("Cannot write file " + runName);
+		}
+		AddBytesWritten(uint64_t(m_count) * m_recordWords * sizeof(uint32_t));
+		m_count = 0;
+	}
+
+	bool Fill(Run& run)
+	{
+		run.input.read(reinterpret_cast<char*>(run.block.data()), std::streamsize(run.block.size() * sizeof(uint32_t)));
+		size_t bytes = static_cast<size_t>(run.input.gcount());
+		AddBytesRead(bytes);
+		run.size = bytes / sizeof(uint32_t);
+		run.position = 0;
+		return run.size != 0;
+	}
+
+	// the runs share the buffer, every block holds whole records
+	template <typename Visit>
+	void Merge(Visit visit)
+	{
+		uint64_t recordBytes = m_recordWords * sizeof(uint32_t);
+		size_t blockRecords = static_cast<size_t>(std::max<uint64_t>(m_bufferBytes / m_runNames.size() / recordBytes, 1));
+		std::vector<Run> runs(m_runNames.size());
+		auto current = [&runs](size_t run) { return runs[run].block.data() + runs[run].position; };
+		auto later = [&](size_t first, size_t second) { return Less(current(second), current(first)); };
+		std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+		for (size_t run = 0; run < runs.size(); run++)
+		{
+			runs[run].input.open(m_runNames[run], std::ios::binary);
+			if (!runs[run].input)
+			{
+				throw std::runtime_error("Cannot open file " + m_runNames[run]);
+			}
+			runs[run].block.resize(blockRecords * m_recordWords);
+			if (Fill(runs[run]))
+			{
+				heap.push(run);
+			}
+		}
+		while (!heap.empty())
+		{
+			size_t run = heap.top();
+			heap.pop();
+			visit(current(run));
+			runs[run].position += m_recordWords;
+			if (runs[run].position < runs[run].size || Fill(runs[run]))
+			{
+				heap.push(run);
+			}
+		}
+	}
+
+	size_t m_recordWords;
+	size_t m_capacity; // records that fit into the buffer
+	uint64_t m_bufferBytes;
+	std::string m_runPrefix;
+	std::vector<uint32_t> m_records;
+	std::vector<uint32_t> m_order;
+	size_t m_count = 0;
+	std::vector<std::string> m_runNames;
+};
+
+// the sorted records {key, state} give every state the number of its key; returns the number of keys
+uint32_t NumberKeys(RecordSorter& sorter, size_t keyWords, std::vector<uint32_t>& classes)
+{
+	std::vector<uint32_t> previous(keyWords);
+	uint32_t count = 0;
+	sorter.Finish([&](const uint32_t* record) {
+		if (count == 0 || !std::equal(record, record + keyWords, previous.begin()))
+		{
+			std::copy(record, record + keyWords, previous.begin());
+			count++;
+		}
+		classes[record[keyWords]] = count - 1;
+	});
+	return count;
+}
+
+// level by level from state 0, every level is sorted so that its rows are read in the order of the file
+StateBits FindReachableOutOfCore(const MappedAutomaton& machine, const std::string& inFileName)
+{
+	StateBits reachable((size_t(machine.stateCount) + 63) / 64, 0);
+	reachable[0] = 1;
+	std::vector<uint32_t> level{ 0 };
+	std::vector<uint32_t> next;
+	while (!level.empty())
+	{
+		CheckCancelled();
+		std::sort(level.begin(), level.end());
+		next.clear();
+		for (uint32_t state : level)
+		{
+			const uint32_t* row = machine.transitions + size_t(state) * machine.entryCount;
+			for (uint32_t entry = 0; entry < machine.entryCount; entry++)
+			{
+				uint32_t target = row[entry];
+				if (target >= machine.stateCount)
+				{
+					FailBroken(inFileName);
+				}
+				uint64_t mask = uint64_t(1) << (target & 63);
+				if (!(reachable[target >> 6] & mask))
+				{
+					reachable[target >> 6] |= mask;
+					next.push_back(target);
+				}
+			}
+		}
+		level.swap(next);
+	}
+	return reachable;
+}
+
+// the starting partition from records {output row or output signal, state} of the reachable states
+uint32_t GroupByOutputsOutOfCore(const MappedAutomaton& machine, const StateBits& reachable, uint64_t sortBytes,
+	const std::string& runPrefix, const std::string& inFileName, std::vector<uint32_t>& classes)
+{
+	size_t outWords = (machine.kind == AutomatonKind::Mealy) ? machine.entryCount : 1;
+	uint32_t outputCount = SymbolCount(machine.outputs);
+	RecordSorter sorter(outWords + 1, sortBytes, runPrefix);
+	for (uint32_t state = 0; state < machine.stateCount; state++)
+	{
+		if (!TestBit(reachable, state))
+		{
+			continue;
+		}
+		const uint32_t* outs = machine.outs + size_t(state) * outWords;
+		uint32_t* record = sorter.Add();
+		for (size_t i = 0; i < outWords; i++)
+		{
+			if (outs[i] >= outputCount)
+			{
+				FailBroken(inFileName);
+			}
+			record[i] = outs[i];
+		}
+		record[outWords] = state;
+	}
+	return NumberKeys(sorter, outWords, classes);
+}
+
+// one Moore round: the states with equal records {class, classes of the targets} keep a class
+uint32_t RefineRound(const MappedAutomaton& machine, const std::vector<uint32_t>& classes, uint64_t sortBytes,
+	const std::string& runPrefix, std::vector<uint32_t>& newClasses)
+{
+	uint32_t entryCount = machine.entryCount;
+	RecordSorter sorter(size_t(entryCount) + 2, sortBytes, runPrefix);
+	for (uint32_t state = 0; state < machine.stateCount; state++)
+	{
+		if (classes[state] == NO_ID)
+		{
+			continue;
+		}
+		const uint32_t* row = machine.transitions + size_t(state) * entryCount;
+		uint32_t* record = sorter.Add();
+		record[0] = classes[state];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			record[entry + 1] = classes[row[entry]];
+		}
+		record[entryCount + 1] = state;
+	}
+	return NumberKeys(sorter, size_t(entryCount) + 1, newClasses);
+}
+
+Checkpoint InputCheckpoint(const std::string& inFileName)
+{
+	Checkpoint checkpoint;
+	checkpoint.fileSize = std::filesystem::file_size(inFileName);
+	checkpoint.writeTime = static_cast<int64_t>(std::filesystem::last_write_time(inFileName).time_since_epoch().count());
+	return checkpoint;
+}
+
+// written next to the checkpoint and renamed, so that a stop while writing leaves the one of the round before
+void SaveCheckpoint(const std::string& fileName, const MappedAutomaton& machine, const Checkpoint& checkpoint,
+	const std::vector<uint32_t>& classes)
+{
+	std::string temporaryFileName = fileName + ".tmp";
+	{
+		const uint32_t fields[] = { CHECKPOINT_VERSION, machine.stateCount, machine.entryCount, checkpoint.round,
+			checkpoint.classCount };
+		std::ofstream output(temporaryFileName, std::ios::binary);
+		output.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		output.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+		output.write(reinterpret_cast<const char*>(&checkpoint.fileSize), sizeof(checkpoint.fileSize));
+		output.write(reinterpret_cast<const char*>(&checkpoint.writeTime), sizeof(checkpoint.writeTime));
+		output.write(reinterpret_cast<const char*>(classes.data()), std::streamsize(classes.size() * sizeof(uint32_t)));
+		output.flush();
+		if (!output)
+		{
+			throw std::runtime_error("Cannot write file " + temporaryFileName);
+		}
+	}
+	AddBytesWritten(classes.size() * sizeof(uint32_t));
+	std::filesystem::rename(temporaryFileName, fileName);
+}
+
+// false when there is no checkpoint of this input, checkpoint has its size and time
+bool LoadCheckpoint(const std::string& fileName, const MappedAutomaton& machine, Checkpoint& checkpoint,
+	std::vector<uint32_t>& classes)
+{
+	std::ifstream input(fileName, std::ios::binary);
+	char magic[sizeof(CHECKPOINT_MAGIC)] = {};
+	uint32_t fields[5] = {};
+	Checkpoint saved;
+	input.read(magic, sizeof(magic));
+	input.read(reinterpret_cast<char*>(fields), sizeof(fields));
+	input.read(reinterpret_cast<char*>(&saved.fileSize), sizeof(saved.fileSize));
+	input.read(reinterpret_cast<char*>(&saved.writeTime), sizeof(saved.writeTime));
+	if (!input || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || fields[0] != CHECKPOINT_VERSION
+		|| fields[1] != machine.stateCount || fields[2] != machine.entryCount || saved.fileSize != checkpoint.fileSize
+		|| saved.writeTime != checkpoint.writeTime)
+	{
+		return false;
+	}
+	classes.resize(machine.stateCount);
+	input.read(reinterpret_cast<char*>(classes.data()), std::streamsize(classes.size() * sizeof(uint32_t)));
+	bool valid = input && classes[0] != NO_ID;
+	for (uint32_t stateClass : classes)
+	{
+		valid = valid && (stateClass == NO_ID || stateClass < fields[4]);
+	}
+	checkpoint.round = fields[3];
+	checkpoint.classCount = fields[4];
+	AddBytesRead(classes.size() * sizeof(uint32_t));
+	return valid;
+}
+
+// one state per class from its first state; the classes are numbered in that order first, which puts the
+// start first, and then from the start the way the engines number them
+template <typename Automaton>
+Automaton BuildMinimalOutOfCore(const MappedAutomaton& machine, const std::vector<uint32_t>& classes, uint32_t classCount)
+{
+	uint32_t entryCount = machine.entryCount;
+	std::vector<uint32_t> quotientIds(classCount, NO_ID);
+	std::vector<uint32_t> representatives;
+	for (uint32_t state = 0; state < machine.stateCount; state++)
+	{
+		if (classes[state] != NO_ID && quotientIds[classes[state]] == NO_ID)
+		{
+			quotientIds[classes[state]] = static_cast<uint32_t>(representatives.size());
+			representatives.push_back(state);
+		}
+	}
+
+	Automaton quotient;
+	quotient.states = NumberedSymbols("X", classCount);
+	quotient.entries = machine.entries;
+	quotient.outputs = machine.outputs;
+	for (uint32_t state : representatives)
+	{
+		const uint32_t* row = machine.transitions + size_t(state) * entryCount;
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			quotient.transitions.push_back(quotientIds[classes[row[entry]]]);
+		}
+		if constexpr (std::is_same_v<Automaton, Mealy>)
+		{
+			quotient.outs.insert(quotient.outs.end(), machine.outs + size_t(state) * entryCount,
+				machine.outs + size_t(state + 1) * entryCount);
+		}
+		else
+		{
+			quotient.outs.push_back(machine.outs[state]);
+		}
+	}
+
+	std::vector<uint32_t> identity(classCount);
+	std::iota(identity.begin(), identity.end(), 0);
+	std::vector<uint32_t> numbered = NumberClassesFromStart(quotient.transitions, entryCount, identity, classCount);
+	if constexpr (std::is_same_v<Automaton, Mealy>)
+	{
+		return BuildMinimalMealy(quotient, numbered);
+	}
+	else
+	{
+		return BuildMinimalMoore(quotient, numbered);
+	}
+}
+
+template <typename Automaton>
+Automaton MinimizedOutOfCore(const std::string& inFileName, AutomatonKind kind, const OutOfCoreOptions& options)
+{
+	MappedAutomaton machine = MapBinary(inFileName);
+	if (machine.kind != kind)
+	{
+		throw std::runtime_error(inFileName + " holds a " + (machine.kind == AutomatonKind::Mealy ? "mealy" : "moore")
+			+ " automaton");
+	}
+	if (machine.stateCount == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	uint64_t classBytes = 2 * sizeof(uint32_t) * uint64_t(machine.stateCount);
+	if (options.memoryBytes < classBytes + MIN_SORT_BYTES)
+	{
+		throw std::runtime_error("A memory budget of " + std::to_string(options.memoryBytes) + " bytes is too small for "
+			+ std::to_string(machine.stateCount) + " states");
+	}
+	uint64_t sortBytes = options.memoryBytes - classBytes;
+	std::string checkpointName = WorkFileName(inFileName, options, ".checkpoint");
+	std::string runPrefix = WorkFileName(inFileName, options, ".run");
+
+	Checkpoint checkpoint = InputCheckpoint(inFileName);
+	std::vector<uint32_t> classes;
+	if (!LoadCheckpoint(checkpointName, machine, checkpoint, classes))
+	{
+		StateBits reachable = InPhase("reachability", [&] { return FindReachableOutOfCore(machine, inFileName); });
+		classes.assign(machine.stateCount, NO_ID);
+		checkpoint.round = 0;
+		checkpoint.classCount = InPhase("partition", [&] {
+			return GroupByOutputsOutOfCore(machine, reachable, sortBytes, runPrefix, inFileName, classes);
+		});
+		SaveCheckpoint(checkpointName, machine, checkpoint, classes);
+	}
+	if (Stats* stats = CurrentStats())
+	{
+		stats->unreachableStateCount += static_cast<uint32_t>(std::count(classes.begin(), classes.end(), NO_ID));
+	}
+
+	// rounds until one splits no class
+	InPhase("refinement", [&] {
+		std::vector<uint32_t> newClasses = classes;
+		uint32_t previousCount = 0;
+		while (previousCount != checkpoint.classCount)
+		{
+			CheckCancelled();
+			previousCount = checkpoint.classCount;
+			checkpoint.classCount = RefineRound(machine, classes, sortBytes, runPrefix, newClasses);
+			checkpoint.round++;
+			AddRefinementRound(checkpoint.classCount);
+			classes.swap(newClasses);
+			SaveCheckpoint(checkpointName, machine, checkpoint, classes);
+		}
+	});
+
+	Automaton minimal = InPhase("build", [&] { return BuildMinimalOutOfCore<Automaton>(machine, classes, checkpoint.classCount); });
+	std::filesystem::remove(checkpointName);
+	return minimal;
+}
+
+}
+
+Mealy MinimizedMealyOutOfCore(const std::string& inFileName, const OutOfCoreOptions& options)
+{
+	return MinimizedOutOfCore<Mealy>(inFileName, AutomatonKind::Mealy, options);
+}
+
+Moore MinimizedMooreOutOfCore(const std::string& inFileName, const OutOfCoreOptions& options)
+{
+	return MinimizedOutOfCore<Moore>(inFileName, AutomatonKind::Moore, options);
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <string>
+
+// Minimization of binary machines larger than the memory. The transition table stays in the file and is
+// paged in as it is scanned; every refinement round is one scan that writes a record {class, classes of the
+// targets, state} per reachable state and an external sort of the records, whose runs go to the work
+// directory. Memory holds the classes of the states twice and the sort buffer. The partition is saved to the
+// work directory after every round, so a minimization that was stopped resumes from the last round it finished.
+struct OutOfCoreOptions
+{
+	uint64_t memoryBytes = 0; // the classes and the sort buffer
+	std::string workDirectory; // the runs and the checkpoint, the current directory when empty
+};
+
+// the results are the ones of MinimizedMealy and MinimizedMoore, only the minimal machine is built in memory;
+// throws when the budget cannot hold the classes of the states and a small sort buffer
+Mealy MinimizedMealyOutOfCore(const std::string& inFileName, const OutOfCoreOptions& options);
+Moore MinimizedMooreOutOfCore(const std::string& inFileName, const OutOfCoreOptions& options);
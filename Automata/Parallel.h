@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// 0 means one thread per hardware thread
+inline unsigned ThreadCount(unsigned requested)
+{
+	if (requested != 0)
+	{
+		return requested;
+	}
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// splits [0, count) into one contiguous chunk per thread and calls function(begin, end, thread);
+// the first chunk runs on the calling thread
+template <typename Function>
+void ParallelFor(size_t count, unsigned threads, Function function)
+{
+	threads = static_cast<unsigned>(std::min<size_t>(ThreadCount(threads), std::max<size_t>(count, 1)));
+	if (threads == 1)
+	{
+		function(size_t(0), count, 0u);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (unsigned thread = 1; thread < threads; thread++)
+	{
+		workers.emplace_back(function, count * thread / threads, count * (thread + 1) / threads, thread);
+	}
+	function(size_t(0), count / threads, 0u);
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
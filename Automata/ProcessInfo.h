@@ -0,0 +1,8 @@
+﻿#pragma once
+#include <cstddef>
+
+// peak resident set size of the process in bytes, 0 when the platform does not report it
+size_t PeakResidentBytes();
+
+// user + system time of all threads of the process
+double CpuSeconds();
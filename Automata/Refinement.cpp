@@ -0,0 +1,814 @@
+﻿#include "Refinement.h"
+#include "Cancellation.h"
+#include "Parallel.h"
+#include "Stats.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+// inputs smaller than this are grouped with one std::sort instead of the radix sort
+const size_t RADIX_SORT_MIN_SIZE = 1 << 16;
+const unsigned RADIX_BITS = 16;
+const size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+// scratch of machines with more transitions than this is freed after the call
+const size_t SCRATCH_KEEP_TRANSITIONS = 1 << 20;
+// the Hopcroft engine looks for cancellation after this many splitters
+const uint64_t CANCEL_CHECK_SPLITTERS = 1 << 10;
+
+uint64_t Mix(uint64_t value)
+{
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111eb;
+	value ^= value >> 31;
+	return value;
+}
+
+struct RowHash
+{
+	size_t operator()(const std::vector<uint32_t>& row) const
+	{
+		uint64_t seed = row.size();
+		for (uint32_t value : row)
+		{
+			seed = Mix(seed + value + 0x9e3779b97f4a7c15);
+		}
+		return static_cast<size_t>(seed);
+	}
+};
+
+struct SignatureHash
+{
+	size_t operator()(const std::pair<std::vector<uint32_t>, uint32_t>& signature) const
+	{
+		return static_cast<size_t>(Mix(RowHash{}(signature.first) + signature.second));
+	}
+};
+
+// working memory of the Hopcroft engine, kept by every thread between calls so that
+// a batch of small machines does not allocate it again for every machine
+struct HopcroftScratch
+{
+	std::vector<size_t> inverseStart;
+	std::vector<uint32_t> inverseStates;
+	std::vector<size_t> fill;
+	std::vector<uint32_t> elements;
+	std::vector<uint32_t> location;
+	std::vector<uint32_t> blockOf;
+	std::vector<uint32_t> first;
+	std::vector<uint32_t> end;
+	std::vector<uint32_t> position;
+	std::vector<uint32_t> mid;
+	std::vector<std::pair<uint32_t, uint32_t>> worklist;
+	std::vector<bool> inWorklist;
+	std::vector<uint32_t> splitter;
+	std::vector<uint32_t> touched;
+};
+
+struct NumberingScratch
+{
+	std::vector<uint32_t> representative;
+	std::vector<uint32_t> number;
+	std::vector<uint32_t> queue;
+};
+
+template <typename Scratch>
+void ReleaseLargeScratch(Scratch& scratch, size_t transitionCount)
+{
+	if (transitionCount > SCRATCH_KEEP_TRANSITIONS)
+	{
+		scratch = Scratch();
+	}
+}
+
+// stable LSD radix sort of keys with their states, 16 bits per pass; passes where all keys
+// share the digit are skipped. Every thread counts and scatters its own contiguous chunk,
+// so the order does not depend on the number of threads.
+void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& states, unsigned threads)
+{
+	size_t count = keys.size();
+	std::vector<uint64_t> keyBuffer(count);
+	std::vector<uint32_t> stateBuffer(count);
+	std::vector<std::vector<size_t>> histograms(threads, std::vector<size_t>(RADIX_BUCKETS));
+
+	for (unsigned shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned thread) {
+			auto& histogram = histograms[thread];
+			std::fill(histogram.begin(), histogram.end(), 0);
+			for (size_t i = begin; i < end; i++)
+			{
+				histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			}
+		});
+
+		// bucket-major, thread-minor offsets keep the sort stable
+		size_t offset = 0;
+		bool single = false;
+		for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+		{
+			size_t bucketSize = 0;
+			for (auto& histogram : histograms)
+			{
+				size_t size = histogram[bucket];
+				histogram[bucket] = offset + bucketSize;
+				bucketSize += size;
+			}
+			single = single || bucketSize == count;
+			offset += bucketSize;
+		}
+		if (single)
+		{
+			continue;
+		}
+
+		ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned thread) {
+			auto& positions = histograms[thread];
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t position = positions[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				keyBuffer[position] = keys[i];
+				stateBuffer[position] = states[i];
+			}
+		});
+		keys.swap(keyBuffer);
+		states.swap(stateBuffer);
+	}
+}
+
+// sets of the elements 0..n-1 as ranges [first, end) of elements for Valmari and Lehtinen's engine; marked
+// elements are moved to [first, mid) and the smaller part of a split set gets the next set number, so the
+// sets still to be used as splitters are always the ones past a cursor
+class RefinablePartition
+{
+public:
+	// element e starts in set sets[e] of 0..setCount-1, empty sets are allowed
+	RefinablePartition(const std::vector<uint32_t>& sets, uint32_t setCount)
+		: m_elements(sets.size())
+		, m_location(sets.size())
+		, m_setOf(sets)
+		, m_first(size_t(setCount) + 1, 0)
+	{
+		for (uint32_t set : sets)
+		{
+			m_first[set + 1]++;
+		}
+		for (uint32_t set = 1; set <= setCount; set++)
+		{
+			m_first[set] += m_first[set - 1];
+		}
+		m_end.assign(m_first.begin() + 1, m_first.end());
+		m_first.pop_back();
+		m_mid = m_first;
+		for (uint32_t element = 0; element < sets.size(); element++)
+		{
+			m_location[element] = m_mid[sets[element]]++;
+			m_elements[m_location[element]] = element;
+		}
+		m_mid = m_first;
+	}
+
+	uint32_t Count() const
+	{
+		return static_cast<uint32_t>(m_first.size());
+	}
+
+	uint32_t First(uint32_t set) const
+	{
+		return m_first[set];
+	}
+
+	uint32_t End(uint32_t set) const
+	{
+		return m_end[set];
+	}
+
+	uint32_t Element(uint32_t location) const
+	{
+		return m_elements[location];
+	}
+
+	const std::vector<uint32_t>& Sets() const
+	{
+		return m_setOf;
+	}
+
+	void Mark(uint32_t element)
+	{
+		uint32_t set = m_setOf[element];
+		uint32_t location = m_location[element];
+		uint32_t mid = m_mid[set];
+		if (location < mid)
+		{
+			return;
+		}
+		if (mid == m_first[set])
+		{
+			m_touched.push_back(set);
+		}
+		uint32_t other = m_elements[mid];
+		m_elements[location] = other;
+		m_location[other] = location;
+		m_elements[mid] = element;
+		m_location[element] = mid;
+		m_mid[set]++;
+	}
+
+	// splits every set with marked and unmarked elements and unmarks all
+	void Split()
+	{
+		for (uint32_t set : m_touched)
+		{
+			uint32_t mid = m_mid[set];
+			m_mid[set] = m_first[set];
+			if (mid == m_end[set])
+			{
+				continue;
+			}
+			uint32_t newSet = Count();
+			if (mid - m_first[set] <= m_end[set] - mid)
+			{
+				m_first.push_back(m_first[set]);
+				m_end.push_back(mid);
+				m_first[set] = mid;
+			}
+			else
+			{
+				m_first.push_back(mid);
+				m_end.push_back(m_end[set]);
+				m_end[set] = mid;
+			}
+			m_mid[set] = m_first[set];
+			m_mid.push_back(m_first[newSet]);
+			for (uint32_t i = m_first[newSet]; i < m_end[newSet]; i++)
+			{
+				m_setOf[m_elements[i]] = newSet;
+			}
+		}
+		m_touched.clear();
+	}
+
+private:
+	std::vector<uint32_t> m_elements;
+	std::vector<uint32_t> m_location;
+	std::vector<uint32_t> m_setOf;
+	std::vector<uint32_t> m_first;
+	std::vector<uint32_t> m_end;
+	std::vector<uint32_t> m_mid;
+	std::vector<uint32_t> m_touched;
+};
+}
+
+std::vector<uint32_t> NumberClassesFromStart(const std::vector<uint32_t>& transitions, uint32_t entryCount,
+	const std::vector<uint32_t>& classes, uint32_t classCount)
+{
+	thread_local NumberingScratch scratch;
+	auto& representative = scratch.representative;
+	representative.assign(classCount, NO_ID);
+	for (uint32_t state = 0; state < classes.size(); state++)
+	{
+		if (representative[classes[state]] == NO_ID)
+		{
+			representative[classes[state]] = state;
+		}
+	}
+
+	// the queue holds one representative per class, so it never grows past classCount
+	auto& number = scratch.number;
+	auto& queue = scratch.queue;
+	number.assign(classCount, NO_ID);
+	queue.clear();
+	uint32_t count = 0;
+	number[classes[0]] = count++;
+	queue.push_back(0);
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		uint32_t state = queue[head];
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t targetClass = classes[transitions[size_t(state) * entryCount + entry]];
+			if (number[targetClass] == NO_ID)
+			{
+				number[targetClass] = count++;
+				queue.push_back(representative[targetClass]);
+			}
+		}
+	}
+
+	std::vector<uint32_t> numbered(classes.size());
+	for (size_t state = 0; state < classes.size(); state++)
+	{
+		numbered[state] = number[classes[state]];
+	}
+	ReleaseLargeScratch(scratch, classes.size() * std::max<size_t>(entryCount, 1));
+	return numbered;
+}
+
+std::vector<uint32_t> RefineReference(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount)
+{
+	std::vector<uint32_t> classes(initialClasses);
+	size_t prevSize = classCount;
+	while (true)
+	{
+		CheckCancelled();
+		// key - {classes of the targets, number of group}, value - number of the new group
+		std::unordered_map<std::pair<std::vector<uint32_t>, uint32_t>, uint32_t, SignatureHash> newMapOfGroups;
+		std::vector<uint32_t> newClasses(stateCount);
+		for (uint32_t state = 0; state < stateCount; state++)
+		{
+			std::vector<uint32_t> transitsForOneState(entryCount);
+			for (uint32_t entry = 0; entry < entryCount; entry++)
+			{
+				transitsForOneState[entry] = classes[transitions[size_t(state) * entryCount + entry]];
+			}
+			uint32_t newNumber = static_cast<uint32_t>(newMapOfGroups.size());
+			newClasses[state] = newMapOfGroups.emplace(std::make_pair(std::move(transitsForOneState), classes[state]), newNumber).first->second;
+		}
+
+		size_t currSize = newMapOfGroups.size();
+		classes = std::move(newClasses);
+		AddRefinementRound(static_cast<uint32_t>(currSize));
+		if (currSize == prevSize || currSize == stateCount)
+		{
+			return NumberClassesFromStart(transitions, entryCount, classes, static_cast<uint32_t>(currSize));
+		}
+		prevSize = currSize;
+	}
+}
+
+std::vector<uint32_t> RefineHopcroft(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount)
+{
+	// inverse transitions: predecessors of target t by entry e are
+	// inverseStates[inverseStart[e * (stateCount + 1) + t] .. inverseStart[e * (stateCount + 1) + t + 1])
+	thread_local HopcroftScratch scratch;
+	size_t rowSize = size_t(stateCount) + 1;
+	auto& inverseStart = scratch.inverseStart;
+	auto& inverseStates = scratch.inverseStates;
+	inverseStart.assign(entryCount * rowSize + 1, 0);
+	inverseStates.resize(transitions.size());
+	for (uint32_t s = 0; s < stateCount; s++)
+	{
+		for (uint32_t e = 0; e < entryCount; e++)
+		{
+			inverseStart[e * rowSize + transitions[size_t(s) * entryCount + e] + 1]++;
+		}
+	}
+	for (size_t i = 1; i < inverseStart.size(); i++)
+	{
+		inverseStart[i] += inverseStart[i - 1];
+	}
+	auto& fill = scratch.fill;
+	fill.assign(inverseStart.begin(), inverseStart.end() - 1);
+	for (uint32_t s = 0; s < stateCount; s++)
+	{
+		for (uint32_t e = 0; e < entryCount; e++)
+		{
+			inverseStates[fill[e * rowSize + transitions[size_t(s) * entryCount + e]]++] = s;
+		}
+	}
+
+	// blocks are ranges [first, end) of elements, marked states are moved to [first, mid)
+	auto& elements = scratch.elements;
+	auto& location = scratch.location;
+	auto& blockOf = scratch.blockOf;
+	auto& first = scratch.first;
+	elements.resize(stateCount);
+	location.resize(stateCount);
+	blockOf.assign(initialClasses.begin(), initialClasses.end());
+	first.assign(size_t(classCount) + 1, 0);
+	for (uint32_t s = 0; s < stateCount; s++)
+	{
+		first[initialClasses[s] + 1]++;
+	}
+	for (uint32_t b = 1; b <= classCount; b++)
+	{
+		first[b] += first[b - 1];
+	}
+	auto& end = scratch.end;
+	auto& position = scratch.position;
+	end.assign(first.begin() + 1, first.end());
+	first.pop_back();
+	position.assign(first.begin(), first.end());
+	for (uint32_t s = 0; s < stateCount; s++)
+	{
+		location[s] = position[initialClasses[s]]++;
+		elements[location[s]] = s;
+	}
+	auto& mid = scratch.mid;
+	mid.assign(first.begin(), first.end());
+
+	// worklist of splitters (block, entry); with a complete transition function
+	// every block but the largest one has to be used as a splitter
+	auto& worklist = scratch.worklist;
+	auto& inWorklist = scratch.inWorklist;
+	worklist.clear();
+	inWorklist.assign(size_t(stateCount) * entryCount, false);
+	uint32_t largest = 0;
+	for (uint32_t b = 1; b < classCount; b++)
+	{
+		if (end[b] - first[b] > end[largest] - first[largest])
+		{
+			largest = b;
+		}
+	}
+	for (uint32_t b = 0; b < classCount; b++)
+	{
+		for (uint32_t e = 0; e < entryCount && b != largest; e++)
+		{
+			worklist.push_back({ b, e });
+			inWorklist[size_t(b) * entryCount + e] = true;
+		}
+	}
+
+	auto& splitter = scratch.splitter;
+	auto& touched = scratch.touched;
+	touched.clear();
+	uint64_t splitterCount = 0;
+	while (!worklist.empty())
+	{
+		auto [splitterBlock, entry] = worklist.back();
+		worklist.pop_back();
+		if (++splitterCount % CANCEL_CHECK_SPLITTERS == 0)
+		{
+			CheckCancelled();
+		}
+		inWorklist[size_t(splitterBlock) * entryCount + entry] = false;
+
+		// marking predecessors of the splitter
+		splitter.assign(elements.begin() + first[splitterBlock], elements.begin() + end[splitterBlock]);
+		for (uint32_t target : splitter)
+		{
+			size_t offset = entry * rowSize + target;
+			for (size_t i = inverseStart[offset]; i < inverseStart[offset + 1]; i++)
+			{
+				uint32_t state = inverseStates[i];
+				uint32_t block = blockOf[state];
+				if (location[state] < mid[block])
+				{
+					continue;
+				}
+				if (mid[block] == first[block])
+				{
+					touched.push_back(block);
+				}
+				uint32_t other = elements[mid[block]];
+				std::swap(elements[location[state]], elements[mid[block]]);
+				location[other] = location[state];
+				location[state] = mid[block]++;
+			}
+		}
+
+		// splitting touched blocks, the smaller half gets the new block number
+		for (uint32_t block : touched)
+		{
+			if (mid[block] == end[block])
+			{
+				mid[block] = first[block];
+				continue;
+			}
+			uint32_t newBlock = static_cast<uint32_t>(first.size());
+			if (mid[block] - first[block] <= end[block] - mid[block])
+			{
+				first.push_back(first[block]);
+				end.push_back(mid[block]);
+				first[block] = mid[block];
+			}
+			else
+			{
+				first.push_back(mid[block]);
+				end.push_back(end[block]);
+				end[block] = mid[block];
+			}
+			mid[block] = first[block];
+			mid.push_back(first[newBlock]);
+			for (uint32_t i = first[newBlock]; i < end[newBlock]; i++)
+			{
+				blockOf[elements[i]] = newBlock;
+			}
+
+			for (uint32_t e = 0; e < entryCount; e++)
+			{
+				if (inWorklist[size_t(block) * entryCount + e])
+				{
+					worklist.push_back({ newBlock, e });
+					inWorklist[size_t(newBlock) * entryCount + e] = true;
+				}
+				else
+				{
+					uint32_t smaller = (end[block] - first[block] < end[newBlock] - first[newBlock]) ? block : newBlock;
+					worklist.push_back({ smaller, e });
+					inWorklist[size_t(smaller) * entryCount + e] = true;
+				}
+			}
+		}
+		touched.clear();
+	}
+
+	if (Stats* stats = CurrentStats())
+	{
+		stats->splitterCount += splitterCount;
+	}
+	AddRefinementRound(static_cast<uint32_t>(first.size()));
+	std::vector<uint32_t> classes = NumberClassesFromStart(transitions, entryCount, blockOf, static_cast<uint32_t>(first.size()));
+	ReleaseLargeScratch(scratch, transitions.size());
+	return classes;
+}
+
+std::vector<uint32_t> RefineSignatures(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount, unsigned threads)
+{
+	threads = ThreadCount(threads);
+	std::vector<uint32_t> classes(initialClasses);
+	std::vector<uint32_t> newClasses(stateCount);
+	std::vector<uint64_t> keys(stateCount);
+	std::vector<uint32_t> order(stateCount);
+	std::vector<uint32_t> runStarts;
+	std::vector<uint32_t> groupCounts(threads);
+
+	auto sameSignature = [&](uint32_t a, uint32_t b) {
+		if (classes[a] != classes[b])
+		{
+			return false;
+		}
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			if (classes[transitions[size_t(a) * entryCount + entry]] != classes[transitions[size_t(b) * entryCount + entry]])
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	auto lessSignature = [&](uint32_t a, uint32_t b) {
+		if (classes[a] != classes[b])
+		{
+			return classes[a] < classes[b];
+		}
+		for (uint32_t entry = 0; entry < entryCount; entry++)
+		{
+			uint32_t classA = classes[transitions[size_t(a) * entryCount + entry]];
+			uint32_t classB = classes[transitions[size_t(b) * entryCount + entry]];
+			if (classA != classB)
+			{
+				return classA < classB;
+			}
+		}
+		return a < b;
+	};
+
+	while (true)
+	{
+		CheckCancelled();
+		// hashing the signatures
+		ParallelFor(stateCount, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t state = begin; state < end; state++)
+			{
+				uint64_t hash = Mix(classes[state] + 0x9e3779b97f4a7c15);
+				for (uint32_t entry = 0; entry < entryCount; entry++)
+				{
+					hash = Mix(hash + classes[transitions[state * entryCount + entry]]);
+				}
+				keys[state] = hash;
+				order[state] = static_cast<uint32_t>(state);
+			}
+		});
+
+		if (stateCount < RADIX_SORT_MIN_SIZE)
+		{
+			std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+				return keys[a] != keys[b] ? keys[a] < keys[b] : a < b;
+			});
+			std::vector<uint64_t> sortedKeys(stateCount);
+			for (uint32_t i = 0; i < stateCount; i++)
+			{
+				sortedKeys[i] = keys[order[i]];
+			}
+			keys.swap(sortedKeys);
+		}
+		else
+		{
+			RadixSort(keys, order, threads);
+		}
+
+		// runs of equal hashes; a run where a collision mixed different signatures is sorted by
+		// the signatures themselves. Chunks start at run boundaries, groups are counted per chunk.
+		runStarts.assign(threads + 1, stateCount);
+		for (unsigned thread = 0; thread < threads; thread++)
+		{
+			size_t start = size_t(stateCount) * thread / threads;
+			while (start > 0 && start < stateCount && keys[start] == keys[start - 1])
+			{
+				start++;
+			}
+			runStarts[thread] = static_cast<uint32_t>(start);
+		}
+		for (unsigned thread = threads; thread-- > 1;)
+		{
+			runStarts[thread - 1] = std::min(runStarts[thread - 1], runStarts[thread]);
+		}
+
+		ParallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t thread = begin; thread < end; thread++)
+			{
+				uint32_t groups = 0;
+				for (uint32_t runStart = runStarts[thread]; runStart < runStarts[thread + 1];)
+				{
+					uint32_t runEnd = runStart + 1;
+					bool collision = false;
+					while (runEnd < runStarts[thread + 1] && keys[runEnd] == keys[runStart])
+					{
+						collision = collision || !sameSignature(order[runStart], order[runEnd]);
+						runEnd++;
+					}
+					if (collision)
+					{
+						std::sort(order.begin() + runStart, order.begin() + runEnd, lessSignature);
+					}
+					for (uint32_t i = runStart; i < runEnd; i++)
+					{
+						if (collision && i != runStart && !sameSignature(order[i - 1], order[i]))
+						{
+							groups++;
+						}
+						newClasses[order[i]] = groups;
+					}
+					groups++;
+					runStart = runEnd;
+				}
+				groupCounts[thread] = groups;
+			}
+		});
+
+		uint32_t groupCount = 0;
+		for (unsigned thread = 0; thread < threads; thread++)
+		{
+			uint32_t offset = groupCount;
+			groupCount += groupCounts[thread];
+			groupCounts[thread] = offset;
+		}
+		ParallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t thread = begin; thread < end; thread++)
+			{
+				for (uint32_t i = runStarts[thread]; i < runStarts[thread + 1]; i++)
+				{
+					newClasses[order[i]] += groupCounts[thread];
+				}
+			}
+		});
+
+		classes.swap(newClasses);
+		AddRefinementRound(groupCount);
+		if (groupCount == classCount || groupCount == stateCount)
+		{
+			return NumberClassesFromStart(transitions, entryCount, classes, groupCount);
+		}
+		classCount = groupCount;
+	}
+}
+
+std::vector<uint32_t> RefinePartial(const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& targets,
+	const std::vector<uint32_t>& labels, uint32_t labelCount, const std::vector<uint32_t>& initialClasses,
+	uint32_t classCount)
+{
+	uint32_t stateCount = static_cast<uint32_t>(initialClasses.size());
+	if (stateCount == 0)
+	{
+		return {};
+	}
+
+	// the tail of every transition and the transitions into every state:
+	// incoming[incomingStart[s] .. incomingStart[s + 1]) end in state s
+	std::vector<uint32_t> tails(targets.size());
+	std::vector<uint32_t> incomingStart(size_t(stateCount) + 1, 0);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		for (uint32_t t = offsets[state]; t < offsets[state + 1]; t++)
+		{
+			tails[t] = state;
+			incomingStart[targets[t] + 1]++;
+		}
+	}
+	for (uint32_t state = 1; state <= stateCount; state++)
+	{
+		incomingStart[state] += incomingStart[state - 1];
+	}
+	std::vector<uint32_t> incoming(targets.size());
+	std::vector<uint32_t> fill(incomingStart.begin(), incomingStart.end() - 1);
+	for (uint32_t t = 0; t < targets.size(); t++)
+	{
+		incoming[fill[targets[t]]++] = t;
+	}
+	fill = std::vector<uint32_t>();
+
+	// blocks of states and cords of transitions split each other: a cord splits the blocks by the tails of its
+	// transitions, a block splits the cords by the transitions into it. Every cord is used, so one of the
+	// starting blocks can be left out as with a complete transition function
+	RefinablePartition blocks(initialClasses, classCount);
+	RefinablePartition cords(labels, labelCount);
+	uint64_t splitterCount = 0;
+	uint32_t block = 1;
+	for (uint32_t cord = 0; cord < cords.Count(); cord++)
+	{
+		if (++splitterCount % CANCEL_CHECK_SPLITTERS == 0)
+		{
+			CheckCancelled();
+		}
+		for (uint32_t i = cords.First(cord); i < cords.End(cord); i++)
+		{
+			blocks.Mark(tails[cords.Element(i)]);
+		}
+		blocks.Split();
+		for (; block < blocks.Count(); block++)
+		{
+			if (++splitterCount % CANCEL_CHECK_SPLITTERS == 0)
+			{
+				CheckCancelled();
+			}
+			for (uint32_t i = blocks.First(block); i < blocks.End(block); i++)
+			{
+				uint32_t state = blocks.Element(i);
+				for (uint32_t j = incomingStart[state]; j < incomingStart[state + 1]; j++)
+				{
+					cords.Mark(incoming[j]);
+				}
+			}
+			cords.Split();
+		}
+	}
+	if (Stats* stats = CurrentStats())
+	{
+		stats->splitterCount += splitterCount;
+	}
+	AddRefinementRound(blocks.Count());
+
+	// the classes numbered by a BFS over the transitions of one state per class in their order
+	const std::vector<uint32_t>& found = blocks.Sets();
+	std::vector<uint32_t> representative(blocks.Count(), NO_ID);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		if (representative[found[state]] == NO_ID)
+		{
+			representative[found[state]] = state;
+		}
+	}
+	std::vector<uint32_t> number(blocks.Count(), NO_ID);
+	std::vector<uint32_t> queue{ 0 };
+	uint32_t count = 0;
+	number[found[0]] = count++;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		uint32_t state = queue[head];
+		for (uint32_t t = offsets[state]; t < offsets[state + 1]; t++)
+		{
+			uint32_t targetClass = found[targets[t]];
+			if (number[targetClass] == NO_ID)
+			{
+				number[targetClass] = count++;
+				queue.push_back(representative[targetClass]);
+			}
+		}
+	}
+	std::vector<uint32_t> classes(stateCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		classes[state] = number[found[state]];
+	}
+	return classes;
+}
+
+uint32_t GroupByOutputs(const Mealy& mealy, std::vector<uint32_t>& classes)
+{
+	uint32_t stateCount = StateCount(mealy);
+	uint32_t entryCount = EntryCount(mealy);
+	std::unordered_map<std::vector<uint32_t>, uint32_t, RowHash> groups;
+	classes.resize(stateCount);
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		auto row = mealy.outs.begin() + size_t(state) * entryCount;
+		uint32_t number = static_cast<uint32_t>(groups.size());
+		classes[state] = groups.emplace(std::vector<uint32_t>(row, row + entryCount), number).first->second;
+	}
+	return static_cast<uint32_t>(groups.size());
+}
+
+uint32_t GroupByOutputs(const Moore& moore, std::vector<uint32_t>& classes)
+{
+	uint32_t stateCount = StateCount(moore);
+	std::vector<uint32_t> groups(SymbolCount(moore.outputs), NO_ID);
+	classes.resize(stateCount);
+	uint32_t groupCount = 0;
+	for (uint32_t state = 0; state < stateCount; state++)
+	{
+		uint32_t& group = groups[moore.outs[state]];
+		if (group == NO_ID)
+		{
+			group = groupCount++;
+		}
+		classes[state] = group;
+	}
+	return groupCount;
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <vector>
+
+// All engines take the transition table of a machine whose states are all reachable from state 0
+// and the starting partition initialClasses[state] in 0..classCount-1. They return the class of every
+// state, numbered in BFS order from state 0, so the same partition always gets the same numbers.
+
+// Hopcroft's splitter worklist with inverse transition lists, O(k * n * log n)
+std::vector<uint32_t> RefineHopcroft(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount);
+
+// Moore rounds: every round groups states by the signature {class, classes of the targets};
+// signatures are hashed in parallel chunks and grouped with a parallel radix sort (0 threads - all hardware threads)
+std::vector<uint32_t> RefineSignatures(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount, unsigned threads = 0);
+
+// the original round-based refinement through a hash map of signatures, kept as a reference
+std::vector<uint32_t> RefineReference(const std::vector<uint32_t>& transitions, uint32_t stateCount, uint32_t entryCount,
+	const std::vector<uint32_t>& initialClasses, uint32_t classCount);
+
+// Valmari and Lehtinen's refinement of a partial transition function, O(m * log n) in the m defined transitions:
+// the transitions of state s are [offsets[s], offsets[s + 1]), transition t goes to targets[t] under
+// labels[t] in 0..labelCount-1 and a state without a label differs from every state with it. The classes are
+// numbered in BFS order over the transitions of each state as they are listed
+std::vector<uint32_t> RefinePartial(const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& targets,
+	const std::vector<uint32_t>& labels, uint32_t labelCount, const std::vector<uint32_t>& initialClasses,
+	uint32_t classCount);
+
+std::vector<uint32_t> NumberClassesFromStart(const std::vector<uint32_t>& transitions, uint32_t entryCount,
+	const std::vector<uint32_t>& classes, uint32_t classCount);
+
+// starting partitions: states with equal output rows (Mealy) or equal output signals (Moore);
+// return the number of classes
+uint32_t GroupByOutputs(const Mealy& mealy, std::vector<uint32_t>& classes);
+uint32_t GroupByOutputs(const Moore& moore, std::vector<uint32_t>& classes);
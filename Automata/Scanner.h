@@ -0,0 +1,99 @@
+﻿#pragma once
+#include <bit>
+#include <cstring>
+#include <string_view>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+// First position in [begin, end) holding one of the characters a, b, c, or end.
+// Compares 32 (AVX2) or 16 (SSE2) bytes at a time, the tail is scanned byte by byte.
+inline const char* FindAny(const char* begin, const char* end, char a, char b, char c)
+{
+	const char* p = begin;
+#if defined(__AVX2__)
+	const __m256i va = _mm256_set1_epi8(a);
+	const __m256i vb = _mm256_set1_epi8(b);
+	const __m256i vc = _mm256_set1_epi8(c);
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)),
+			_mm256_cmpeq_epi8(chunk, vc));
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(found));
+		if (mask != 0)
+		{
+			return p + std::countr_zero(mask);
+		}
+	}
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	const __m128i sa = _mm_set1_epi8(a);
+	const __m128i sb = _mm_set1_epi8(b);
+	const __m128i sc = _mm_set1_epi8(c);
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, sa), _mm_cmpeq_epi8(chunk, sb)),
+			_mm_cmpeq_epi8(chunk, sc));
+		unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(found));
+		if (mask != 0)
+		{
+			return p + std::countr_zero(mask);
+		}
+	}
+#endif
+	for (; p != end; p++)
+	{
+		if (*p == a || *p == b || *p == c)
+		{
+			return p;
+		}
+	}
+	return end;
+}
+
+inline const char* FindAny(const char* begin, const char* end, char a, char b)
+{
+	return FindAny(begin, end, a, b, b);
+}
+
+inline const char* FindChar(const char* begin, const char* end, char a)
+{
+	return FindAny(begin, end, a, a, a);
+}
+
+// cuts the next line off the text, without the line break; returns false at the end of the text
+inline bool NextLine(std::string_view& text, std::string_view& line)
+{
+	if (text.empty())
+	{
+		return false;
+	}
+	const char* begin = text.data();
+	const char* end = begin + text.size();
+	const char* lineEnd = FindChar(begin, end, '\n');
+	line = std::string_view(begin, lineEnd - begin);
+	text.remove_prefix(line.size() + (lineEnd != end ? 1 : 0));
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.remove_suffix(1);
+	}
+	return true;
+}
+
+// cuts the next cell off the line like std::getline with ';' does: a cell is produced for every
+// delimiter and for a non-empty rest of the line
+inline bool NextCell(std::string_view& line, std::string_view& cell)
+{
+	if (line.empty())
+	{
+		return false;
+	}
+	const char* begin = line.data();
+	const char* end = begin + line.size();
+	const char* cellEnd = FindChar(begin, end, ';');
+	cell = std::string_view(begin, cellEnd - begin);
+	line.remove_prefix(cell.size() + (cellEnd != end ? 1 : 0));
+	return true;
+}
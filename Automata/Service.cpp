@@ -0,0 +1,410 @@
+﻿#include "Service.h"
+#include "BinaryFormat.h"
+#include "Cancellation.h"
+#include "Socket.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+namespace
+{
+const std::string CANCEL_COMMAND = "cancel";
+const std::string SHUTDOWN_COMMAND = "shutdown";
+const std::string INPUT_KEY = "input";
+const std::string INLINE_KEY = "inline";
+const std::string OUTPUT_KEY = "output";
+const std::string TIMEOUT_KEY = "timeout";
+// the accept loop looks for a shutdown this often
+const int ACCEPT_POLL_MS = 200;
+// results are streamed in frames of up to this many bytes
+const size_t FRAME_BYTES = 1 << 20;
+
+std::string OneLine(std::string text)
+{
+	std::replace(text.begin(), text.end(), '\n', ' ');
+	std::replace(text.begin(), text.end(), '\r', ' ');
+	return text;
+}
+
+class Connection
+{
+public:
+	explicit Connection(Socket socket)
+		: m_socket(std::move(socket))
+	{
+	}
+
+	const Socket& GetSocket() const
+	{
+		return m_socket;
+	}
+
+	// a message is sent whole under the lock, so that frames of parallel requests do not mix;
+	// once the client is gone every request of the connection is cancelled
+	bool Send(std::string_view head, std::string_view body = {})
+	{
+		bool sent;
+		{
+			std::lock_guard lock(m_sendMutex);
+			sent = !m_broken && m_socket.SendAll(head) && m_socket.SendAll(body);
+			m_broken = !sent;
+		}
+		if (!sent)
+		{
+			CancelAll();
+		}
+		return sent;
+	}
+
+	// false when a request with this id is still running
+	bool Start(const std::string& id, const std::shared_ptr<CancelToken>& token)
+	{
+		std::lock_guard lock(m_mutex);
+		return m_running.emplace(id, token).second;
+	}
+
+	void Finish(const std::string& id)
+	{
+		std::lock_guard lock(m_mutex);
+		m_running.erase(id);
+	}
+
+	bool Cancel(const std::string& id)
+	{
+		std::lock_guard lock(m_mutex);
+		auto it = m_running.find(id);
+		if (it == m_running.end())
+		{
+			return false;
+		}
+		it->second->Cancel();
+		return true;
+	}
+
+	void CancelAll()
+	{
+		std::lock_guard lock(m_mutex);
+		for (auto& [id, token] : m_running)
+		{
+			token->Cancel();
+		}
+	}
+
+private:
+	Socket m_socket;
+	std::mutex m_sendMutex;
+	bool m_broken = false;
+	std::mutex m_mutex;
+	std::map<std::string, std::shared_ptr<CancelToken>> m_running;
+};
+
+// stream buffer that sends everything written to it as "<id> data <bytes>" frames
+class FrameBuffer : public std::streambuf
+{
+public:
+	FrameBuffer(Connection& connection, const std::string& id)
+		: m_connection(connection)
+		, m_id(id)
+	{
+	}
+
+protected:
+	int_type overflow(int_type ch) override
+	{
+		if (traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			return traits_type::not_eof(ch);
+		}
+		m_pending.push_back(traits_type::to_char_type(ch));
+		if (m_pending.size() >= FRAME_BYTES && !SendPending())
+		{
+			return traits_type::eof();
+		}
+		return ch;
+	}
+
+	std::streamsize xsputn(const char* data, std::streamsize size) override
+	{
+		m_pending.append(data, static_cast<size_t>(size));
+		if (m_pending.size() >= FRAME_BYTES && !SendPending())
+		{
+			return 0;
+		}
+		return size;
+	}
+
+	int sync() override
+	{
+		return SendPending() ? 0 : -1;
+	}
+
+private:
+	bool SendPending()
+	{
+		if (m_pending.empty())
+		{
+			return true;
+		}
+		bool sent = m_connection.Send(m_id + " data " + std::to_string(m_pending.size()) + "\n", m_pending);
+		m_pending.clear();
+		return sent;
+	}
+
+	Connection& m_connection;
+	std::string m_id;
+	std::string m_pending;
+};
+
+class Server
+{
+public:
+	Server(unsigned threads, const ServiceHandler& handler)
+		: m_pool(threads)
+		, m_handler(handler)
+	{
+	}
+
+	void Run(const Socket& listener)
+	{
+		while (!m_stopping)
+		{
+			Socket socket = AcceptUnix(listener, ACCEPT_POLL_MS);
+			if (!socket.IsOpen())
+			{
+				continue;
+			}
+			auto connection = std::make_shared<Connection>(std::move(socket));
+			{
+				std::lock_guard lock(m_mutex);
+				std::erase_if(m_connections, [](const auto& weak) { return weak.expired(); });
+				m_connections.push_back(connection);
+				m_readers++;
+			}
+			std::thread([this, connection] {
+				Read(connection);
+				std::lock_guard lock(m_mutex);
+				m_readers--;
+				m_readersDone.notify_all();
+			}).detach();
+		}
+
+		// no more requests: wake the readers, then wait for the requests they have started
+		std::unique_lock lock(m_mutex);
+		for (auto& weak : m_connections)
+		{
+			if (auto connection = weak.lock())
+			{
+				connection->GetSocket().ShutdownRead();
+			}
+		}
+		m_readersDone.wait(lock, [this] { return m_readers == 0; });
+		lock.unlock();
+		m_pool.Wait();
+	}
+
+private:
+	void Read(const std::shared_ptr<Connection>& connection)
+	{
+		SocketReader reader(connection->GetSocket());
+		std::string line;
+		while (!m_stopping && reader.ReadLine(line))
+		{
+			std::istringstream fields(line);
+			ServiceRequest request;
+			if (!(fields >> request.id))
+			{
+				continue;
+			}
+			if (!(fields >> request.command))
+			{
+				connection->Send(request.id + " error Missing command\n");
+				continue;
+			}
+
+			if (request.command == CANCEL_COMMAND)
+			{
+				std::string target;
+				fields >> target;
+				connection->Send(connection->Cancel(target)
+					? request.id + " ok\n"
+					: request.id + " error Unknown request " + target + "\n");
+				continue;
+			}
+			if (request.command == SHUTDOWN_COMMAND)
+			{
+				m_stopping = true;
+				connection->Send(request.id + " ok\n");
+				return;
+			}
+
+			std::string error;
+			long long timeoutMs = -1;
+			size_t inlineBytes = 0;
+			std::string field;
+			while (fields >> field)
+			{
+				size_t equals = field.find('=');
+				std::string key = field.substr(0, equals);
+				std::string value = (equals == std::string::npos) ? std::string() : field.substr(equals + 1);
+				try
+				{
+					if (equals == std::string::npos || value.empty())
+					{
+						error = "Expected key=value instead of " + field;
+					}
+					else if (key == INPUT_KEY)
+					{
+						request.inputFileName = value;
+					}
+					else if (key == OUTPUT_KEY)
+					{
+						request.outputFileName = value;
+					}
+					else if (key == INLINE_KEY)
+					{
+						inlineBytes = std::stoull(value);
+					}
+					else if (key == TIMEOUT_KEY)
+					{
+						timeoutMs = std::stoll(value);
+					}
+					else
+					{
+						request.parameters[key] = value;
+					}
+				}
+				catch (const std::exception&)
+				{
+					error = "Bad value of " + key;
+				}
+			}
+			// the inline automaton is read even for a bad request to stay in step with the client
+			if (inlineBytes != 0 && !reader.ReadBytes(inlineBytes, request.text))
+			{
+				return;
+			}
+			if (error.empty() && request.inputFileName.empty() && request.text.empty())
+			{
+				error = "No input";
+			}
+			if (!error.empty())
+			{
+				connection->Send(request.id + " error " + OneLine(error) + "\n");
+				continue;
+			}
+
+			auto token = std::make_shared<CancelToken>();
+			if (timeoutMs >= 0)
+			{
+				token->SetDeadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs));
+			}
+			if (!connection->Start(request.id, token))
+			{
+				connection->Send(request.id + " error Duplicate request id\n");
+				continue;
+			}
+			Submit(connection, std::move(request), std::move(token));
+		}
+	}
+
+	void Submit(const std::shared_ptr<Connection>& connection, ServiceRequest request, std::shared_ptr<CancelToken> token)
+	{
+		m_pool.Submit([this, connection, request = std::move(request), token = std::move(token)] {
+			CancelScope cancelScope(token.get());
+			std::string response;
+			try
+			{
+				CheckCancelled();
+				FrameBuffer frames(*connection, request.id);
+				std::ostream result(&frames);
+				m_handler(request, result);
+				if (!result.flush())
+				{
+					throw std::runtime_error("Cannot send the result");
+				}
+				response = request.id + " ok\n";
+			}
+			catch (const OperationCancelled& e)
+			{
+				response = e.TimedOut() ? request.id + " error Timeout\n" : request.id + " cancelled\n";
+			}
+			catch (const std::exception& e)
+			{
+				response = request.id + " error " + OneLine(e.what()) + "\n";
+			}
+			// finished before the answer, so that the client may reuse the id right after it
+			connection->Finish(request.id);
+			connection->Send(response);
+		});
+	}
+
+	ThreadPool m_pool;
+	const ServiceHandler& m_handler;
+	std::atomic<bool> m_stopping{ false };
+	std::mutex m_mutex;
+	std::condition_variable m_readersDone;
+	size_t m_readers = 0;
+	std::vector<std::weak_ptr<Connection>> m_connections;
+};
+
+template <typename Automaton>
+Automaton LoadRequest(const ServiceRequest& request, Automaton (*parse)(std::string_view, unsigned),
+	Automaton (*load)(const std::string&, FileFormat, unsigned), unsigned threads)
+{
+	return request.inputFileName.empty()
+		? parse(request.text, threads)
+		: load(request.inputFileName, FileFormat::Auto, threads);
+}
+}
+
+void Serve(const std::string& socketPath, unsigned threads, const ServiceHandler& handler)
+{
+#ifndef _WIN32
+	// a client that went away must not kill the service
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+	Socket listener = ListenUnix(socketPath);
+	{
+		Server server(threads, handler);
+		server.Run(listener);
+	}
+	listener.Close();
+	std::remove(socketPath.c_str());
+}
+
+Mealy LoadRequestMealy(const ServiceRequest& request, unsigned threads)
+{
+	return LoadRequest<Mealy>(request, ParseMealy, LoadMealy, threads);
+}
+
+Moore LoadRequestMoore(const ServiceRequest& request, unsigned threads)
+{
+	return LoadRequest<Moore>(request, ParseMoore, LoadMoore, threads);
+}
+
+void SendMealy(const ServiceRequest& request, const Mealy& mealy, std::ostream& result, unsigned threads)
+{
+	request.outputFileName.empty()
+		? WriteMealy(mealy, result, threads)
+		: SaveMealy(mealy, request.outputFileName, FileFormat::Auto, threads);
+}
+
+void SendMoore(const ServiceRequest& request, const Moore& moore, std::ostream& result, unsigned threads)
+{
+	request.outputFileName.empty()
+		? WriteMoore(moore, result, threads)
+		: SaveMoore(moore, request.outputFileName, FileFormat::Auto, threads);
+}
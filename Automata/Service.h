@@ -0,0 +1,39 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+
+// Line protocol of the service, every request and response starts with a request id chosen by the client:
+//   <id> <command> [input=<path>] [inline=<bytes>] [output=<path>] [timeout=<ms>] [<key>=<value> ...]
+//     runs a command of the tool; inline=<bytes> means the csv automaton follows the line as that many
+//     bytes; without output=<path> the result is streamed back
+//   <id> cancel <request id>
+//   <id> shutdown - stops the service once the running requests are answered
+// Responses come when they are ready, so several requests may be in flight on one connection:
+//   <id> data <bytes>, followed by the bytes - the next part of the result
+//   <id> ok | <id> cancelled | <id> error <message> - the request is over
+struct ServiceRequest
+{
+	std::string id;
+	std::string command;
+	std::string inputFileName; // empty when the automaton came inline
+	std::string text; // the inline automaton
+	std::string outputFileName; // empty when the result is streamed back
+	std::map<std::string, std::string> parameters; // every other key=value
+};
+
+// writes the result of the request to the stream, a thrown exception is sent back as the error
+using ServiceHandler = std::function<void(const ServiceRequest& request, std::ostream& result)>;
+
+// answers requests on a Unix domain socket until a shutdown request; the requests run on a pool
+// of warm workers (0 threads - one per hardware thread) that keep their scratch memory between requests
+void Serve(const std::string& socketPath, unsigned threads, const ServiceHandler& handler);
+
+// the inline or input=<path> automaton of the request, parsed on threads
+Mealy LoadRequestMealy(const ServiceRequest& request, unsigned threads = 0);
+Moore LoadRequestMoore(const ServiceRequest& request, unsigned threads = 0);
+// to the output file of the request or back into the stream as csv, formatted on threads either way
+void SendMealy(const ServiceRequest& request, const Mealy& mealy, std::ostream& result, unsigned threads = 0);
+void SendMoore(const ServiceRequest& request, const Moore& moore, std::ostream& result, unsigned threads = 0);
@@ -0,0 +1,506 @@
+﻿#include "Simulation.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Scanner.h"
+#include "Stats.h"
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+const uint32_t STEP = 2; // next row and output of a transition
+const unsigned MAX_LANES = 64;
+// lines of the input are run in blocks of about this many bytes
+const size_t BLOCK_BYTES = 1 << 20;
+// paths from all states are merged every this many steps
+const size_t MERGE_INTERVAL = 16;
+// a shorter chunk of a stream is not worth a thread
+const size_t MIN_CHUNK_SYMBOLS = 1 << 16;
+// outputs of a stream are formatted in pieces of this many, a piece per thread at a time
+const size_t OUTPUT_PIECE = 1 << 20;
+
+template <typename Automaton, typename OutputOf>
+CompiledMachine Compile(const Automaton& automaton, OutputOf outputOf)
+{
+	CompiledMachine machine;
+	machine.entryCount = EntryCount(automaton);
+	uint64_t transitionCount = automaton.transitions.size();
+	if (STEP * transitionCount > UINT32_MAX)
+	{
+		throw std::length_error("Too many transitions to compile");
+	}
+	machine.table.resize(STEP * transitionCount);
+	for (size_t transition = 0; transition < transitionCount; transition++)
+	{
+		machine.table[STEP * transition] = STEP * automaton.transitions[transition] * machine.entryCount;
+		machine.table[STEP * transition + 1] = outputOf(transition);
+	}
+	machine.states = automaton.states;
+	machine.entries = automaton.entries;
+	machine.outputs = automaton.outputs;
+	return machine;
+}
+
+uint32_t StateOfRow(const CompiledMachine& machine, uint32_t row)
+{
+	return machine.entryCount == 0 ? 0 : row / (STEP * machine.entryCount);
+}
+
+struct Lane
+{
+	uint32_t row = 0;
+	size_t position = 0;
+	size_t end = 0;
+	size_t stream = 0;
+};
+
+// the active lanes take steps in lockstep: the loads of one step are independent of each other
+template <bool WithOutputs>
+void Advance(const uint32_t* table, const uint32_t* entries, uint32_t* out, Lane* lane, unsigned active, size_t steps)
+{
+	for (size_t step = 0; step < steps; step++)
+	{
+		for (unsigned l = 0; l < active; l++)
+		{
+			size_t position = lane[l].position + step;
+			const uint32_t* transition = table + lane[l].row + STEP * entries[position];
+			if constexpr (WithOutputs)
+			{
+				out[position] = transition[1];
+			}
+			lane[l].row = transition[0];
+		}
+	}
+	for (unsigned l = 0; l < active; l++)
+	{
+		lane[l].position += steps;
+	}
+}
+
+// one path over entries [begin, end) from the row, returns the row it ends in
+uint32_t RunPath(const uint32_t* table, const uint32_t* entries, size_t begin, size_t end, uint32_t row, uint32_t* out)
+{
+	for (size_t position = begin; position < end; position++)
+	{
+		const uint32_t* transition = table + row + STEP * entries[position];
+		if (out)
+		{
+			out[position] = transition[1];
+		}
+		row = transition[0];
+	}
+	return row;
+}
+
+struct ChunkRun
+{
+	std::vector<uint32_t> ends; // ends[state - firstState] - the row the chunk ends in from the state
+	size_t metAt = 0; // all paths had met here, the outputs from here on are written
+};
+
+// runs entries [begin, end) from the states [firstState, firstState + stateCount) at once; the paths in
+// the same state go on as one, and once one path is left it writes the outputs
+ChunkRun RunChunk(const CompiledMachine& machine, const uint32_t* entries, size_t begin, size_t end, uint32_t firstState,
+	uint32_t stateCount, uint32_t* out)
+{
+	const uint32_t* table = machine.table.data();
+	std::vector<uint32_t> owner(stateCount); // start state -> its path
+	std::vector<uint32_t> rows(stateCount); // path -> its row
+	for (uint32_t i = 0; i < stateCount; i++)
+	{
+		owner[i] = i;
+		rows[i] = (firstState + i) * STEP * machine.entryCount;
+	}
+	std::vector<uint32_t> pathOfState(StateCount(machine), NO_ID);
+	std::vector<uint32_t> remap;
+	size_t position = begin;
+	while (rows.size() > 1 && position < end)
+	{
+		for (size_t stop = std::min(end, position + MERGE_INTERVAL); position < stop; position++)
+		{
+			uint32_t offset = STEP * entries[position];
+			for (auto& row : rows)
+			{
+				row = table[row + offset];
+			}
+		}
+		remap.resize(rows.size());
+		uint32_t count = 0;
+		for (size_t path = 0; path < rows.size(); path++)
+		{
+			uint32_t state = StateOfRow(machine, rows[path]);
+			if (pathOfState[state] == NO_ID)
+			{
+				pathOfState[state] = count;
+				rows[count++] = rows[path];
+			}
+			remap[path] = pathOfState[state];
+		}
+		for (uint32_t path = 0; path < count; path++)
+		{
+			pathOfState[StateOfRow(machine, rows[path])] = NO_ID;
+		}
+		if (count != rows.size())
+		{
+			rows.resize(count);
+			for (auto& path : owner)
+			{
+				path = remap[path];
+			}
+		}
+	}
+	ChunkRun run;
+	run.metAt = rows.size() == 1 ? position : end;
+	if (rows.size() == 1)
+	{
+		rows[0] = RunPath(table, entries, position, end, rows[0], out);
+	}
+	run.ends.resize(stateCount);
+	for (uint32_t i = 0; i < stateCount; i++)
+	{
+		run.ends[i] = rows[owner[i]];
+	}
+	return run;
+}
+
+void AppendText(std::string& buffer, std::string_view text)
+{
+	buffer.append(text.data(), text.size());
+}
+
+void Flush(std::ostream& output, std::string_view buffer)
+{
+	if (!output.write(buffer.data(), static_cast<std::streamsize>(buffer.size())))
+	{
+		throw std::runtime_error("Cannot write the output");
+	}
+	AddBytesWritten(buffer.size());
+}
+
+uint32_t FindEntry(const CompiledMachine& machine, std::string_view name)
+{
+	uint32_t entry = Find(machine.entries, name);
+	if (entry == NO_ID)
+	{
+		throw std::runtime_error("Unknown input " + std::string(name));
+	}
+	return entry;
+}
+
+bool IsSeparator(char c)
+{
+	return c == ' ' || c == '\t' || c == ';' || c == '\n' || c == '\r';
+}
+
+// the entries of all names of the text, the text is cut at separators into a piece per thread
+std::vector<uint32_t> ReadStream(const CompiledMachine& machine, std::string_view text, unsigned threads)
+{
+	threads = ThreadCount(threads);
+	std::vector<size_t> bounds(threads + 1, text.size());
+	for (unsigned piece = 0; piece < threads; piece++)
+	{
+		size_t bound = text.size() * piece / threads;
+		while (bound != 0 && bound < text.size() && !IsSeparator(text[bound - 1]))
+		{
+			bound++;
+		}
+		bounds[piece] = std::max(bound, piece == 0 ? 0 : bounds[piece - 1]);
+	}
+	std::vector<std::vector<uint32_t>> pieces(threads);
+	std::vector<std::exception_ptr> errors(threads);
+	ParallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+		for (size_t piece = begin; piece < end; piece++)
+		{
+			try
+			{
+				for (size_t position = bounds[piece]; position < bounds[piece + 1];)
+				{
+					size_t nameEnd = position;
+					while (nameEnd < bounds[piece + 1] && !IsSeparator(text[nameEnd]))
+					{
+						nameEnd++;
+					}
+					if (nameEnd != position)
+					{
+						pieces[piece].push_back(FindEntry(machine, text.substr(position, nameEnd - position)));
+					}
+					position = nameEnd + 1;
+				}
+			}
+			catch (...)
+			{
+				errors[piece] = std::current_exception();
+			}
+		}
+	});
+	std::vector<uint32_t> entries;
+	for (unsigned piece = 0; piece < threads; piece++)
+	{
+		if (errors[piece])
+		{
+			std::rethrow_exception(errors[piece]);
+		}
+		entries.insert(entries.end(), pieces[piece].begin(), pieces[piece].end());
+		pieces[piece] = {};
+	}
+	return entries;
+}
+
+// the outputs as one line of names, formatted in parallel a piece per thread at a time
+void WriteOutputs(const CompiledMachine& machine, const std::vector<uint32_t>& outputs, std::ostream& output,
+	unsigned threads)
+{
+	threads = ThreadCount(threads);
+	std::vector<std::string> buffers(threads);
+	for (size_t batch = 0; batch < outputs.size(); batch += threads * OUTPUT_PIECE)
+	{
+		ParallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t piece = begin; piece < end; piece++)
+			{
+				buffers[piece].clear();
+				size_t first = batch + piece * OUTPUT_PIECE;
+				for (size_t i = first; i < std::min(outputs.size(), first + OUTPUT_PIECE); i++)
+				{
+					if (i != 0)
+					{
+						buffers[piece].push_back(' ');
+					}
+					AppendText(buffers[piece], Name(machine.outputs, outputs[i]));
+				}
+			}
+		});
+		for (const auto& buffer : buffers)
+		{
+			Flush(output, buffer);
+		}
+	}
+	Flush(output, "\n");
+}
+
+// adds the lines of the block as streams
+void ReadStreams(const CompiledMachine& machine, std::string_view text, Streams& streams)
+{
+	std::string_view line;
+	while (NextLine(text, line))
+	{
+		const char* end = line.data() + line.size();
+		for (const char* p = line.data(); p < end;)
+		{
+			const char* nameEnd = FindAny(p, end, ' ', ';', '\t');
+			if (nameEnd != p)
+			{
+				streams.entries.push_back(FindEntry(machine, std::string_view(p, nameEnd - p)));
+			}
+			p = nameEnd + 1;
+		}
+		streams.offsets.push_back(streams.entries.size());
+	}
+}
+
+void WriteResults(const CompiledMachine& machine, const Streams& streams, const std::vector<uint32_t>& finals,
+	const std::vector<uint32_t>& outputs, bool finalStatesOnly, std::ostream& output)
+{
+	std::string buffer;
+	for (size_t stream = 0; stream < finals.size(); stream++)
+	{
+		if (finalStatesOnly)
+		{
+			AppendText(buffer, Name(machine.states, finals[stream]));
+		}
+		for (size_t i = streams.offsets[stream]; !finalStatesOnly && i < streams.offsets[stream + 1]; i++)
+		{
+			if (i != streams.offsets[stream])
+			{
+				buffer.push_back(' ');
+			}
+			AppendText(buffer, Name(machine.outputs, outputs[i]));
+		}
+		buffer.push_back('\n');
+	}
+	Flush(output, buffer);
+}
+}
+
+CompiledMachine CompileMachine(const Mealy& mealy)
+{
+	return Compile(mealy, [&mealy](size_t transition) { return mealy.outs[transition]; });
+}
+
+CompiledMachine CompileMachine(const Moore& moore)
+{
+	return Compile(moore, [&moore](size_t transition) { return moore.outs[moore.transitions[transition]]; });
+}
+
+std::vector<uint32_t> RunStreams(const CompiledMachine& machine, const Streams& streams, std::vector<uint32_t>* outputs,
+	unsigned lanes)
+{
+	size_t streamCount = streams.offsets.size() - 1;
+	std::vector<uint32_t> finals(streamCount, 0);
+	if (streamCount != 0 && StateCount(machine) == 0)
+	{
+		throw std::runtime_error("The machine has no states");
+	}
+	if (outputs)
+	{
+		outputs->resize(streams.entries.size());
+	}
+	const uint32_t* table = machine.table.data();
+	const uint32_t* entries = streams.entries.data();
+	uint32_t* out = outputs ? outputs->data() : nullptr;
+
+	// the active lanes go first; they all take as many steps as the shortest of them has left, then
+	// the finished ones take the next streams or give their place to the last active lane
+	std::array<Lane, MAX_LANES> lane;
+	unsigned laneCount = std::clamp(lanes, 1u, MAX_LANES);
+	unsigned active = 0;
+	size_t next = 0;
+	for (; active < laneCount && next < streamCount; active++, next++)
+	{
+		lane[active] = { 0, streams.offsets[next], streams.offsets[next + 1], next };
+	}
+	while (active != 0)
+	{
+		size_t steps = lane[0].end - lane[0].position;
+		for (unsigned l = 1; l < active; l++)
+		{
+			steps = std::min(steps, lane[l].end - lane[l].position);
+		}
+		out ? Advance<true>(table, entries, out, lane.data(), active, steps)
+			: Advance<false>(table, entries, out, lane.data(), active, steps);
+		for (unsigned l = 0; l < active;)
+		{
+			if (lane[l].position != lane[l].end)
+			{
+				l++;
+				continue;
+			}
+			finals[lane[l].stream] = StateOfRow(machine, lane[l].row);
+			if (next < streamCount)
+			{
+				lane[l] = { 0, streams.offsets[next], streams.offsets[next + 1], next };
+				next++;
+			}
+			else
+			{
+				lane[l] = lane[--active];
+			}
+		}
+	}
+	return finals;
+}
+
+uint32_t RunParallel(const CompiledMachine& machine, const std::vector<uint32_t>& entries, std::vector<uint32_t>* outputs,
+	unsigned threads)
+{
+	if (StateCount(machine) == 0)
+	{
+		throw std::runtime_error("The machine has no states");
+	}
+	if (outputs)
+	{
+		outputs->resize(entries.size());
+	}
+	uint32_t* out = outputs ? outputs->data() : nullptr;
+	size_t count = entries.size();
+	size_t chunkCount = std::clamp<size_t>(count / MIN_CHUNK_SYMBOLS, 1, ThreadCount(threads));
+	auto chunkBegin = [&](size_t chunk) { return count * chunk / chunkCount; };
+
+	// the first chunk runs from the start state alone
+	std::vector<ChunkRun> runs(chunkCount);
+	ParallelFor(chunkCount, threads, [&](size_t begin, size_t end, unsigned) {
+		for (size_t chunk = begin; chunk < end; chunk++)
+		{
+			runs[chunk] = RunChunk(machine, entries.data(), chunkBegin(chunk), chunkBegin(chunk + 1), 0,
+				chunk == 0 ? 1 : StateCount(machine), out);
+		}
+	});
+	// a chunk starts where the chunk before ends
+	std::vector<uint32_t> startRows(chunkCount + 1, 0);
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		startRows[chunk + 1] = runs[chunk].ends[StateOfRow(machine, startRows[chunk])];
+	}
+	if (out)
+	{
+		ParallelFor(chunkCount, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				RunPath(machine.table.data(), entries.data(), chunkBegin(chunk), runs[chunk].metAt, startRows[chunk], out);
+			}
+		});
+	}
+	return StateOfRow(machine, startRows[chunkCount]);
+}
+
+void RunFile(const CompiledMachine& machine, const std::string& inFileName, std::ostream& output, bool finalStatesOnly,
+	unsigned lanes)
+{
+	std::ifstream file;
+	if (inFileName != "-")
+	{
+		file.open(inFileName, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Cannot open file " + inFileName);
+		}
+	}
+	std::istream& input = (inFileName == "-") ? std::cin : file;
+
+	std::string block;
+	std::string line;
+	Streams streams;
+	std::vector<uint32_t> outputs;
+	bool more = true;
+	while (more)
+	{
+		block.clear();
+		while (block.size() < BLOCK_BYTES && (more = static_cast<bool>(std::getline(input, line))))
+		{
+			block.append(line).push_back('\n');
+		}
+		AddBytesRead(block.size());
+		streams.entries.clear();
+		streams.offsets.assign(1, 0);
+		ReadStreams(machine, block, streams);
+		std::vector<uint32_t> finals = RunStreams(machine, streams, finalStatesOnly ? nullptr : &outputs, lanes);
+		WriteResults(machine, streams, finals, outputs, finalStatesOnly, output);
+	}
+	if (input.bad())
+	{
+		throw std::runtime_error("Cannot read file " + inFileName);
+	}
+}
+
+void RunFileParallel(const CompiledMachine& machine, const std::string& inFileName, std::ostream& output,
+	bool finalStatesOnly, unsigned threads)
+{
+	std::optional<MappedFile> file;
+	std::string input;
+	std::string_view text;
+	if (inFileName == "-")
+	{
+		input.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+		text = input;
+	}
+	else
+	{
+		text = file.emplace(inFileName).Data();
+	}
+	AddBytesRead(text.size());
+	std::vector<uint32_t> entries = ReadStream(machine, text, threads);
+	std::vector<uint32_t> outputs;
+	uint32_t finalState = RunParallel(machine, entries, finalStatesOnly ? nullptr : &outputs, threads);
+	if (finalStatesOnly)
+	{
+		Flush(output, std::string(Name(machine.states, finalState)) + "\n");
+		return;
+	}
+	WriteOutputs(machine, outputs, output, threads);
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+const unsigned DEFAULT_LANES = 8;
+
+// a machine compiled for running: table[row + 2 * entry] is the row of the next state and table[row + 2 * entry + 1]
+// the output of the transition, the row of a state is state * entryCount * 2, so a step is one load from one
+// cache line. A Moore machine outputs the signal of the state it enters, like MooreToMealy
+struct CompiledMachine
+{
+	uint32_t entryCount = 0;
+	std::vector<uint32_t> table;
+	SymbolTable states;
+	SymbolTable entries;
+	SymbolTable outputs;
+};
+
+// input streams packed one after another: stream i is entries[offsets[i], offsets[i + 1])
+struct Streams
+{
+	std::vector<uint32_t> entries;
+	std::vector<size_t> offsets{ 0 };
+};
+
+CompiledMachine CompileMachine(const Mealy& mealy);
+CompiledMachine CompileMachine(const Moore& moore);
+
+// runs every stream from the start state and returns their final states; outputs, when not null, gets the
+// output of every step at the position of its entry. lanes streams advance side by side in one thread, so
+// the table loads of one stream overlap the loads of the others instead of waiting for each other
+std::vector<uint32_t> RunStreams(const CompiledMachine& machine, const Streams& streams, std::vector<uint32_t>* outputs,
+	unsigned lanes = DEFAULT_LANES);
+
+// one long stream on threads (0 - all hardware threads) and its final state. The stream is cut into a chunk
+// per thread, every chunk after the first runs from all states at once: paths that reach the same state merge
+// and once one path is left it writes the outputs. The start state of every chunk then follows from the end
+// of the chunk before, and only the steps before its paths met run again. This pays off for small minimized
+// machines, whose paths meet within a few hundred steps; a machine that never forgets its state, like a
+// counter, costs a path per state
+uint32_t RunParallel(const CompiledMachine& machine, const std::vector<uint32_t>& entries, std::vector<uint32_t>* outputs,
+	unsigned threads = 0);
+
+// every line of the input file ("-" - stdin) is a stream of entry names separated by spaces, tabs or ';';
+// writes a line of output names for every stream, or only the name of its final state
+void RunFile(const CompiledMachine& machine, const std::string& inFileName, std::ostream& output, bool finalStatesOnly,
+	unsigned lanes = DEFAULT_LANES);
+// the whole input file is one stream of names separated by spaces, tabs, ';' or line breaks, run by RunParallel;
+// writes a line of its outputs or the name of its final state
+void RunFileParallel(const CompiledMachine& machine, const std::string& inFileName, std::ostream& output,
+	bool finalStatesOnly, unsigned threads = 0);
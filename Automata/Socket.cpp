@@ -0,0 +1,275 @@
+﻿#include "Socket.h"
+#include <stdexcept>
+#include <utility>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const size_t RECEIVE_BYTES = 1 << 16;
+
+#ifdef _WIN32
+[[noreturn]] void NotSupported()
+{
+	throw std::runtime_error("Unix domain sockets are not supported on this platform");
+}
+#else
+sockaddr_un UnixAddress(const std::string& path)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("Socket path is too long: " + path);
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return address;
+}
+
+Socket UnixSocket()
+{
+	int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error(std::string("Cannot create a socket: ") + std::strerror(errno));
+	}
+	return Socket(descriptor);
+}
+#endif
+}
+
+Socket::Socket(int descriptor)
+	: m_descriptor(descriptor)
+{
+}
+
+Socket::~Socket()
+{
+	Close();
+}
+
+Socket::Socket(Socket&& other) noexcept
+	: m_descriptor(std::exchange(other.m_descriptor, -1))
+{
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_descriptor = std::exchange(other.m_descriptor, -1);
+	}
+	return *this;
+}
+
+bool Socket::IsOpen() const
+{
+	return m_descriptor >= 0;
+}
+
+int Socket::Descriptor() const
+{
+	return m_descriptor;
+}
+
+#ifdef _WIN32
+bool Socket::SendAll(std::string_view) const
+{
+	NotSupported();
+}
+
+size_t Socket::Receive(char*, size_t) const
+{
+	NotSupported();
+}
+
+void Socket::ShutdownRead() const
+{
+}
+
+void Socket::ShutdownWrite() const
+{
+}
+
+void Socket::Close()
+{
+	m_descriptor = -1;
+}
+
+Socket ListenUnix(const std::string&)
+{
+	NotSupported();
+}
+
+Socket ConnectUnix(const std::string&)
+{
+	NotSupported();
+}
+
+Socket AcceptUnix(const Socket&, int)
+{
+	NotSupported();
+}
+#else
+bool Socket::SendAll(std::string_view data) const
+{
+	while (!data.empty())
+	{
+		// MSG_NOSIGNAL where there is one, the server ignores SIGPIPE anyway
+#ifdef MSG_NOSIGNAL
+		ssize_t sent = send(m_descriptor, data.data(), data.size(), MSG_NOSIGNAL);
+#else
+		ssize_t sent = send(m_descriptor, data.data(), data.size(), 0);
+#endif
+		if (sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (sent <= 0)
+		{
+			return false;
+		}
+		data.remove_prefix(static_cast<size_t>(sent));
+	}
+	return true;
+}
+
+size_t Socket::Receive(char* buffer, size_t size) const
+{
+	while (true)
+	{
+		ssize_t received = recv(m_descriptor, buffer, size, 0);
+		if (received >= 0)
+		{
+			return static_cast<size_t>(received);
+		}
+		if (errno != EINTR)
+		{
+			return 0;
+		}
+	}
+}
+
+void Socket::ShutdownRead() const
+{
+	shutdown(m_descriptor, SHUT_RD);
+}
+
+void Socket::ShutdownWrite() const
+{
+	shutdown(m_descriptor, SHUT_WR);
+}
+
+void Socket::Close()
+{
+	if (m_descriptor >= 0)
+	{
+		close(m_descriptor);
+		m_descriptor = -1;
+	}
+}
+
+Socket ListenUnix(const std::string& path)
+{
+	sockaddr_un address = UnixAddress(path);
+	struct stat status;
+	if (stat(path.c_str(), &status) == 0)
+	{
+		if (!S_ISSOCK(status.st_mode))
+		{
+			throw std::runtime_error("Not a socket: " + path);
+		}
+		unlink(path.c_str());
+	}
+
+	Socket listener = UnixSocket();
+	if (bind(listener.Descriptor(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(listener.Descriptor(), SOMAXCONN) != 0)
+	{
+		throw std::runtime_error("Cannot listen on " + path + ": " + std::strerror(errno));
+	}
+	return listener;
+}
+
+Socket ConnectUnix(const std::string& path)
+{
+	sockaddr_un address = UnixAddress(path);
+	Socket socket = UnixSocket();
+	if (connect(socket.Descriptor(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		throw std::runtime_error("Cannot connect to " + path + ": " + std::strerror(errno));
+	}
+	return socket;
+}
+
+Socket AcceptUnix(const Socket& listener, int timeoutMs)
+{
+	pollfd waiting{ listener.Descriptor(), POLLIN, 0 };
+	if (poll(&waiting, 1, timeoutMs) <= 0)
+	{
+		return Socket();
+	}
+	return Socket(accept(listener.Descriptor(), nullptr, nullptr));
+}
+#endif
+
+SocketReader::SocketReader(const Socket& socket)
+	: m_socket(socket)
+{
+}
+
+bool SocketReader::ReadLine(std::string& line)
+{
+	while (true)
+	{
+		size_t end = m_buffer.find('\n', m_position);
+		if (end != std::string::npos)
+		{
+			line.assign(m_buffer, m_position, end - m_position);
+			m_position = end + 1;
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			return true;
+		}
+		if (!Fill())
+		{
+			return false;
+		}
+	}
+}
+
+bool SocketReader::ReadBytes(size_t size, std::string& bytes)
+{
+	while (m_buffer.size() - m_position < size)
+	{
+		if (!Fill())
+		{
+			return false;
+		}
+	}
+	bytes.assign(m_buffer, m_position, size);
+	m_position += size;
+	return true;
+}
+
+// drops what was read already and appends the next block
+bool SocketReader::Fill()
+{
+	m_buffer.erase(0, m_position);
+	m_position = 0;
+	size_t size = m_buffer.size();
+	m_buffer.resize(size + RECEIVE_BYTES);
+	size_t received = m_socket.Receive(m_buffer.data() + size, RECEIVE_BYTES);
+	m_buffer.resize(size + received);
+	return received != 0;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// stream socket in the Unix domain; not available on Windows, where every call throws
+class Socket
+{
+public:
+	Socket() = default;
+	explicit Socket(int descriptor);
+	~Socket();
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	bool IsOpen() const;
+	int Descriptor() const;
+	// false when the peer is gone
+	bool SendAll(std::string_view data) const;
+	// 0 at the end of the stream
+	size_t Receive(char* buffer, size_t size) const;
+	// no more reading or writing, wakes up a thread blocked in Receive
+	void ShutdownRead() const;
+	void ShutdownWrite() const;
+	void Close();
+
+private:
+	int m_descriptor = -1;
+};
+
+// replaces a stale socket file at the path
+Socket ListenUnix(const std::string& path);
+Socket ConnectUnix(const std::string& path);
+// waits up to timeoutMs for a connection, returns a closed socket when none came
+Socket AcceptUnix(const Socket& listener, int timeoutMs);
+
+// line and block reads over a socket
+class SocketReader
+{
+public:
+	explicit SocketReader(const Socket& socket);
+	// line without '\n' and '\r', false at the end of the stream
+	bool ReadLine(std::string& line);
+	// false when the stream ends first
+	bool ReadBytes(size_t size, std::string& bytes);
+
+private:
+	bool Fill();
+
+	const Socket& m_socket;
+	std::string m_buffer;
+	size_t m_position = 0;
+};
@@ -0,0 +1,195 @@
+﻿#include "Sparse.h"
+#include "Minimization.h"
+#include "Refinement.h"
+#include "Stats.h"
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+// the states reachable from the start state 0 in their order and the new index of every state (NO_ID - unreachable)
+template <typename Sparse>
+std::vector<uint32_t> FindReachable(const Sparse& automaton, std::vector<uint32_t>& newIndexes)
+{
+	newIndexes.assign(StateCount(automaton), NO_ID);
+	std::vector<uint32_t> queue{ 0 };
+	newIndexes[0] = 0;
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		uint32_t state = queue[head];
+		for (uint32_t t = automaton.offsets[state]; t < automaton.offsets[state + 1]; t++)
+		{
+			if (newIndexes[automaton.targets[t]] == NO_ID)
+			{
+				newIndexes[automaton.targets[t]] = 0;
+				queue.push_back(automaton.targets[t]);
+			}
+		}
+	}
+
+	std::vector<uint32_t> reachable;
+	reachable.reserve(queue.size());
+	for (uint32_t state = 0; state < StateCount(automaton); state++)
+	{
+		if (newIndexes[state] != NO_ID)
+		{
+			newIndexes[state] = static_cast<uint32_t>(reachable.size());
+			reachable.push_back(state);
+		}
+	}
+	if (Stats* stats = CurrentStats())
+	{
+		stats->unreachableStateCount += StateCount(automaton) - static_cast<uint32_t>(reachable.size());
+	}
+	return reachable;
+}
+
+// the states of the list with their transitions, targets are given by newIndexes; addTransition(t) copies
+// whatever else the machine keeps of transition t
+template <typename Sparse, typename AddTransition>
+void CopyStates(const Sparse& automaton, const std::vector<uint32_t>& states, const std::vector<uint32_t>& newIndexes,
+	Sparse& copy, AddTransition addTransition)
+{
+	for (uint32_t state : states)
+	{
+		for (uint32_t t = automaton.offsets[state]; t < automaton.offsets[state + 1]; t++)
+		{
+			copy.labels.push_back(automaton.labels[t]);
+			copy.targets.push_back(newIndexes[automaton.targets[t]]);
+			addTransition(t);
+		}
+		copy.offsets.push_back(static_cast<uint32_t>(copy.targets.size()));
+	}
+}
+
+SparseMealy DeleteUnreachableStates(const SparseMealy& mealy)
+{
+	std::vector<uint32_t> newIndexes;
+	std::vector<uint32_t> reachable = FindReachable(mealy, newIndexes);
+	SparseMealy kept;
+	kept.entries = mealy.entries;
+	kept.outputs = mealy.outputs;
+	for (uint32_t state : reachable)
+	{
+		Append(kept.states, Name(mealy.states, state));
+	}
+	CopyStates(mealy, reachable, newIndexes, kept, [&](uint32_t t) { kept.outs.push_back(mealy.outs[t]); });
+	return kept;
+}
+
+SparseMoore DeleteUnreachableStates(const SparseMoore& moore)
+{
+	std::vector<uint32_t> newIndexes;
+	std::vector<uint32_t> reachable = FindReachable(moore, newIndexes);
+	SparseMoore kept;
+	kept.entries = moore.entries;
+	kept.outputs = moore.outputs;
+	for (uint32_t state : reachable)
+	{
+		Append(kept.states, Name(moore.states, state));
+		kept.outs.push_back(moore.outs[state]);
+	}
+	CopyStates(moore, reachable, newIndexes, kept, [](uint32_t) {});
+	return kept;
+}
+
+// the first state of every class
+std::vector<uint32_t> FindRepresentatives(const std::vector<uint32_t>& classes)
+{
+	std::vector<uint32_t> representatives(CountClasses(classes), NO_ID);
+	for (uint32_t state = 0; state < classes.size(); state++)
+	{
+		if (representatives[classes[state]] == NO_ID)
+		{
+			representatives[classes[state]] = state;
+		}
+	}
+	return representatives;
+}
+
+// ids of the pairs {entry, output} of the transitions in the order they are met
+uint32_t LabelPairs(const SparseMealy& mealy, std::vector<uint32_t>& labels)
+{
+	std::unordered_map<uint64_t, uint32_t> ids;
+	labels.resize(mealy.targets.size());
+	for (size_t t = 0; t < labels.size(); t++)
+	{
+		uint64_t pair = uint64_t(mealy.labels[t]) << 32 | mealy.outs[t];
+		labels[t] = ids.emplace(pair, static_cast<uint32_t>(ids.size())).first->second;
+	}
+	return static_cast<uint32_t>(ids.size());
+}
+
+// ids of the output signals of the states in the order they are met
+uint32_t GroupByOutputs(const SparseMoore& moore, std::vector<uint32_t>& classes)
+{
+	std::vector<uint32_t> ids(SymbolCount(moore.outputs), NO_ID);
+	uint32_t classCount = 0;
+	classes.resize(StateCount(moore));
+	for (uint32_t state = 0; state < StateCount(moore); state++)
+	{
+		uint32_t& id = ids[moore.outs[state]];
+		id = (id == NO_ID) ? classCount++ : id;
+		classes[state] = id;
+	}
+	return classCount;
+}
+}
+
+SparseMealy MinimizedSparseMealy(SparseMealy mealy)
+{
+	if (StateCount(mealy) == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	mealy = InPhase("reachability", [&] { return DeleteUnreachableStates(mealy); });
+
+	// one starting class, the outputs are in the labels of the transitions
+	std::vector<uint32_t> classes = InPhase("refinement", [&] {
+		std::vector<uint32_t> labels;
+		uint32_t labelCount = LabelPairs(mealy, labels);
+		return RefinePartial(mealy.offsets, mealy.targets, labels, labelCount,
+			std::vector<uint32_t>(StateCount(mealy), 0), 1);
+	});
+
+	return InPhase("build", [&] {
+		std::vector<uint32_t> representatives = FindRepresentatives(classes);
+		SparseMealy minMealy;
+		minMealy.states = NumberedSymbols("X", static_cast<uint32_t>(representatives.size()));
+		minMealy.entries = mealy.entries;
+		minMealy.outputs = mealy.outputs;
+		CopyStates(mealy, representatives, classes, minMealy, [&](uint32_t t) { minMealy.outs.push_back(mealy.outs[t]); });
+		return minMealy;
+	});
+}
+
+SparseMoore MinimizedSparseMoore(SparseMoore moore)
+{
+	if (StateCount(moore) == 0)
+	{
+		throw std::runtime_error("Automata has no states");
+	}
+	moore = InPhase("reachability", [&] { return DeleteUnreachableStates(moore); });
+
+	// states with equal output signals form the starting partition
+	std::vector<uint32_t> classes = InPhase("refinement", [&] {
+		std::vector<uint32_t> initialClasses;
+		uint32_t groupCount = GroupByOutputs(moore, initialClasses);
+		return RefinePartial(moore.offsets, moore.targets, moore.labels, EntryCount(moore), initialClasses, groupCount);
+	});
+
+	return InPhase("build", [&] {
+		std::vector<uint32_t> representatives = FindRepresentatives(classes);
+		SparseMoore minMoore;
+		minMoore.states = NumberedSymbols("X", static_cast<uint32_t>(representatives.size()));
+		minMoore.entries = moore.entries;
+		minMoore.outputs = moore.outputs;
+		for (uint32_t state : representatives)
+		{
+			minMoore.outs.push_back(moore.outs[state]);
+		}
+		CopyStates(moore, representatives, classes, minMoore, [](uint32_t) {});
+		return minMoore;
+	});
+}
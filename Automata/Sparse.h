@@ -0,0 +1,56 @@
+﻿#pragma once
+#include "Automaton.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Partial machines stored by their defined transitions only, so that the memory grows with the transitions and
+// not with states * entries: the transitions of state s are [offsets[s], offsets[s + 1]) in the order of their
+// entries, an entry without a transition of the state is undefined in it. An undefined transition differs from
+// every defined one, states are equivalent when they define the same entries and these lead to equivalent states
+// with equal outputs.
+
+// the csv cell of an undefined transition; an empty cell and the missing cells at the end of a row are undefined too
+const std::string UNDEFINED_CELL = "-";
+
+struct SparseMealy
+{
+	SymbolTable states;
+	SymbolTable entries;
+	SymbolTable outputs;
+	std::vector<uint32_t> offsets{ 0 };
+	std::vector<uint32_t> labels; // labels[t] -> entry of the transition
+	std::vector<uint32_t> targets;
+	std::vector<uint32_t> outs; // outs[t] -> output symbol
+};
+
+struct SparseMoore
+{
+	SymbolTable states;
+	SymbolTable entries;
+	SymbolTable outputs;
+	std::vector<uint32_t> outs; // outs[state] -> output symbol
+	std::vector<uint32_t> offsets{ 0 };
+	std::vector<uint32_t> labels; // labels[t] -> entry of the transition
+	std::vector<uint32_t> targets;
+};
+
+// the csv files of Mealy and Moore machines with undefined cells, parsed like ReadMealy and ReadMoore
+SparseMealy ReadSparseMealy(const std::string& inFileName, unsigned threads = 0);
+SparseMoore ReadSparseMoore(const std::string& inFileName, unsigned threads = 0);
+SparseMealy ParseSparseMealy(std::string_view text, unsigned threads = 0);
+SparseMoore ParseSparseMoore(std::string_view text, unsigned threads = 0);
+// undefined transitions are written as UNDEFINED_CELL
+void WriteSparseMealy(const SparseMealy& mealy, const std::string& outFileName, unsigned threads = 0);
+void WriteSparseMoore(const SparseMoore& moore, const std::string& outFileName, unsigned threads = 0);
+void WriteSparseMealy(const SparseMealy& mealy, std::ostream& output, unsigned threads = 0);
+void WriteSparseMoore(const SparseMoore& moore, std::ostream& output, unsigned threads = 0);
+
+// minimal machine of the states reachable from the start, refined by RefinePartial over the defined transitions:
+// the transitions of a Mealy machine are labeled by their pairs {entry, output}, the states of a Moore machine
+// start grouped by their outputs. One state per class, named X0, X1, ... in the order of RefinePartial, so a
+// machine without undefined transitions gets the result of MinimizedMealy and MinimizedMoore. Throws for a
+// machine without states
+SparseMealy MinimizedSparseMealy(SparseMealy mealy);
+SparseMoore MinimizedSparseMoore(SparseMoore moore);
@@ -0,0 +1,142 @@
+﻿#include "Stats.h"
+#include "Alphabet.h"
+#include "ProcessInfo.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+thread_local Stats* currentStats = nullptr;
+
+// allocations are counted only while some scope collects stats
+std::atomic<int> countingScopes{ 0 };
+std::atomic<uint64_t> allocationCount{ 0 };
+
+double WallSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+void CountAllocation() noexcept
+{
+	if (countingScopes.load(std::memory_order_relaxed) != 0)
+	{
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+Stats* CurrentStats()
+{
+	return currentStats;
+}
+
+StatsScope::StatsScope(Stats* stats)
+	: m_stats(stats)
+	, m_previous(currentStats)
+{
+	currentStats = stats;
+	if (stats)
+	{
+		countingScopes.fetch_add(1);
+		m_allocations = allocationCount.load();
+	}
+}
+
+StatsScope::~StatsScope()
+{
+	if (m_stats)
+	{
+		m_stats->allocationCount += allocationCount.load() - m_allocations;
+		countingScopes.fetch_sub(1);
+		m_stats->peakResidentBytes = PeakResidentBytes();
+	}
+	currentStats = m_previous;
+}
+
+StatsPhase::StatsPhase(const char* name)
+	: m_stats(currentStats)
+	, m_name(name)
+{
+	if (m_stats)
+	{
+		m_wallStart = WallSeconds();
+		m_cpuStart = CpuSeconds();
+	}
+}
+
+StatsPhase::~StatsPhase()
+{
+	if (m_stats)
+	{
+		m_stats->phases.push_back({ m_name, WallSeconds() - m_wallStart, CpuSeconds() - m_cpuStart });
+	}
+}
+
+bool ReadStatsOption(std::string_view argument, std::string& outFileName)
+{
+	const std::string_view option = "--stats";
+	if (argument == option)
+	{
+		outFileName.clear();
+		return true;
+	}
+	if (argument.starts_with(option) && argument[option.size()] == '=')
+	{
+		outFileName = argument.substr(option.size() + 1);
+		return true;
+	}
+	return false;
+}
+
+void WriteStats(std::ostream& output, const Stats& stats)
+{
+	output << std::fixed << std::setprecision(6) << "{\n  \"phases\": [";
+	for (size_t i = 0; i < stats.phases.size(); i++)
+	{
+		const PhaseStats& phase = stats.phases[i];
+		output << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << phase.name << "\", \"wall_seconds\": " << phase.wallSeconds
+			<< ", \"cpu_seconds\": " << phase.cpuSeconds << "}";
+	}
+	output << (stats.phases.empty() ? "],\n" : "\n  ],\n")
+		<< "  \"refinement_rounds\": " << stats.roundClassCounts.size() << ",\n"
+		<< "  \"round_class_counts\": [";
+	for (size_t i = 0; i < stats.roundClassCounts.size(); i++)
+	{
+		output << (i == 0 ? "" : ", ") << stats.roundClassCounts[i];
+	}
+	output << "],\n"
+		<< "  \"splitters\": " << stats.splitterCount << ",\n"
+		<< "  \"unreachable_states\": " << stats.unreachableStateCount << ",\n"
+		<< "  \"entries\": " << stats.entryCount << ",\n"
+		<< "  \"entry_classes\": " << stats.entryClassCount << ",\n"
+		<< "  \"entry_compression\": " << EntryCompression(stats.entryCount, stats.entryClassCount) << ",\n"
+		<< "  \"bytes_read\": " << stats.bytesRead << ",\n"
+		<< "  \"bytes_written\": " << stats.bytesWritten << ",\n"
+		<< "  \"allocations\": " << stats.allocationCount << ",\n"
+		<< "  \"peak_rss_bytes\": " << stats.peakResidentBytes << "\n"
+		<< "}\n";
+}
+
+void SaveStats(const Stats& stats, const std::string& outFileName)
+{
+	if (outFileName.empty())
+	{
+		WriteStats(std::cerr, stats);
+		return;
+	}
+	std::ostringstream json;
+	WriteStats(json, stats);
+	std::ofstream output(outFileName, std::ios::binary);
+	if (!(output << json.str()))
+	{
+		throw std::runtime_error("Cannot write file " + outFileName);
+	}
+}
@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Statistics of one job. The library records into the Stats a StatsScope has installed on the
+// calling thread; without a scope every hook is a check of one thread_local pointer.
+struct PhaseStats
+{
+	std::string name;
+	double wallSeconds = 0;
+	double cpuSeconds = 0; // all threads of the process
+};
+
+struct Stats
+{
+	std::vector<PhaseStats> phases;
+	std::vector<uint32_t> roundClassCounts; // classes after every round, the Hopcroft and partial engines report one
+	uint64_t splitterCount = 0; // splitters of the Hopcroft and partial engines, which have no rounds
+	uint32_t unreachableStateCount = 0;
+	uint32_t entryCount = 0; // entries of the input machine
+	uint32_t entryClassCount = 0; // entries with distinct columns the engines ran on
+	uint64_t bytesRead = 0;
+	uint64_t bytesWritten = 0;
+	uint64_t allocationCount = 0; // operator new calls of the process while the scope was open
+	size_t peakResidentBytes = 0;
+};
+
+// nullptr when no stats are collected on this thread
+Stats* CurrentStats();
+
+// counts one allocation while some scope collects stats. The library never replaces operator new: the tools
+// link the one of AllocationCounter.cpp, which calls this, and other programs count no allocations
+void CountAllocation() noexcept;
+
+// collects into stats (nothing when nullptr) until destroyed
+class StatsScope
+{
+public:
+	explicit StatsScope(Stats* stats);
+	~StatsScope();
+	StatsScope(const StatsScope&) = delete;
+	StatsScope& operator=(const StatsScope&) = delete;
+
+private:
+	Stats* m_stats;
+	Stats* m_previous;
+	uint64_t m_allocations = 0;
+};
+
+// adds the wall and cpu time from construction to destruction as a phase
+class StatsPhase
+{
+public:
+	explicit StatsPhase(const char* name);
+	~StatsPhase();
+	StatsPhase(const StatsPhase&) = delete;
+	StatsPhase& operator=(const StatsPhase&) = delete;
+
+private:
+	Stats* m_stats;
+	const char* m_name;
+	double m_wallStart = 0;
+	double m_cpuStart = 0;
+};
+
+// runs function as the named phase and returns its result
+template <typename Function>
+auto InPhase(const char* name, Function function)
+{
+	StatsPhase phase(name);
+	return function();
+}
+
+inline void AddBytesRead(uint64_t bytes)
+{
+	if (Stats* stats = CurrentStats())
+	{
+		stats->bytesRead += bytes;
+	}
+}
+
+inline void AddBytesWritten(uint64_t bytes)
+{
+	if (Stats* stats = CurrentStats())
+	{
+		stats->bytesWritten += bytes;
+	}
+}
+
+inline void AddRefinementRound(uint32_t classCount)
+{
+	if (Stats* stats = CurrentStats())
+	{
+		stats->roundClassCounts.push_back(classCount);
+	}
+}
+
+inline void AddEntryClasses(uint32_t entryCount, uint32_t classCount)
+{
+	if (Stats* stats = CurrentStats())
+	{
+		stats->entryCount = entryCount;
+		stats->entryClassCount = classCount;
+	}
+}
+
+// "--stats" or "--stats=file.json", false for any other argument
+bool ReadStatsOption(std::string_view argument, std::string& outFileName);
+void WriteStats(std::ostream& output, const Stats& stats);
+// to the file, or to stderr when the name is empty
+void SaveStats(const Stats& stats, const std::string& outFileName);
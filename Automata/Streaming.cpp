@@ -0,0 +1,385 @@
+﻿#include "Streaming.h"
+#include "Automaton.h"
+#include "Cancellation.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Scanner.h"
+#include "Stats.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+const char DELIMETER = ';';
+const char SLASH = '/';
+// the rows are cut into pieces of this many bytes, every thread translates a run of pieces
+const size_t PIECE_BYTES = 1 << 20;
+const size_t PIECES_PER_THREAD = 4;
+// lines of the header before the first row, for the line numbers of errors
+const size_t HEADER_LINES = 2;
+
+// a state of the header in the open addressing index by name: its name in the mapped file with the first
+// bytes kept in the slot, so short names compare without another cache miss, its column and its output signal
+struct alignas(32) StateSlot
+{
+	const char* name = nullptr;
+	uint64_t prefix = 0;
+	uint32_t size = 0;
+	uint32_t state = NO_ID;
+	uint32_t output = NO_ID;
+};
+
+// the states and output signals of the two header lines; a lookup touches one slot and the name in the file
+// instead of the several tables of a SymbolTable, which matters once the states do not fit in the cache
+struct Header
+{
+	std::vector<std::string_view> states;
+	std::vector<StateSlot> slots;
+	SymbolTable outputs;
+};
+
+// bytes [begin, end) of the rows; column - delimiters between the start of its line and begin,
+// line - line breaks before begin
+struct Piece
+{
+	size_t begin = 0;
+	size_t end = 0;
+	size_t column = 0;
+	size_t line = 0;
+};
+
+void AppendText(std::string& buffer, std::string_view text)
+{
+	buffer.append(text.data(), text.size());
+}
+
+void Flush(std::ostream& output, const std::string& buffer)
+{
+	output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	if (!output)
+	{
+		throw std::runtime_error("Cannot write the output file");
+	}
+	AddBytesWritten(buffer.size());
+}
+
+// cells of a header line ";name;name;..." without its first cell
+std::vector<std::string_view> ReadHeaderCells(std::string_view line)
+{
+	std::vector<std::string_view> cells;
+	std::string_view cell;
+	NextCell(line, cell);
+	while (NextCell(line, cell))
+	{
+		cells.push_back(cell);
+	}
+	return cells;
+}
+
+size_t HashName(std::string_view name)
+{
+	return std::hash<std::string_view>{}(name);
+}
+
+uint64_t NamePrefix(std::string_view name)
+{
+	uint64_t prefix = 0;
+	std::memcpy(&prefix, name.data(), std::min(name.size(), sizeof(prefix)));
+	return prefix;
+}
+
+// cuts the two header lines off the text; lookups by a repeated name find its first column
+Header ReadHeader(std::string_view& text)
+{
+	std::string_view outLine;
+	std::string_view stateLine;
+	NextLine(text, outLine);
+	NextLine(text, stateLine);
+	std::vector<std::string_view> outCells = ReadHeaderCells(outLine);
+	Header header;
+	header.states = ReadHeaderCells(stateLine);
+	header.states.resize(std::min(header.states.size(), outCells.size()));
+	if (header.states.size() >= NO_ID)
+	{
+		throw std::length_error("Too many states in the header");
+	}
+	size_t capacity = 16;
+	while (capacity * 3 < header.states.size() * 4 + 4)
+	{
+		capacity *= 2;
+	}
+	header.slots.resize(capacity);
+	size_t mask = capacity - 1;
+	for (uint32_t state = 0; state < header.states.size(); state++)
+	{
+		std::string_view name = header.states[state];
+		size_t slot = HashName(name) & mask;
+		while (header.slots[slot].name != nullptr && std::string_view(header.slots[slot].name, header.slots[slot].size) != name)
+		{
+			slot = (slot + 1) & mask;
+		}
+		if (header.slots[slot].name == nullptr)
+		{
+			header.slots[slot] = { name.data(), NamePrefix(name), static_cast<uint32_t>(name.size()), state,
+				Intern(header.outputs, outCells[state]) };
+		}
+	}
+	return header;
+}
+
+// the delimiters and line breaks of every piece are counted in parallel, then the columns and lines
+// at the starts of the pieces follow in one pass over the counts
+std::vector<Piece> CutPieces(std::string_view text, unsigned threads)
+{
+	size_t count = std::max<size_t>(1, (text.size() + PIECE_BYTES - 1) / PIECE_BYTES);
+	std::vector<Piece> pieces(count);
+	std::vector<size_t> tails(count); // delimiters after the last line break of the piece
+	std::vector<size_t> breaks(count);
+	ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned) {
+		for (size_t i = begin; i < end; i++)
+		{
+			pieces[i].begin = i * PIECE_BYTES;
+			pieces[i].end = std::min(text.size(), (i + 1) * PIECE_BYTES);
+			const char* pieceEnd = text.data() + pieces[i].end;
+			for (const char* p = text.data() + pieces[i].begin; (p = FindAny(p, pieceEnd, DELIMETER, '\n')) != pieceEnd; p++)
+			{
+				tails[i] = (*p == '\n') ? 0 : tails[i] + 1;
+				breaks[i] += (*p == '\n') ? 1 : 0;
+			}
+		}
+	});
+	for (size_t i = 1; i < count; i++)
+	{
+		pieces[i].column = (breaks[i - 1] != 0) ? tails[i - 1] : pieces[i - 1].column + tails[i - 1];
+		pieces[i].line = pieces[i - 1].line + breaks[i - 1];
+	}
+	return pieces;
+}
+
+// calls visitCell(line, column, cell) for the cells starting in the piece, column 0 is the entry, and
+// endLine(line, cellCount) after the last cell of a line; empty lines and trailing delimiters make no cells
+template <typename VisitCell, typename EndLine>
+void ScanPiece(std::string_view text, const Piece& piece, VisitCell visitCell, EndLine endLine)
+{
+	const char* data = text.data();
+	const char* textEnd = data + text.size();
+	size_t position = piece.begin;
+	size_t column = piece.column;
+	size_t line = piece.line;
+	if (position != 0 && data[position - 1] != DELIMETER && data[position - 1] != '\n')
+	{
+		// the cell at begin started in the piece before
+		const char* next = FindAny(data + position, textEnd, DELIMETER, '\n');
+		if (next == textEnd)
+		{
+			return;
+		}
+		column = (*next == DELIMETER) ? column + 1 : 0;
+		line += (*next == '\n') ? 1 : 0;
+		position = next - data + 1;
+	}
+	// a delimiter at the very end leaves an empty cell that ends the last line
+	while (position < piece.end || (position == text.size() && piece.end == text.size() && column != 0))
+	{
+		const char* cellEnd = FindAny(data + position, textEnd, DELIMETER, '\n');
+		std::string_view cell(data + position, cellEnd - (data + position));
+		bool lineEnd = cellEnd == textEnd || *cellEnd == '\n';
+		if (lineEnd && !cell.empty() && cell.back() == '\r')
+		{
+			cell.remove_suffix(1);
+		}
+		if (!lineEnd || !cell.empty())
+		{
+			visitCell(line, column, cell);
+		}
+		if (lineEnd && (column != 0 || !cell.empty()))
+		{
+			endLine(line, cell.empty() ? column - 1 : column);
+		}
+		if (cellEnd == textEnd)
+		{
+			break;
+		}
+		column = lineEnd ? 0 : column + 1;
+		line += lineEnd ? 1 : 0;
+		position = cellEnd - data + 1;
+	}
+}
+
+void CheckLine(size_t line, size_t cellCount, uint32_t stateCount)
+{
+	if (cellCount != stateCount)
+	{
+		throw std::runtime_error("Line " + std::to_string(HEADER_LINES + line + 1) + " has " + std::to_string(cellCount)
+			+ " transitions, expected " + std::to_string(stateCount));
+	}
+}
+
+const StateSlot& FindState(const Header& header, std::string_view name)
+{
+	size_t mask = header.slots.size() - 1;
+	uint64_t prefix = NamePrefix(name);
+	for (size_t slot = HashName(name) & mask; header.slots[slot].name != nullptr; slot = (slot + 1) & mask)
+	{
+		const StateSlot& found = header.slots[slot];
+		if (found.prefix == prefix && found.size == name.size()
+			&& (name.size() <= sizeof(prefix) || std::equal(name.begin(), name.end(), found.name)))
+		{
+			return found;
+		}
+	}
+	throw std::runtime_error("Unknown state " + std::string(name));
+}
+
+// runs work(piece, buffer) over batches of pieces in parallel and hands the buffers to write in the order
+// of the pieces; the first error of a batch, in piece order, is rethrown
+template <typename Work, typename Write>
+void ForPieces(const std::vector<Piece>& pieces, unsigned threads, Work work, Write write)
+{
+	threads = ThreadCount(threads);
+	size_t batchSize = size_t(threads) * PIECES_PER_THREAD;
+	std::vector<std::string> buffers(batchSize);
+	std::vector<std::exception_ptr> errors(batchSize);
+	for (size_t batch = 0; batch < pieces.size(); batch += batchSize)
+	{
+		CheckCancelled();
+		size_t batchEnd = std::min(pieces.size(), batch + batchSize);
+		ParallelFor(batchEnd - batch, threads, [&](size_t begin, size_t end, unsigned) {
+			for (size_t i = begin; i < end; i++)
+			{
+				buffers[i].clear();
+				errors[i] = nullptr;
+				try
+				{
+					work(pieces[batch + i], buffers[i]);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+		for (size_t i = 0; i < batchEnd - batch; i++)
+		{
+			if (errors[i])
+			{
+				std::rethrow_exception(errors[i]);
+			}
+			write(buffers[i]);
+		}
+	}
+}
+
+// first pass: the target of every cell, row by row, and the states reachable from state 0 over them
+std::vector<bool> FindReachableColumns(std::string_view text, const std::vector<Piece>& pieces, const Header& header,
+	unsigned threads)
+{
+	uint32_t stateCount = static_cast<uint32_t>(header.states.size());
+	size_t lineCount = pieces.back().line + 1;
+	for (const char* p = text.data() + pieces.back().begin; (p = FindChar(p, text.data() + text.size(), '\n')) != text.data() + text.size(); p++)
+	{
+		lineCount++;
+	}
+	std::vector<uint32_t> targets(lineCount * stateCount, NO_ID);
+	std::vector<uint8_t> rows(lineCount, 0);
+	ForPieces(pieces, threads, [&](const Piece& piece, std::string&) {
+		ScanPiece(text, piece, [&](size_t line, size_t column, std::string_view cell) {
+			if (column == 0)
+			{
+				rows[line] = 1;
+			}
+			else if (column <= stateCount)
+			{
+				targets[line * stateCount + column - 1] = FindState(header, cell).state;
+			}
+		}, [&](size_t line, size_t cellCount) { CheckLine(line, cellCount, stateCount); });
+	}, [](const std::string&) {});
+
+	std::vector<bool> reachable(stateCount, false);
+	std::vector<uint32_t> queue;
+	if (stateCount != 0)
+	{
+		reachable[0] = true;
+		queue.push_back(0);
+	}
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		for (size_t line = 0; line < lineCount; line++)
+		{
+			uint32_t target = rows[line] ? targets[line * stateCount + queue[head]] : NO_ID;
+			if (target != NO_ID && !reachable[target])
+			{
+				reachable[target] = true;
+				queue.push_back(target);
+			}
+		}
+	}
+	return reachable;
+}
+}
+
+void StreamMooreToMealy(const std::string& inFileName, const std::string& outFileName, bool pruneUnreachable,
+	unsigned threads)
+{
+	MappedFile file(inFileName);
+	AddBytesRead(file.Data().size());
+	std::string_view text = file.Data();
+	Header header = ReadHeader(text);
+	uint32_t stateCount = static_cast<uint32_t>(header.states.size());
+	std::vector<Piece> pieces = CutPieces(text, threads);
+	std::vector<bool> keep = pruneUnreachable
+		? InPhase("reachability", [&] { return FindReachableColumns(text, pieces, header, threads); })
+		: std::vector<bool>(stateCount, true);
+
+	std::ofstream output(outFileName);
+	if (!output)
+	{
+		throw std::runtime_error("Cannot open file " + outFileName);
+	}
+	InPhase("convert", [&] {
+		// ";name;name;...\n" of the kept states
+		std::string buffer;
+		for (uint32_t state = 0; state < stateCount; state++)
+		{
+			if (keep[state])
+			{
+				buffer.push_back(DELIMETER);
+				AppendText(buffer, header.states[state]);
+			}
+			if (buffer.size() >= PIECE_BYTES)
+			{
+				Flush(output, buffer);
+				buffer.clear();
+			}
+		}
+		buffer.push_back('\n');
+		Flush(output, buffer);
+
+		// every transition outputs the signal of its target
+		ForPieces(pieces, threads, [&](const Piece& piece, std::string& buffer) {
+			ScanPiece(text, piece, [&](size_t, size_t column, std::string_view cell) {
+				if (column == 0)
+				{
+					AppendText(buffer, cell);
+				}
+				else if (column <= stateCount && keep[column - 1])
+				{
+					buffer.push_back(DELIMETER);
+					AppendText(buffer, cell);
+					buffer.push_back(SLASH);
+					AppendText(buffer, Name(header.outputs, FindState(header, cell).output));
+				}
+			}, [&](size_t line, size_t cellCount) {
+				CheckLine(line, cellCount, stateCount);
+				buffer.push_back('\n');
+			});
+		}, [&](const std::string& buffer) { Flush(output, buffer); });
+		output.flush();
+	});
+}
@@ -0,0 +1,11 @@
+﻿#pragma once
+#include <string>
+
+// Moore csv to Mealy csv without loading the machine: only the names and output signals of the states from
+// the two header lines are kept. The mapped rows are cut into pieces, the pieces are translated in parallel
+// (0 threads - all hardware threads) and written out in order, so memory stays bounded by the header and
+// a batch of pieces. With pruneUnreachable a first pass reads the transitions, one id per cell, to find
+// the states reachable from the start, and only their columns are written.
+// The result is the same as WriteMealy(MooreToMealy(moore)) of the loaded machine, or of its reachable part.
+void StreamMooreToMealy(const std::string& inFileName, const std::string& outFileName, bool pruneUnreachable,
+	unsigned threads = 0);
@@ -0,0 +1,143 @@
+﻿#include "ThreadPool.h"
+#include "Parallel.h"
+#include <utility>
+
+namespace
+{
+// the pool and the worker index of the current thread, to keep nested tasks local
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local unsigned currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+	threads = ThreadCount(threads);
+	for (unsigned worker = 0; worker < threads; worker++)
+	{
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	for (unsigned worker = 0; worker < threads; worker++)
+	{
+		m_workers.emplace_back(&ThreadPool::Work, this, worker);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+	size_t queue;
+	{
+		// counted under the lock the workers wait with, so that no wake-up is lost;
+		// a worker that comes before the push below just looks through the deques again
+		std::lock_guard lock(m_mutex);
+		m_pending++;
+		m_queued++;
+		queue = (currentPool == this) ? currentWorker : m_next++ % m_queues.size();
+	}
+	{
+		std::lock_guard lock(m_queues[queue]->mutex);
+		m_queues[queue]->tasks.push_back(std::move(task));
+	}
+	m_wake.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending == 0; });
+	if (m_error)
+	{
+		std::exception_ptr error = std::exchange(m_error, nullptr);
+		std::rethrow_exception(error);
+	}
+}
+
+unsigned ThreadPool::Size() const
+{
+	return static_cast<unsigned>(m_workers.size());
+}
+
+void ThreadPool::Work(unsigned worker)
+{
+	currentPool = this;
+	currentWorker = worker;
+	std::function<void()> task;
+	while (true)
+	{
+		if (TryPop(worker, task))
+		{
+			std::exception_ptr error;
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			task = nullptr;
+			Finish(error);
+			continue;
+		}
+
+		std::unique_lock lock(m_mutex);
+		m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+		if (m_stopping && m_queued == 0)
+		{
+			return;
+		}
+	}
+}
+
+// own deque from the back, then the others from the front
+bool ThreadPool::TryPop(unsigned worker, std::function<void()>& task)
+{
+	size_t count = m_queues.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		Queue& queue = *m_queues[(worker + i) % count];
+		std::lock_guard lock(queue.mutex);
+		if (queue.tasks.empty())
+		{
+			continue;
+		}
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		m_queued--;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::Finish(std::exception_ptr error)
+{
+	std::lock_guard lock(m_mutex);
+	if (error && !m_error)
+	{
+		m_error = error;
+	}
+	if (--m_pending == 0)
+	{
+		m_done.notify_all();
+	}
+}
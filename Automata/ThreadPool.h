@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker takes tasks from the back of its own deque and, when that is
+// empty, steals from the front of the others. Tasks submitted from outside are dealt round-robin,
+// tasks submitted by a task go to the deque of its worker.
+class ThreadPool
+{
+public:
+	// 0 threads - one per hardware thread
+	explicit ThreadPool(unsigned threads = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void Submit(std::function<void()> task);
+	// blocks until every submitted task has finished, rethrows the first exception a task threw;
+	// not to be called from a task
+	void Wait();
+	unsigned Size() const;
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void Work(unsigned worker);
+	bool TryPop(unsigned worker, std::function<void()>& task);
+	void Finish(std::exception_ptr error);
+
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_wake; // a task was queued or the pool stops
+	std::condition_variable m_done; // the last pending task finished
+	std::atomic<size_t> m_queued{ 0 };
+	size_t m_pending = 0; // submitted and not finished yet, guarded by m_mutex
+	size_t m_next = 0; // queue for the next task from outside, guarded by m_mutex
+	bool m_stopping = false;
+	std::exception_ptr m_error;
+};
@@ -1,474 +1,338 @@
-﻿#include <fstream>
+﻿#include "Automaton.h"
+#include "Batch.h"
+#include "BinaryFormat.h"
+#include "Cache.h"
+#include "Conversion.h"
+#include "Minimization.h"
+#include "Service.h"
+#include "Stats.h"
+#include "Streaming.h"
+#include <algorithm>
 #include <iostream>
-#include <vector>
+#include <optional>
 #include <string>
-#include <sstream>
-#include <set>
-#include <unordered_set>
-#include <queue>
-#include <unordered_map>
+#include <vector>
+#include <stdexcept>
 
 const std::string CONVERSION_TYPE_MEALY_TO_MOORE = "mealy-to-moore";
 const std::string CONVERSION_TYPE_MOORE_TO_MEALY = "moore-to-mealy";
-
-struct Mealy
-{
-	std::vector<std::string> states;
-	std::vector<std::string> entries;
-	std::vector<std::vector<std::pair<std::string, std::string>>> transitions;
-};
-
-struct Moore
+const std::string CONVERSION_TYPE_MEALY_TO_MINIMAL_MOORE = "mealy-to-minimal-moore";
+const std::string CONVERSION_TYPE_MEALY_TO_BINARY = "mealy-to-binary";
+const std::string CONVERSION_TYPE_MOORE_TO_BINARY = "moore-to-binary";
+const std::string CONVERSION_TYPE_BINARY_TO_CSV = "binary-to-csv";
+const std::string BATCH_COMMAND = "batch";
+const std::string SERVE_OPTION = "--serve";
+const std::string JOBS_OPTION = "--jobs";
+const std::string INPUT_FORMAT_OPTION = "--input-format";
+const std::string OUTPUT_FORMAT_OPTION = "--output-format";
+const std::string CACHE_OPTION = "--cache";
+const std::string CACHE_SIZE_OPTION = "--cache-size";
+const std::string STREAM_OPTION = "--stream";
+const std::string STREAM_ALL = "all";
+const std::string STREAM_REACHABLE = "reachable";
+
+struct Options
 {
-	std::vector<std::pair<std::string, std::string>> states;
-	std::vector<std::string> entries;
-	std::vector<std::vector<std::string>> transitions;
+	FileFormat inputFormat = FileFormat::Auto;
+	FileFormat outputFormat = FileFormat::Auto;
+	unsigned jobs = 0; // batch jobs running at once
+	unsigned threads = 0; // parsing, conversion and writing of one job, batch jobs take one each
+	bool stats = false;
+	std::string statsFileName; // stderr when empty
+	std::string cacheDirectory; // no cache when empty
+	uint64_t cacheBytes = DEFAULT_CACHE_BYTES;
+	std::string stream; // "all" or "reachable" states for a streamed moore-to-mealy, the machine is loaded when empty
 };
 
-void ReadMealy(const std::string& inFileName, Mealy& mealy)
+// moore-to-mealy keeps every state and its name, there is nothing to save by caching it
+Moore CachedMealyToMoore(const Mealy& mealy, const Options& options, unsigned threads)
 {
-	std::ifstream input(inFileName);
-
-	// чтение состояний
-	std::string line;
-	std::getline(input, line);
-	std::stringstream ss(line);
-	std::string state;
-	std::getline(ss, state, ';');
-
-	while (std::getline(ss, state, ';'))
+	if (StateCount(mealy) == 0)
 	{
-		mealy.states.push_back(state);
+		throw std::runtime_error("Automata has no states");
 	}
-
-	while (std::getline(input, line))
+	if (options.cacheDirectory.empty())
 	{
-		// чтение входных сигналов
-		std::stringstream ss(line);
-		std::string entry;
-		std::getline(ss, entry, ';');
-		mealy.entries.push_back(entry);
-
-		// чтение переходов
-		std::string transition;
-		std::vector<std::pair<std::string, std::string>> transitions;
-		for (const auto& state : mealy.states)
-		{
-			std::getline(ss, transition, ';');
-			size_t pos = transition.find('/');
-			std::string transitionState = transition.substr(0, pos);
-			std::string transitionOut = transition.substr(pos + 1, transition.size());
-			transitions.push_back(std::make_pair(transitionState, transitionOut));
-		}
-		mealy.transitions.push_back(transitions);
+		return InPhase("convert", [&] { return MealyToMoore(mealy, threads); });
 	}
+	ResultCache cache(options.cacheDirectory, options.cacheBytes);
+	CacheKey key = InPhase("cache-key", [&] { return StructuralKey(mealy, CacheOperation::MealyToMoore); });
+	std::optional<Moore> cached = InPhase("cache-lookup", [&] { return cache.FindMoore(key, mealy.entries, mealy.outputs); });
+	if (cached)
+	{
+		return std::move(*cached);
+	}
+	Moore moore = InPhase("convert", [&] { return MealyToMoore(mealy, threads); });
+	InPhase("cache-store", [&] { cache.StoreMoore(key, moore); });
+	return moore;
+}
+
+void ConvertToMoore(const std::string& inFileName, const std::string& outFileName, const Options& options)
+{
+	Mealy mealy = InPhase("parse", [&] { return LoadMealy(inFileName, options.inputFormat, options.threads); });
+	Moore moore = CachedMealyToMoore(mealy, options, options.threads);
+	InPhase("write", [&] { SaveMoore(moore, outFileName, options.outputFormat, options.threads); });
 }
 
-void WriteMealy(const std::string& outFileName, Mealy mealy)
+// minimizes the mealy machine first, the moore machine of all its pairs is never built
+Moore MinimalMoore(Mealy mealy, const Options& options, unsigned threads)
 {
-	std::ofstream output(outFileName);
+	MinimizeOptions minimizeOptions;
+	minimizeOptions.threads = threads;
+	minimizeOptions.cacheDirectory = options.cacheDirectory;
+	minimizeOptions.cacheBytes = options.cacheBytes;
+	return MealyToMinimalMoore(std::move(mealy), minimizeOptions);
+}
 
-	for (const auto& state : mealy.states)
-	{
-		output << ";" << state;
-	}
-	output << std::endl;
+void ConvertToMinimalMoore(const std::string& inFileName, const std::string& outFileName, const Options& options)
+{
+	Mealy mealy = InPhase("parse", [&] { return LoadMealy(inFileName, options.inputFormat, options.threads); });
+	Moore moore = MinimalMoore(std::move(mealy), options, options.threads);
+	InPhase("write", [&] { SaveMoore(moore, outFileName, options.outputFormat, options.threads); });
+}
 
-	for (size_t i = 0; i < mealy.transitions.size(); i++)
+void ConvertToMealy(const std::string& inFileName, const std::string& outFileName, const Options& options)
+{
+	if (!options.stream.empty())
 	{
-		output << mealy.entries[i] << ";";
-		for (size_t j = 0; j < mealy.transitions[i].size(); j++)
+		if (ResolveFormat(inFileName, options.inputFormat) != FileFormat::Csv
+			|| ResolveFormat(outFileName, options.outputFormat) != FileFormat::Csv)
 		{
-			output << mealy.transitions[i][j].first
-				<< "/" << mealy.transitions[i][j].second;
-			if (j != mealy.transitions[i].size() - 1)
-			{
-				output << ";";
-			}
+			throw std::runtime_error("Streaming reads and writes csv only");
 		}
-		output << std::endl;
+		StreamMooreToMealy(inFileName, outFileName, options.stream == STREAM_REACHABLE, options.threads);
+		return;
 	}
+	Moore moore = InPhase("parse", [&] { return LoadMoore(inFileName, options.inputFormat, options.threads); });
+	Mealy mealy = InPhase("convert", [&] { return MooreToMealy(moore); });
+	InPhase("write", [&] { SaveMealy(mealy, outFileName, options.outputFormat, options.threads); });
 }
 
-void ReadMoore(const std::string& inFileName, Moore& moore)
+// csv <-> binary without changing the machine
+template <typename Read, typename Write>
+void Copy(Read read, Write write, const std::string& inFileName, const std::string& outFileName)
 {
-	std::ifstream input(inFileName);
-
-	// чтение состояний
-	std::string outString;
-	std::string stateString;
-
-	std::getline(input, outString);
-	std::getline(input, stateString);
-
-	std::stringstream ssOut(outString);
-	std::stringstream ssState(stateString);
-
-	std::string out;
-	std::getline(ssOut, out, ';');
-	std::string state;
-	std::getline(ssState, state, ';');
-
-	while (std::getline(ssOut, out, ';') && std::getline(ssState, state, ';'))
-	{
-		moore.states.push_back(std::make_pair(state, out));
-	}
-
-	std::string line;
-	while (std::getline(input, line))
-	{
-		// чтение входных сигналов
-		std::stringstream ss(line);
-		std::string entry;
-		std::getline(ss, entry, ';');
-		moore.entries.push_back(entry);
+	auto automaton = InPhase("parse", [&] { return read(inFileName); });
+	InPhase("write", [&] { write(automaton, outFileName); });
+}
 
-		// чтение переходов
-		std::string transition;
-		std::vector<std::string> transitions;
-		for (const auto& state : moore.states)
-		{
-			std::getline(ss, transition, ';');
-			transitions.push_back(transition);
-		}
-		moore.transitions.push_back(transitions);
-	}
+void ConvertToBinary(const std::string& automataType, const std::string& inFileName, const std::string& outFileName,
+	unsigned threads)
+{
+	(automataType == CONVERSION_TYPE_MEALY_TO_BINARY) ?
+		Copy([threads](const std::string& fileName) { return ReadMealy(fileName, threads); },
+			[](const Mealy& mealy, const std::string& fileName) { WriteBinaryMealy(mealy, fileName); },
+			inFileName, outFileName) :
+		Copy([threads](const std::string& fileName) { return ReadMoore(fileName, threads); },
+			[](const Moore& moore, const std::string& fileName) { WriteBinaryMoore(moore, fileName); },
+			inFileName, outFileName);
 }
 
-void WriteMoore(const std::string& outFileName, Moore moore)
+void ConvertToCsv(const std::string& inFileName, const std::string& outFileName, unsigned threads)
 {
-	std::ofstream output(outFileName);
+	(ReadBinaryKind(inFileName) == AutomatonKind::Mealy) ?
+		Copy([](const std::string& fileName) { return ReadBinaryMealy(fileName); },
+			[threads](const Mealy& mealy, const std::string& fileName) { WriteMealy(mealy, fileName, threads); },
+			inFileName, outFileName) :
+		Copy([](const std::string& fileName) { return ReadBinaryMoore(fileName); },
+			[threads](const Moore& moore, const std::string& fileName) { WriteMoore(moore, fileName, threads); },
+			inFileName, outFileName);
+}
 
-	for (const auto& state : moore.states)
+void Convert(const std::string& convType, const std::string& inFileName, const std::string& outFileName,
+	const Options& options)
+{
+	if (!options.stream.empty() && convType != CONVERSION_TYPE_MOORE_TO_MEALY)
 	{
-		output << ";" << state.second;
+		throw std::runtime_error("Only " + CONVERSION_TYPE_MOORE_TO_MEALY + " can be streamed");
 	}
-	output << std::endl;
-	for (const auto& state : moore.states)
+	if (convType == CONVERSION_TYPE_MEALY_TO_BINARY || convType == CONVERSION_TYPE_MOORE_TO_BINARY)
 	{
-		output << ";" << state.first;
+		ConvertToBinary(convType, inFileName, outFileName, options.threads);
 	}
-	output << std::endl;
-
-	for (size_t i = 0; i < moore.transitions.size(); i++)
+	else if (convType == CONVERSION_TYPE_BINARY_TO_CSV)
 	{
-		output << moore.entries[i] << ";";
-		for (size_t j = 0; j < moore.transitions[i].size(); j++)
-		{
-			output << moore.transitions[i][j];
-			if (j != moore.transitions[i].size() - 1)
-			{
-				output << ";";
-			}
-		}
-		output << std::endl;
+		ConvertToCsv(inFileName, outFileName, options.threads);
 	}
-}
-
-std::vector<std::pair<std::string, std::string>> ExtractMooreStates(const std::vector<std::vector<std::pair<std::string, std::string>>>& mealyTransitions, const std::string& startState)
-{
-	std::set<std::pair<std::string, std::string>> statesForMoore;
-	for (const auto& transitionForOneEntry : mealyTransitions)
+	else if (convType == CONVERSION_TYPE_MEALY_TO_MOORE)
 	{
-		for (const auto& transition : transitionForOneEntry)
-		{
-			statesForMoore.insert(transition);
-		}
+		ConvertToMoore(inFileName, outFileName, options);
 	}
-
-	std::vector<std::pair<std::string, std::string>> statesForMooreVector;
-	bool containsStartState = false;
-	for (const auto& state : statesForMoore)
+	else if (convType == CONVERSION_TYPE_MOORE_TO_MEALY)
 	{
-		statesForMooreVector.push_back(state);
-		if (state.first == startState)
-		{
-			containsStartState = true;
-		}
+		ConvertToMealy(inFileName, outFileName, options);
 	}
-
-	if (!containsStartState)
+	else if (convType == CONVERSION_TYPE_MEALY_TO_MINIMAL_MOORE)
 	{
-		statesForMooreVector.insert(statesForMooreVector.begin(), std::make_pair(startState, ""));
+		ConvertToMinimalMoore(inFileName, outFileName, options);
+	}
+	else
+	{
+		throw std::runtime_error("Invalid type of conversion");
 	}
-
-	return statesForMooreVector;
 }
 
-std::unordered_set<size_t> FindReachableStates(const Mealy& mealy)
+// returns false when some job failed
+bool ConvertBatch(const std::string& manifestFileName, const Options& options)
 {
-	std::unordered_set<std::string> reachableStates;
-	std::queue<std::string> queue;
-	queue.push(mealy.states[0]);
-	reachableStates.insert(mealy.states[0]);
-
-	while (!queue.empty())
-	{
-		std::string currentState = queue.front();
-		queue.pop();
+	std::vector<BatchJob> jobs = LoadBatchJobs(manifestFileName);
+	std::vector<BatchResult> results = RunBatch(jobs, options.jobs, [&options](const BatchJob& job) {
+		Convert(job.mode, job.input, job.output, options);
+	});
+	WriteBatchSummary(std::cout, jobs, results);
+	return std::all_of(results.begin(), results.end(), [](const BatchResult& result) { return result.ok; });
+}
 
-		for (size_t i = 0; i < mealy.states.size(); i++)
+// "mealy-to-moore", "moore-to-mealy" and "mealy-to-minimal-moore" requests
+void ServeConvert(const std::string& socketPath, const Options& options)
+{
+	Serve(socketPath, options.jobs, [&options](const ServiceRequest& request, std::ostream& result) {
+		if (!request.parameters.empty())
 		{
-			if (currentState == mealy.states[i])
-			{
-				for (size_t j = 0; j < mealy.entries.size(); j++)
-				{
-					if (!reachableStates.count(mealy.transitions[j][i].first))
-					{
-						queue.push(mealy.transitions[j][i].first);
-						reachableStates.insert(mealy.transitions[j][i].first);
-					}
-				}
-				break;
-			}
+			throw std::runtime_error("Unknown parameter " + request.parameters.begin()->first);
 		}
-	}
-
-	std::unordered_set<size_t> reachableStatesIndexes;
-	for (const auto& reachableState : reachableStates)
-	{
-		for (size_t i = 0; i < mealy.states.size(); i++)
+		if (request.command == CONVERSION_TYPE_MEALY_TO_MOORE)
 		{
-			if (reachableState == mealy.states[i])
-			{
-				reachableStatesIndexes.insert(i);
-				break;
-			}
+			SendMoore(request, CachedMealyToMoore(LoadRequestMealy(request, 1), options, 1), result, 1);
 		}
-	}
-
-	return reachableStatesIndexes;
+		else if (request.command == CONVERSION_TYPE_MOORE_TO_MEALY)
+		{
+			SendMealy(request, MooreToMealy(LoadRequestMoore(request, 1)), result, 1);
+		}
+		else if (request.command == CONVERSION_TYPE_MEALY_TO_MINIMAL_MOORE)
+		{
+			SendMoore(request, MinimalMoore(LoadRequestMealy(request, 1), options, 1), result, 1);
+		}
+		else
+		{
+			throw std::runtime_error("Invalid type of conversion");
+		}
+	});
 }
 
-std::unordered_set<size_t> FindReachableStates(const Moore& moore)
+void WriteBadRequest(const std::string& msg)
 {
-	std::unordered_set<std::string> reachableStates;
-	std::queue<std::string> queue;
-	queue.push(moore.states[0].first);
-	reachableStates.insert(moore.states[0].first);
+	std::cout << msg << std::endl;
+}
 
-	while (!queue.empty())
+// reads "--name value" pairs after the positional arguments
+bool ReadOptions(int argc, char* argv[], int first, Options& options)
+{
+	for (int i = first; i < argc; i += 2)
 	{
-		std::string currentState = queue.front();
-		queue.pop();
-
-		for (size_t i = 0; i < moore.states.size(); i++)
+		if (ReadStatsOption(argv[i], options.statsFileName))
 		{
-			if (currentState == moore.states[i].first)
-			{
-				for (size_t j = 0; j < moore.entries.size(); j++)
-				{
-					if (!reachableStates.count(moore.transitions[j][i]))
-					{
-						queue.push(moore.transitions[j][i]);
-						reachableStates.insert(moore.transitions[j][i]);
-					}
-				}
-				break;
-			}
+			options.stats = true;
+			i--; // the only option without a value
+			continue;
 		}
-	}
-
-	std::unordered_set<size_t> reachableStatesIndexes;
-	for (const auto& reachableState : reachableStates)
-	{
-		for (size_t i = 0; i < moore.states.size(); i++)
+		if (i + 1 >= argc)
 		{
-			if (reachableState == moore.states[i].first)
-			{
-				reachableStatesIndexes.insert(i);
-				break;
-			}
+			return false;
+		}
+		if (argv[i] == INPUT_FORMAT_OPTION)
+		{
+			options.inputFormat = ParseFileFormat(argv[i + 1]);
+		}
+		else if (argv[i] == OUTPUT_FORMAT_OPTION)
+		{
+			options.outputFormat = ParseFileFormat(argv[i + 1]);
+		}
+		else if (argv[i] == JOBS_OPTION)
+		{
+			options.jobs = static_cast<unsigned>(std::stoul(argv[i + 1]));
+		}
+		else if (argv[i] == CACHE_OPTION)
+		{
+			options.cacheDirectory = argv[i + 1];
+		}
+		else if (argv[i] == CACHE_SIZE_OPTION)
+		{
+			options.cacheBytes = ParseByteSize(argv[i + 1]);
+		}
+		else if (argv[i] == STREAM_OPTION && (argv[i + 1] == STREAM_ALL || argv[i + 1] == STREAM_REACHABLE))
+		{
+			options.stream = argv[i + 1];
+		}
+		else
+		{
+			return false;
 		}
 	}
-
-	return reachableStatesIndexes;
+	return true;
 }
 
-void ConvertToMoore(const std::string& inFileName, const std::string& outFileName)
+int main(int argc, char* argv[])
 {
-	Mealy mealy;
-	ReadMealy(inFileName, mealy);
-	Moore moore;
-
-	std::unordered_set<size_t> reachableStates = FindReachableStates(mealy);
-	Mealy filteredMealy;
-	filteredMealy.entries = mealy.entries;
-	filteredMealy.transitions = std::vector<std::vector<std::pair<std::string, std::string>>>(filteredMealy.entries.size());
-	for (const auto& index : reachableStates)
+	bool batch = argc >= 3 && argv[1] == BATCH_COMMAND;
+	bool serve = argc >= 3 && argv[1] == SERVE_OPTION;
+	Options options;
+	// batch jobs run side by side, one thread each
+	options.threads = batch ? 1 : 0;
+	bool validOptions = false;
+	try
 	{
-		filteredMealy.states.push_back(mealy.states[index]);
-		for (size_t i = 0; i < filteredMealy.entries.size(); i++)
-		{
-			filteredMealy.transitions[i].push_back(mealy.transitions[i][index]);
-		}
+		validOptions = (batch || serve)
+			? ReadOptions(argc, argv, 3, options) && !options.stats && !(serve && !options.stream.empty())
+			: argc >= 4 && ReadOptions(argc, argv, 4, options);
 	}
-
-	auto statesForMoore = ExtractMooreStates(filteredMealy.transitions, filteredMealy.states[0]);
-
-	// states for moore
-	for (size_t i = 0; i < statesForMoore.size(); i++)
+	catch (const std::exception&)
 	{
-		moore.states.push_back(std::make_pair("q" + std::to_string(i), statesForMoore[i].second));
 	}
-
-	// entries for moore
-	moore.entries = filteredMealy.entries;
-
-	// transitions for moore
-	std::vector<std::vector<std::string>> transitionsMoore(filteredMealy.transitions.size(),
-		std::vector<std::string>(filteredMealy.transitions[0].size()));
-
-	for (size_t i = 0; i < filteredMealy.transitions.size(); i++)
+	if (!validOptions)
 	{
-		for (size_t j = 0; j < filteredMealy.transitions[0].size(); j++)
-		{
-			size_t k = 0;
-			auto transition = filteredMealy.transitions[i][j];
-
-			for (const auto& state : statesForMoore)
-			{
-				if (transition == state)
-				{
-					transitionsMoore[i][j] = moore.states[k].first;
-				}
-				k++;
-			}
-		}
+		std::cout << "Usage: " << argv[0] << " <conversion-type> <input.csv|.atm> <output.csv|.atm|.h>"
+			<< " [--input-format <csv|binary>] [--output-format <csv|binary|cpp|cpp-switch>] [--stats[=file.json]]"
+			<< " [--cache <directory>] [--cache-size <bytes[K|M|G]>] [--stream <all|reachable>]" << std::endl
+			<< "conversion types: " << CONVERSION_TYPE_MEALY_TO_MOORE << ", " << CONVERSION_TYPE_MOORE_TO_MEALY << ", "
+			<< CONVERSION_TYPE_MEALY_TO_MINIMAL_MOORE << ", "
+			<< CONVERSION_TYPE_MEALY_TO_BINARY << ", " << CONVERSION_TYPE_MOORE_TO_BINARY << ", "
+			<< CONVERSION_TYPE_BINARY_TO_CSV << std::endl
+			<< "       " << argv[0] << " batch <manifest|-> [--jobs <count>] [--input-format <csv|binary>]"
+			<< " [--output-format <csv|binary|cpp|cpp-switch>] [--cache <directory>] [--cache-size <bytes[K|M|G]>] [--stream <all|reachable>]" << std::endl
+			<< "       " << argv[0] << " --serve <socket> [--jobs <count>] [--cache <directory>] [--cache-size <bytes>]" << std::endl
+			<< "manifest lines: <conversion-type> <input> <output>" << std::endl;
+		return 1;
 	}
 
-	std::vector<std::vector<std::string>> transitions(filteredMealy.transitions.size(),
-		std::vector<std::string>(statesForMoore.size()));
-
-	for (size_t i = 0; i < moore.states.size(); i++)
+	if (batch || serve)
 	{
-		for (size_t j = 0; j < moore.entries.size(); j++)
+		try
 		{
-			for (size_t k = 0; k < filteredMealy.states.size(); k++)
+			if (serve)
 			{
-				if (statesForMoore[i].first == filteredMealy.states[k])
-				{
-					transitions[j][i] = transitionsMoore[j][k];
-				}
+				ServeConvert(argv[2], options);
+				return 0;
 			}
+			return ConvertBatch(argv[2], options) ? 0 : 1;
+		}
+		catch (const std::exception& e)
+		{
+			WriteBadRequest(e.what());
+			return 1;
 		}
 	}
 
-	moore.transitions = transitions;
-
-	WriteMoore(outFileName, moore);
-}
-
-std::vector<std::string> split(const std::string& s, char delimiter) {
-	std::vector<std::string> tokens;
-	std::string token;
-	std::istringstream tokenStream(s);
-	while (std::getline(tokenStream, token, delimiter)) {
-		tokens.push_back(token);
-	}
-	return tokens;
-}
-
-void ConvertToMealy(const std::string& inFileName, const std::string& outFileName)
-{
-	//Moore moore;
-	//ReadMoore(inFileName, moore);
-	//Mealy mealy;
-
-	//std::unordered_set<size_t> reachableStates = FindReachableStates(moore);
-	//Moore filteredMoore;
-	//filteredMoore.entries = moore.entries;
-	//filteredMoore.transitions = std::vector<std::vector<std::string>>(filteredMoore.entries.size());
-	//for (const auto& index : reachableStates)
-	//{
-	//	filteredMoore.states.push_back(moore.states[index]);
-	//	for (size_t i = 0; i < filteredMoore.entries.size(); i++)
-	//	{
-	//		filteredMoore.transitions[i].push_back(moore.transitions[i][index]);
-	//	}
-	//}
-
-	//for (const auto& state : filteredMoore.states)
-	//{
-	//	mealy.states.push_back(state.first);
-	//}
-
-	//for (const auto& entry : filteredMoore.entries)
-	//{
-	//	mealy.entries.push_back(entry);
-	//}
-
-	//for (size_t i = 0; i < filteredMoore.transitions.size(); i++)
-	//{
-	//	std::vector<std::pair<std::string, std::string>> transitionForOneEntry;
-	//	for (size_t j = 0; j < filteredMoore.transitions[i].size(); j++)
-	//	{
-	//		for (const auto& state : filteredMoore.states)
-	//		{
-	//			if (state.first == filteredMoore.transitions[i][j])
-	//			{
-	//				transitionForOneEntry.push_back(std::make_pair(state.first, state.second));
-	//				break;
-	//			}
-	//		}
-	//	}
-	//	mealy.transitions.push_back(transitionForOneEntry);
-	//}
-
-	//WriteMealy(outFileName, mealy);
-	std::ifstream file(inFileName);
-	std::ofstream outFile(outFileName);
-	std::string line;
-	std::getline(file, line);
-	std::vector<std::string> tempRowOut = split(line, ';');
-	std::getline(file, line);
-	std::vector<std::string> tempRowStates = split(line, ';');
-
-
-	std::unordered_map<std::string, std::string> stateToOut;
-
-	for (size_t i = 1; i < tempRowOut.size(); ++i)
-	{
-		stateToOut[tempRowStates[i]] = tempRowOut[i]; // выходной символ соответсвующий состоянию
-		outFile << ";" << tempRowStates[i];
-	}
-	outFile << "\n";
+	std::string convType = argv[1];
+	std::string inputFileName = argv[2];
+	std::string outputFileName = argv[3];
 
-	while (std::getline(file, line))
+	Stats stats;
+	try
 	{
-		std::vector<std::string> rowNextSt = split(line, ';');
-		outFile << rowNextSt[0] << ";";
-		for (int i = 1; i < rowNextSt.size(); i++)
 		{
-			outFile << rowNextSt[i] << "/" << stateToOut[rowNextSt[i]] << ";";
+			StatsScope statsScope(options.stats ? &stats : nullptr);
+			Convert(convType, inputFileName, outputFileName, options);
+		}
+		if (options.stats)
+		{
+			SaveStats(stats, options.statsFileName);
 		}
-		outFile << "\n";
 	}
-	file.close();
-	outFile.close();
-}
-
-void WriteBadRequest(const std::string& msg)
-{
-	std::cout << msg << std::endl;
-}
-
-int main(int argc, char* argv[])
-{
-	if (argc != 4)
+	catch (const std::exception& e)
 	{
-		std::cout << "Usage: " << argv[0] << " <conversion-type> <input.csv> <output.csv>" << std::endl;
+		WriteBadRequest(e.what());
 		return 1;
 	}
-
-	std::string convType = argv[1];
-	std::string inputFileName = argv[2];
-	std::string outputFileName = argv[3];
-
-	(convType == CONVERSION_TYPE_MEALY_TO_MOORE) ?
-		ConvertToMoore(inputFileName, outputFileName) :
-		((convType == CONVERSION_TYPE_MOORE_TO_MEALY) ?
-			ConvertToMealy(inputFileName, outputFileName) :
-			WriteBadRequest("Invalid type of conversion"));
 	return 0;
 }
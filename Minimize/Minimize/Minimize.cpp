@@ -1,629 +1,575 @@
-﻿#include <iostream>
+﻿#include "Alphabet.h"
+#include "Analysis.h"
+#include "Automaton.h"
+#include "Batch.h"
+#include "BinaryFormat.h"
+#include "Cache.h"
+#include "Equivalence.h"
+#include "Incremental.h"
+#include "Minimization.h"
+#include "OutOfCore.h"
+#include "Service.h"
+#include "Simulation.h"
+#include "Sparse.h"
+#include "Stats.h"
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <optional>
 #include <string>
 #include <vector>
-#include <fstream>
-#include <sstream>
-#include <unordered_set>
-#include <queue>
-#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
 
 const std::string MEALY_AUTOMATA = "mealy";
 const std::string MOORE_AUTOMATA = "moore";
-const char DELIMETER = ';';
-const char SLASH = '/';
+const std::string ANALYZE_COMMAND = "analyze";
+const std::string EQUIV_COMMAND = "equiv";
+const std::string UPDATE_COMMAND = "update";
+const std::string RUN_COMMAND = "run";
+const std::string FINAL_OPTION = "--final";
+const std::string BATCH_COMMAND = "batch";
+const std::string SERVE_OPTION = "--serve";
+const std::string ALGORITHM_PARAMETER = "algorithm";
+const std::string ALGORITHM_OPTION = "--algorithm";
+const std::string THREADS_OPTION = "--threads";
+const std::string JOBS_OPTION = "--jobs";
+const std::string INPUT_FORMAT_OPTION = "--input-format";
+const std::string OUTPUT_FORMAT_OPTION = "--output-format";
+const std::string CACHE_OPTION = "--cache";
+const std::string CACHE_SIZE_OPTION = "--cache-size";
+const std::string SAVE_PARTITION_OPTION = "--save-partition";
+const std::string MEMORY_OPTION = "--memory";
+const std::string WORK_DIRECTORY_OPTION = "--work-dir";
+
+struct Options
+{
+	MinimizeOptions minimize;
+	unsigned jobs = 0; // batch jobs running at once
+	FileFormat inputFormat = FileFormat::Auto;
+	FileFormat outputFormat = FileFormat::Auto;
+	bool stats = false;
+	std::string statsFileName; // stderr when empty
+	std::string partitionFileName; // machine with its classes for update, none when empty
+	OutOfCoreOptions outOfCore; // a binary input is minimized out of core when its memory is set
+};
 
-namespace std
+// written next to the file and renamed, so that a failed update leaves the old partition
+template <typename Write>
+void ReplaceFile(const std::string& fileName, Write write)
 {
-	template<>
-	struct hash<std::vector<std::string>>
-	{
-		size_t operator()(const std::vector<std::string>& vec) const
-		{
-			std::hash<std::string> hasher;
-			size_t seed = vec.size();
-			for (const auto& str : vec)
-			{
-				seed ^= hasher(str) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-			}
-			return seed;
-		}
-	};
+	std::string temporaryFileName = fileName + ".tmp";
+	write(temporaryFileName);
+	std::filesystem::rename(temporaryFileName, fileName);
 }
 
-namespace std {
-	// Хеш-функция для std::vector<size_t>
-	template<>
-	struct hash<std::vector<size_t>> {
-		size_t operator()(const std::vector<size_t>& vec) const {
-			std::hash<size_t> hasher;
-			size_t seed = vec.size();
-			for (const auto& elem : vec) {
-				seed ^= hasher(elem) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-			}
-			return seed;
-		}
-	};
-
-	// Специализация хеш-функции для std::pair<std::vector<size_t>, size_t>
-	template<>
-	struct hash<std::pair<std::vector<size_t>, size_t>>
+// the runs and the checkpoint of the out-of-core mode go next to the output unless --work-dir says otherwise
+OutOfCoreOptions CheckOutOfCore(const std::string& inFileName, const std::string& outFileName, const Options& options)
+{
+	if (ResolveFormat(inFileName, options.inputFormat) != FileFormat::Binary)
 	{
-		size_t operator()(const std::pair<std::vector<size_t>, size_t>& p) const
-		{
-			auto hash1 = hash<std::vector<size_t>>{}(p.first);
-			auto hash2 = hash<size_t>{}(p.second);
-			return hash1 ^ (hash2 << 1); // Объединение хешей
-		}
-	};
+		throw std::runtime_error("Out-of-core minimization reads binary automata only");
+	}
+	if (!options.minimize.cacheDirectory.empty() || !options.partitionFileName.empty())
+	{
+		throw std::runtime_error("Out-of-core minimization works without a cache and a saved partition");
+	}
+	OutOfCoreOptions outOfCore = options.outOfCore;
+	if (outOfCore.workDirectory.empty())
+	{
+		outOfCore.workDirectory = std::filesystem::path(outFileName).parent_path().string();
+	}
+	return outOfCore;
 }
 
-namespace std
+// --algorithm partial reads csv machines with undefined transitions and writes the minimal ones the same way
+void CheckPartial(const std::string& inFileName, const std::string& outFileName, const Options& options)
 {
-	// Специализация хеш-функции для std::pair<std::vector<std::string>, size_t>
-	template<>
-	struct hash<std::pair<std::vector<std::string>, size_t>>
+	if (ResolveFormat(inFileName, options.inputFormat) != FileFormat::Csv
+		|| ResolveFormat(outFileName, options.outputFormat) != FileFormat::Csv)
 	{
-		size_t operator()(const std::pair<std::vector<std::string>, size_t>& p) const
-		{
-			auto hash1 = hash<std::vector<std::string>>{}(p.first);
-			auto hash2 = hash<size_t>{}(p.second);
-			return hash1 ^ (hash2 << 1); // Объединение хешей
-		}
-	};
+		throw std::runtime_error("Partial minimization reads and writes csv automata only");
+	}
+	if (!options.minimize.cacheDirectory.empty() || !options.partitionFileName.empty() || options.outOfCore.memoryBytes != 0)
+	{
+		throw std::runtime_error("Partial minimization works without a cache, a saved partition and a memory budget");
+	}
 }
 
-struct MealyStateWithTransitions
+void MinimizeMealy(const std::string& inFileName, const std::string& outFileName, const Options& options)
 {
-	std::string currentState;
-	std::vector<std::string> transitions;
-	std::vector<std::string> outs;
-};
-
-struct Mealy
-{
-	std::vector<std::string> entries;
-	std::vector<MealyStateWithTransitions> statesWithTransitions;
-};
-
-struct MooreStateWithTransitions
-{
-	std::string currentState;
-	std::string out;
-	std::vector<std::string> transitions;
-};
+	if (options.minimize.algorithm == RefinementAlgorithm::Partial)
+	{
+		CheckPartial(inFileName, outFileName, options);
+		SparseMealy mealy = InPhase("parse", [&] { return ReadSparseMealy(inFileName, options.minimize.threads); });
+		SparseMealy minMealy = MinimizedSparseMealy(std::move(mealy));
+		InPhase("write", [&] { WriteSparseMealy(minMealy, outFileName, options.minimize.threads); });
+		return;
+	}
+	if (options.outOfCore.memoryBytes != 0)
+	{
+		Mealy minMealy = MinimizedMealyOutOfCore(inFileName, CheckOutOfCore(inFileName, outFileName, options));
+		InPhase("write", [&] { SaveMealy(minMealy, outFileName, options.outputFormat, options.minimize.threads); });
+		return;
+	}
+	Mealy mealy = InPhase("parse", [&] { return LoadMealy(inFileName, options.inputFormat, options.minimize.threads); });
+	if (options.partitionFileName.empty())
+	{
+		Mealy minMealy = MinimizedMealy(std::move(mealy), options.minimize);
+		InPhase("write", [&] { SaveMealy(minMealy, outFileName, options.outputFormat, options.minimize.threads); });
+		return;
+	}
+	Mealy minMealy = MinimizedMealy(mealy, options.minimize);
+	InPhase("write", [&] { SaveMealy(minMealy, outFileName, options.outputFormat, options.minimize.threads); });
+	InPhase("save-partition", [&] {
+		ReplaceFile(options.partitionFileName, [&](const std::string& fileName) {
+			WriteBinaryMealy(mealy, MatchClasses(mealy, minMealy), fileName);
+		});
+	});
+}
 
-struct Moore
+// applies the delta to the machine saved with its partition and minimizes it again from the old classes;
+// the updated machine and classes replace the partition file or go to --save-partition
+void UpdateMealy(const std::string& partitionFileName, const std::string& deltaFileName, const std::string& outFileName,
+	const Options& options)
 {
-	std::vector<std::string> entries;
-	std::vector<MooreStateWithTransitions> statesWithTransitions;
-};
+	std::vector<uint32_t> classes;
+	Mealy mealy = InPhase("parse", [&] { return ReadBinaryMealy(partitionFileName, classes); });
+	std::vector<uint32_t> editedStates = InPhase("delta", [&] { return ApplyDelta(mealy, deltaFileName); });
+	InPhase("refinement", [&] { UpdateClasses(mealy, classes, editedStates, options.minimize.threads); });
+	Mealy minMealy = InPhase("build", [&] { return BuildMinimalMealy(mealy, classes); });
+	InPhase("write", [&] { SaveMealy(minMealy, outFileName, options.outputFormat, options.minimize.threads); });
+	InPhase("save-partition", [&] {
+		ReplaceFile(options.partitionFileName.empty() ? partitionFileName : options.partitionFileName,
+			[&](const std::string& fileName) { WriteBinaryMealy(mealy, classes, fileName); });
+	});
+}
 
-Mealy ReadMealy(const std::string& inFileName)
+void MinimizeMoore(const std::string& inFileName, const std::string& outFileName, const Options& options)
 {
-	Mealy mealy;
-
-	// reading states of mealy
-	std::ifstream input(inFileName);
-	std::string line;
-	std::getline(input, line);
-	std::istringstream ss(line);
-	std::string state;
-	std::getline(ss, state, DELIMETER);
-	while (std::getline(ss, state, DELIMETER))
+	if (options.minimize.algorithm == RefinementAlgorithm::Partial)
 	{
-		mealy.statesWithTransitions.push_back({ state, std::vector<std::string>(), std::vector<std::string>() });
+		CheckPartial(inFileName, outFileName, options);
+		SparseMoore moore = InPhase("parse", [&] { return ReadSparseMoore(inFileName, options.minimize.threads); });
+		SparseMoore minMoore = MinimizedSparseMoore(std::move(moore));
+		InPhase("write", [&] { WriteSparseMoore(minMoore, outFileName, options.minimize.threads); });
+		return;
 	}
-
-	// reading entries and transitions of mealy
-	while (std::getline(input, line))
+	if (options.outOfCore.memoryBytes != 0)
 	{
-		// reading entries of mealy
-		std::stringstream ss1(line);
-		std::string entry;
-		std::getline(ss1, entry, DELIMETER);
-		mealy.entries.push_back(entry);
-
-		// reading transitions of mealy
-		size_t i = 0;
-		std::string transition;
-		while (std::getline(ss1, transition, DELIMETER))
-		{
-			size_t pos = transition.find(SLASH);
-			std::string transitionState = transition.substr(0, pos);
-			std::string transitionOut = transition.substr(pos + 1, transition.size());
-			mealy.statesWithTransitions[i].transitions.push_back(transitionState);
-			mealy.statesWithTransitions[i].outs.push_back(transitionOut);
-			i++;
-		}
+		Moore minMoore = MinimizedMooreOutOfCore(inFileName, CheckOutOfCore(inFileName, outFileName, options));
+		InPhase("write", [&] { SaveMoore(minMoore, outFileName, options.outputFormat, options.minimize.threads); });
+		return;
 	}
-
-	return mealy;
+	Moore moore = InPhase("parse", [&] { return LoadMoore(inFileName, options.inputFormat, options.minimize.threads); });
+	if (options.partitionFileName.empty())
+	{
+		Moore minMoore = MinimizedMoore(std::move(moore), options.minimize);
+		InPhase("write", [&] { SaveMoore(minMoore, outFileName, options.outputFormat, options.minimize.threads); });
+		return;
+	}
+	Moore minMoore = MinimizedMoore(moore, options.minimize);
+	InPhase("write", [&] { SaveMoore(minMoore, outFileName, options.outputFormat, options.minimize.threads); });
+	InPhase("save-partition", [&] {
+		ReplaceFile(options.partitionFileName, [&](const std::string& fileName) {
+			WriteBinaryMoore(moore, MatchClasses(moore, minMoore), fileName);
+		});
+	});
 }
 
-void WriteMealy(const Mealy& mealy, const std::string& outFileName)
+void UpdateMoore(const std::string& partitionFileName, const std::string& deltaFileName, const std::string& outFileName,
+	const Options& options)
 {
-	std::ofstream output(outFileName);
-
-	// writing states of mealy
-	for (const auto& state : mealy.statesWithTransitions)
-	{
-		output << DELIMETER << state.currentState;
-	}
-	output << std::endl;
+	std::vector<uint32_t> classes;
+	Moore moore = InPhase("parse", [&] { return ReadBinaryMoore(partitionFileName, classes); });
+	std::vector<uint32_t> editedStates = InPhase("delta", [&] { return ApplyDelta(moore, deltaFileName); });
+	InPhase("refinement", [&] { UpdateClasses(moore, classes, editedStates, options.minimize.threads); });
+	Moore minMoore = InPhase("build", [&] { return BuildMinimalMoore(moore, classes); });
+	InPhase("write", [&] { SaveMoore(minMoore, outFileName, options.outputFormat, options.minimize.threads); });
+	InPhase("save-partition", [&] {
+		ReplaceFile(options.partitionFileName.empty() ? partitionFileName : options.partitionFileName,
+			[&](const std::string& fileName) { WriteBinaryMoore(moore, classes, fileName); });
+	});
+}
 
-	// writing entries and transitions of mealy
-	for (size_t i = 0; i < mealy.entries.size(); i++)
-	{
-		// writing entry
-		output << mealy.entries[i] << DELIMETER;
+// returns false when some job failed; every job parses, refines and writes on options.minimize.threads,
+// one thread unless --threads says otherwise
+bool MinimizeBatch(const std::string& manifestFileName, const Options& options)
+{
+	std::vector<BatchJob> jobs = LoadBatchJobs(manifestFileName);
+	std::vector<BatchResult> results = RunBatch(jobs, options.jobs, [&options](const BatchJob& job) {
+		if (job.mode == MEALY_AUTOMATA)
+		{
+			MinimizeMealy(job.input, job.output, options);
+		}
+		else if (job.mode == MOORE_AUTOMATA)
+		{
+			MinimizeMoore(job.input, job.output, options);
+		}
+		else
+		{
+			throw std::runtime_error("Invalid type of automata");
+		}
+	});
+	WriteBatchSummary(std::cout, jobs, results);
+	return std::all_of(results.begin(), results.end(), [](const BatchResult& result) { return result.ok; });
+}
 
-		// writing transitions
-		for (size_t j = 0; j < mealy.statesWithTransitions.size(); j++)
+// "mealy" and "moore" requests with the options of the command line, algorithm=<name> picks another engine
+void ServeMinimize(const std::string& socketPath, const Options& options)
+{
+	Serve(socketPath, options.jobs, [&options](const ServiceRequest& request, std::ostream& result) {
+		Options requestOptions = options;
+		for (const auto& [key, value] : request.parameters)
 		{
-			output << mealy.statesWithTransitions[j].transitions[i] << SLASH << mealy.statesWithTransitions[j].outs[i];
-			if (j != mealy.statesWithTransitions.size() - 1)
+			if (key != ALGORITHM_PARAMETER)
 			{
-				output << DELIMETER;
+				throw std::runtime_error("Bad parameter " + key + "=" + value);
 			}
+			requestOptions.minimize.algorithm = ParseRefinementAlgorithm(value);
 		}
-		output << std::endl;
-	}
+		// the request is parsed, minimized and written on the same threads
+		unsigned threads = requestOptions.minimize.threads;
+		if (request.command == MEALY_AUTOMATA)
+		{
+			SendMealy(request, MinimizedMealy(LoadRequestMealy(request, threads), requestOptions.minimize), result, threads);
+		}
+		else if (request.command == MOORE_AUTOMATA)
+		{
+			SendMoore(request, MinimizedMoore(LoadRequestMoore(request, threads), requestOptions.minimize), result, threads);
+		}
+		else
+		{
+			throw std::runtime_error("Invalid type of automata");
+		}
+	});
 }
 
-Moore ReadMoore(const std::string& inFileName)
+void WriteReport(const GraphReport& report)
 {
-	Moore moore;
-
-	std::ifstream input(inFileName);
-
-	// reading output signals of moore
-	std::string outs;
-	std::getline(input, outs);
-	std::istringstream outSs(outs);
-	std::string out;
-	std::getline(outSs, out, DELIMETER);
-
-	// reading states of moore
-	std::string states;
-	std::getline(input, states);
-	std::istringstream stateSs(states);
-	std::string state;
-	std::getline(stateSs, state, DELIMETER);
+	std::cout << "states: " << report.stateCount << std::endl
+		<< "reachable: " << report.reachableCount << std::endl
+		<< "unreachable: " << report.unreachableCount << std::endl
+		<< "components: " << report.componentCount << std::endl
+		<< "largest component: " << report.largestComponent << std::endl
+		<< "trap components: " << report.trapComponentCount << std::endl
+		<< "sink states: " << report.sinkCount << std::endl
+		<< "dead states: " << report.deadCount << std::endl
+		<< "entries: " << report.entryCount << std::endl
+		<< "entry classes: " << report.entryClassCount << std::endl
+		<< "entry compression: " << std::fixed << std::setprecision(2)
+		<< EntryCompression(report.entryCount, report.entryClassCount) << std::endl;
+}
 
-	// pushing the outs and states
-	while (std::getline(outSs, out, DELIMETER) && std::getline(stateSs, state, DELIMETER))
+// returns false when the machines differ
+bool WriteEquivalence(const EquivalenceResult& result, const SymbolTable& entries)
+{
+	if (result.equivalent)
 	{
-		moore.statesWithTransitions.push_back({ state, out, std::vector<std::string>() });
+		std::cout << "equivalent" << std::endl;
+		return true;
 	}
-
-	// reading transition of moore
-	std::string line;
-	while (std::getline(input, line))
+	std::cout << "not equivalent" << std::endl << "word:";
+	for (uint32_t entry : result.word)
 	{
-		// reading entries of mealy
-		std::istringstream ss(line);
-		std::string entry;
-		std::getline(ss, entry, DELIMETER);
-		moore.entries.push_back(entry);
-
-		// reading transitions of mealy
-		size_t i = 0;
-		std::string transition;
-		while (std::getline(ss, transition, DELIMETER))
-		{
-			moore.statesWithTransitions[i].transitions.push_back(transition);
-			i++;
-		}
+		std::cout << " " << Name(entries, entry);
 	}
-
-	return moore;
+	std::cout << std::endl;
+	return false;
 }
 
-void WriteMoore(const Moore& moore, const std::string& outFileName)
+bool CheckEquivalence(const std::string& automataType, const std::string& firstFileName,
+	const std::string& secondFileName)
 {
-	std::ofstream output(outFileName);
-
-	// writing output signals of moore
-	for (const auto& stateWithTransition : moore.statesWithTransitions)
+	if (automataType == MEALY_AUTOMATA)
 	{
-		output << DELIMETER << stateWithTransition.out;
+		Mealy first = LoadMealy(firstFileName);
+		return WriteEquivalence(CheckEquivalence(first, LoadMealy(secondFileName)), first.entries);
 	}
-	output << std::endl;
-
-	// writing states of moore
-	for (const auto& stateWithTransition : moore.statesWithTransitions)
+	if (automataType == MOORE_AUTOMATA)
 	{
-		output << DELIMETER << stateWithTransition.currentState;
-	}
-	output << std::endl;
-
-	// writing transitions of moore
-	for (size_t i = 0; i < moore.entries.size(); i++)
-	{
-		// writing entry
-		output << moore.entries[i] << DELIMETER;
-
-		// writing transitions
-		for (size_t j = 0; j < moore.statesWithTransitions.size(); j++)
-		{
-			output << moore.statesWithTransitions[j].transitions[i];
-			if (j != moore.statesWithTransitions.size() - 1)
-			{
-				output << DELIMETER;
-			}
-		}
-		output << std::endl;
+		Moore first = LoadMoore(firstFileName);
+		return WriteEquivalence(CheckEquivalence(first, LoadMoore(secondFileName)), first.entries);
 	}
+	throw std::runtime_error("Invalid type of automata");
 }
 
-Mealy DeleteUnreachableStates(const Mealy& mealy)
+struct RunOptions
 {
-	Mealy mealyWithoutUnreachableStates;
-	mealyWithoutUnreachableStates.entries = mealy.entries;
-
-	std::unordered_set<std::string> reachableStates;
-	std::queue<std::string> queue;
-	queue.push(mealy.statesWithTransitions[0].currentState);
-	reachableStates.insert(mealy.statesWithTransitions[0].currentState);
+	bool finalStatesOnly = false;
+	std::optional<unsigned> threads; // the whole input is one stream run on this many threads
+};
 
-	while (!queue.empty())
+// reads [--final] [--threads <count>] after the positional arguments of run
+bool ReadRunOptions(int argc, char* argv[], int first, RunOptions& options)
+{
+	for (int i = first; i < argc; i++)
 	{
-		std::string currentState = queue.front();
-		queue.pop();
-
-		for (size_t i = 0; i < mealy.statesWithTransitions.size(); i++)
+		if (argv[i] == FINAL_OPTION)
 		{
-			if (currentState == mealy.statesWithTransitions[i].currentState)
-			{
-				for (size_t j = 0; j < mealy.statesWithTransitions[i].transitions.size(); j++)
-				{
-					if (!reachableStates.count(mealy.statesWithTransitions[i].transitions[j]))
-					{
-						queue.push(mealy.statesWithTransitions[i].transitions[j]);
-						reachableStates.insert(mealy.statesWithTransitions[i].transitions[j]);
-					}
-				}
-				break;
-			}
+			options.finalStatesOnly = true;
 		}
-	}
-
-	for (const auto& reachableState : reachableStates)
-	{
-		for (size_t i = 0; i < mealy.statesWithTransitions.size(); i++)
+		else if (argv[i] == THREADS_OPTION && i + 1 < argc)
 		{
-			if (reachableState == mealy.statesWithTransitions[i].currentState)
-			{
-				mealyWithoutUnreachableStates.statesWithTransitions.push_back(mealy.statesWithTransitions[i]);
-				break;
-			}
+			options.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+		}
+		else
+		{
+			return false;
 		}
 	}
-
-	return mealyWithoutUnreachableStates;
+	return true;
 }
 
-Moore DeleteUnreachableStates(const Moore& moore)
+void RunCompiled(const CompiledMachine& machine, const std::string& inFileName, const RunOptions& options)
 {
-	Moore mooreWithoutUnreachableStates;
-	mooreWithoutUnreachableStates.entries = moore.entries;
-
-	std::unordered_set<std::string> reachableStates;
-	std::queue<std::string> queue;
-	queue.push(moore.statesWithTransitions[0].currentState);
-	reachableStates.insert(moore.statesWithTransitions[0].currentState);
+	options.threads
+		? RunFileParallel(machine, inFileName, std::cout, options.finalStatesOnly, *options.threads)
+		: RunFile(machine, inFileName, std::cout, options.finalStatesOnly);
+}
 
-	while (!queue.empty())
+// runs every line of the input on the machine, or all of it as one stream, and writes the outputs
+// or the final states to stdout
+void RunMachine(const std::string& automataType, const std::string& machineFileName, const std::string& inFileName,
+	const RunOptions& options)
+{
+	if (automataType == MEALY_AUTOMATA)
 	{
-		std::string currentState = queue.front();
-		queue.pop();
-
-		for (size_t i = 0; i < moore.statesWithTransitions.size(); i++)
-		{
-			if (currentState == moore.statesWithTransitions[i].currentState)
-			{
-				for (size_t j = 0; j < moore.statesWithTransitions[i].transitions.size(); j++)
-				{
-					if (!reachableStates.count(moore.statesWithTransitions[i].transitions[j]))
-					{
-						queue.push(moore.statesWithTransitions[i].transitions[j]);
-						reachableStates.insert(moore.statesWithTransitions[i].transitions[j]);
-					}
-				}
-				break;
-			}
-		}
+		RunCompiled(CompileMachine(LoadMealy(machineFileName)), inFileName, options);
+		return;
 	}
-
-	for (const auto& reachableState : reachableStates)
+	if (automataType == MOORE_AUTOMATA)
 	{
-		for (size_t i = 0; i < moore.statesWithTransitions.size(); i++)
-		{
-			if (reachableState == moore.statesWithTransitions[i].currentState)
-			{
-				mooreWithoutUnreachableStates.statesWithTransitions.push_back(moore.statesWithTransitions[i]);
-				break;
-			}
-		}
+		RunCompiled(CompileMachine(LoadMoore(machineFileName)), inFileName, options);
+		return;
 	}
-
-	return mooreWithoutUnreachableStates;
+	throw std::runtime_error("Invalid type of automata");
 }
 
-void MinimizeMealy(const std::string& inFileName, const std::string& outFileName)
+void WriteBadRequest(const std::string& message)
 {
-	Mealy mealy = ReadMealy(inFileName);
-	mealy = DeleteUnreachableStates(mealy);
+	std::cout << message << std::endl;
+}
 
-	// minimization
-	std::unordered_map<std::vector<std::string>, std::vector<MealyStateWithTransitions>> mapOfGroups;
-	for (const auto& state : mealy.statesWithTransitions)
-	{
-		mapOfGroups[state.outs].push_back(state);
-	}
-	std::unordered_multimap<size_t, MealyStateWithTransitions> multimapOfGroups;
-	size_t number = 0;
-	for (const auto& pair : mapOfGroups)
+// reads "--name value" pairs after the positional arguments
+bool ReadOptions(int argc, char* argv[], int first, Options& options)
+{
+	bool algorithmSet = false;
+	for (int i = first; i < argc; i += 2)
 	{
-		for (const auto& state : pair.second)
+		if (ReadStatsOption(argv[i], options.statsFileName))
 		{
-			multimapOfGroups.insert({ number, state });
+			options.stats = true;
+			i--; // the only option without a value
+			continue;
 		}
-		number++;
-	}
-
-	std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MealyStateWithTransitions>> transits;
-	for (const auto& pair : multimapOfGroups)
-	{
-		std::vector<size_t> transitsForOneState;
-		for (const auto& transit : pair.second.transitions)
+		if (i + 1 >= argc)
 		{
-			for (const auto& newPair : multimapOfGroups)
-			{
-				if (transit == newPair.second.currentState)
-				{
-					transitsForOneState.push_back(newPair.first);
-				}
-			}
+			return false;
 		}
-		transits.insert({ pair.first, std::make_pair(transitsForOneState, pair.second) });
-	}
-
-	size_t prevSize = mapOfGroups.size();
-	size_t currSize = 0;
-	std::unordered_map<std::pair<std::vector<size_t>, size_t>, std::vector<MealyStateWithTransitions>> finalMapOfGroups; // key - {transits, number of group}, value - vector of states in this group
-	std::unordered_multimap<size_t, MealyStateWithTransitions> finalMultimap; // key - num of group, value - state with transits
-	std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MealyStateWithTransitions>> finalTransits; // key - num of group, value - {vector of new transits, old state with old transits
-	while (true)
-	{
-		std::unordered_map<std::pair<std::vector<size_t>, size_t>, std::vector<MealyStateWithTransitions>> newMapOfGroups;
-		std::unordered_multimap<size_t, MealyStateWithTransitions> newMultimap;
-		std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MealyStateWithTransitions>> newTransits;
-
-		for (const auto& pair : transits)
+		std::string value = argv[i + 1];
+		if (argv[i] == ALGORITHM_OPTION)
 		{
-			newMapOfGroups[{pair.second.first, pair.first}].push_back(pair.second.second);
+			options.minimize.algorithm = ParseRefinementAlgorithm(value);
+			algorithmSet = true;
 		}
-		size_t newNumber = 0;
-		for (const auto& pair : newMapOfGroups)
+		else if (argv[i] == THREADS_OPTION)
 		{
-			for (const auto& state : pair.second)
-			{
-				newMultimap.insert({ newNumber, state });
-			}
-			newNumber++;
+			options.minimize.threads = static_cast<unsigned>(std::stoul(value));
+			options.minimize.algorithm = algorithmSet ? options.minimize.algorithm : RefinementAlgorithm::Signatures;
 		}
-
-		for (const auto& pair : newMultimap)
+		else if (argv[i] == JOBS_OPTION)
 		{
-			std::vector<size_t> transitsForOneState;
-			for (const auto& transit : pair.second.transitions)
-			{
-				for (const auto& newPair : newMultimap)
-				{
-					if (transit == newPair.second.currentState)
-					{
-						transitsForOneState.push_back(newPair.first);
-					}
-				}
-			}
-			newTransits.insert({ pair.first, std::make_pair(transitsForOneState, pair.second) });
+			options.jobs = static_cast<unsigned>(std::stoul(value));
 		}
-
-		currSize = newMapOfGroups.size();
-		prevSize = mapOfGroups.size();
-
-		if (currSize == prevSize || currSize == mealy.statesWithTransitions.size())
+		else if (argv[i] == INPUT_FORMAT_OPTION)
+		{
+			options.inputFormat = ParseFileFormat(value);
+		}
+		else if (argv[i] == OUTPUT_FORMAT_OPTION)
+		{
+			options.outputFormat = ParseFileFormat(value);
+		}
+		else if (argv[i] == CACHE_OPTION)
+		{
+			options.minimize.cacheDirectory = value;
+		}
+		else if (argv[i] == CACHE_SIZE_OPTION)
+		{
+			options.minimize.cacheBytes = ParseByteSize(value);
+		}
+		else if (argv[i] == SAVE_PARTITION_OPTION)
+		{
+			options.partitionFileName = value;
+		}
+		else if (argv[i] == MEMORY_OPTION)
+		{
+			options.outOfCore.memoryBytes = ParseByteSize(value);
+		}
+		else if (argv[i] == WORK_DIRECTORY_OPTION)
 		{
-			finalMultimap = newMultimap;
-			finalMapOfGroups = newMapOfGroups;
-			finalTransits = newTransits;
-			break;
+			options.outOfCore.workDirectory = value;
 		}
 		else
 		{
-			multimapOfGroups = newMultimap;
-			transits = newTransits;
+			return false;
 		}
 	}
+	return true;
+}
 
-	Mealy minMealy;
-	minMealy.entries = mealy.entries;
-	std::vector<std::vector<MealyStateWithTransitions>> states(finalMapOfGroups.size());
-	for (const auto& pair : finalMultimap)
-	{
-		states[pair.first].push_back(pair.second);
-	}
-	std::vector<std::vector<std::string>> minTransits(states.size());
-	for (const auto& pair : finalTransits)
+int main(int argc, char* argv[])
+{
+	if (argc == 4 && argv[1] == ANALYZE_COMMAND)
 	{
-		std::vector<std::string> minT;
-		for (const auto& t : pair.second.first)
+		std::string automataType = argv[2];
+		try
+		{
+			(automataType == MEALY_AUTOMATA) ?
+				WriteReport(AnalyzeMealy(LoadMealy(argv[3]))) :
+				((automataType == MOORE_AUTOMATA) ?
+					WriteReport(AnalyzeMoore(LoadMoore(argv[3]))) :
+					WriteBadRequest("Invalid type of automata"));
+		}
+		catch (const std::exception& e)
 		{
-			minT.push_back("X" + std::to_string(t));
+			WriteBadRequest(e.what());
+			return 1;
 		}
-		minTransits[pair.first] = minT;
+		return 0;
 	}
-	for (size_t j = 0; j < states.size(); j++)
+
+	if (argc == 5 && argv[1] == EQUIV_COMMAND)
 	{
-		minMealy.statesWithTransitions.push_back({ "X" + std::to_string(j), std::vector<std::string>(), std::vector<std::string>() });
+		try
+		{
+			return CheckEquivalence(argv[2], argv[3], argv[4]) ? 0 : 1;
+		}
+		catch (const std::exception& e)
+		{
+			WriteBadRequest(e.what());
+			return 1;
+		}
 	}
-	for (size_t j = 0; j < states.size(); j++)
+
+	RunOptions runOptions;
+	bool run = false;
+	try
 	{
-		minMealy.statesWithTransitions[j].outs = states[j][0].outs;
-		minMealy.statesWithTransitions[j].transitions = minTransits[j];
+		run = argc >= 5 && argv[1] == RUN_COMMAND && ReadRunOptions(argc, argv, 5, runOptions);
 	}
-
-	WriteMealy(minMealy, outFileName);
-}
-
-void MinimizeMoore(const std::string& inFileName, const std::string& outFileName)
-{
-	Moore moore = ReadMoore(inFileName);
-	moore = DeleteUnreachableStates(moore);
-
-	// minimization
-	std::unordered_map<std::string, std::vector<MooreStateWithTransitions>> mapOfGroups;
-	for (const auto& state : moore.statesWithTransitions)
+	catch (const std::exception&)
 	{
-		mapOfGroups[state.out].push_back(state);
 	}
-	std::unordered_multimap<size_t, MooreStateWithTransitions> multimapOfGroups;
-	size_t number = 0;
-	for (const auto& pair : mapOfGroups)
+	if (run)
 	{
-		for (const auto& state : pair.second)
+		try
 		{
-			multimapOfGroups.insert({ number, state });
+			RunMachine(argv[2], argv[3], argv[4], runOptions);
 		}
-		number++;
-	}
-
-	std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MooreStateWithTransitions>> transits;
-	for (const auto& pair : multimapOfGroups)
-	{
-		std::vector<size_t> transitsForOneState;
-		for (const auto& transit : pair.second.transitions)
+		catch (const std::exception& e)
 		{
-			for (const auto& newPair : multimapOfGroups)
-			{
-				if (transit == newPair.second.currentState)
-				{
-					transitsForOneState.push_back(newPair.first);
-				}
-			}
+			WriteBadRequest(e.what());
+			return 1;
 		}
-		transits.insert({ pair.first, std::make_pair(transitsForOneState, pair.second) });
+		return 0;
 	}
 
-	size_t prevSize = mapOfGroups.size();
-	size_t currSize = 0;
-	std::unordered_map<std::pair<std::vector<size_t>, size_t>, std::vector<MooreStateWithTransitions>> finalMapOfGroups; // key - {transits, number of group}, value - vector of states in this group
-	std::unordered_multimap<size_t, MooreStateWithTransitions> finalMultimap; // key - num of group, value - state with transits
-	std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MooreStateWithTransitions>> finalTransits; // key - num of group, value - {vector of new transits, old state with old transits
-	while (true)
+	bool batch = argc >= 3 && argv[1] == BATCH_COMMAND;
+	bool serve = argc >= 3 && argv[1] == SERVE_OPTION;
+	bool update = argc >= 6 && argv[1] == UPDATE_COMMAND;
+	Options options;
+	// batch jobs and requests run side by side, one thread each unless --threads says otherwise
+	options.minimize.threads = (batch || serve) ? 1 : 0;
+	bool validOptions = false;
+	try
+	{
+		validOptions = (batch || serve)
+			? ReadOptions(argc, argv, 3, options) && !options.stats && options.partitionFileName.empty()
+				&& options.outOfCore.memoryBytes == 0
+			: update ? ReadOptions(argc, argv, 6, options) && options.outOfCore.memoryBytes == 0
+			: argc >= 4 && ReadOptions(argc, argv, 4, options);
+	}
+	catch (const std::exception&)
 	{
-		std::unordered_map<std::pair<std::vector<size_t>, size_t>, std::vector<MooreStateWithTransitions>> newMapOfGroups;
-		std::unordered_multimap<size_t, MooreStateWithTransitions> newMultimap;
-		std::unordered_multimap<size_t, std::pair<std::vector<size_t>, MooreStateWithTransitions>> newTransits;
+	}
+	if (!validOptions)
+	{
+		std::cout << "Usage: " << argv[0] << " <type-of-automata> <input.csv|.atm> <output.csv|.atm|.h>"
+			<< " [--algorithm <hopcroft|signature|reference|partial>] [--threads <count>]"
+			<< " [--input-format <csv|binary>] [--output-format <csv|binary|cpp|cpp-switch>] [--stats[=file.json]]"
+			<< " [--cache <directory>] [--cache-size <bytes[K|M|G]>] [--save-partition <file.atm>]"
+			<< " [--memory <bytes[K|M|G]> [--work-dir <directory>]]" << std::endl
+			<< "       " << argv[0] << " update <type-of-automata> <partition.atm> <delta.txt> <output.csv|.atm|.h>"
+			<< " [--threads <count>] [--output-format <csv|binary|cpp|cpp-switch>] [--stats[=file.json]] [--save-partition <file.atm>]" << std::endl
+			<< "       " << argv[0] << " batch <manifest|-> [--jobs <count>] [options without --stats, --save-partition and --memory]" << std::endl
+			<< "       " << argv[0] << " --serve <socket> [--jobs <count>] [options without --stats, --save-partition and --memory]" << std::endl
+			<< "       " << argv[0] << " analyze <type-of-automata> <input.csv>" << std::endl
+			<< "       " << argv[0] << " equiv <type-of-automata> <first.csv|.atm> <second.csv|.atm>" << std::endl
+			<< "       " << argv[0] << " run <type-of-automata> <machine.csv|.atm> <input.txt|-> [--final] [--threads <count>]" << std::endl
+			<< "manifest lines: <type-of-automata> <input> <output>" << std::endl
+			<< "run input: a line of input names per stream, prints a line of outputs or the final state per stream;"
+			<< " with --threads all of it is one stream run in parallel" << std::endl
+			<< "--memory: out-of-core minimization of a binary input within the budget, its sorted runs and the"
+			<< " checkpoint of every round go to --work-dir (the directory of the output by default)" << std::endl
+			<< "--algorithm partial: csv machines whose undefined transitions are '-', empty or missing cells,"
+			<< " minimized over their defined transitions alone" << std::endl;
+		return 1;
+	}
 
-		for (const auto& pair : transits)
-		{
-			newMapOfGroups[{pair.second.first, pair.first}].push_back(pair.second.second);
-		}
-		size_t newNumber = 0;
-		for (const auto& pair : newMapOfGroups)
+	if (batch || serve)
+	{
+		try
 		{
-			for (const auto& state : pair.second)
+			if (serve)
 			{
-				newMultimap.insert({ newNumber, state });
+				ServeMinimize(argv[2], options);
+				return 0;
 			}
-			newNumber++;
+			return MinimizeBatch(argv[2], options) ? 0 : 1;
 		}
-
-		for (const auto& pair : newMultimap)
+		catch (const std::exception& e)
 		{
-			std::vector<size_t> transitsForOneState;
-			for (const auto& transit : pair.second.transitions)
-			{
-				for (const auto& newPair : newMultimap)
-				{
-					if (transit == newPair.second.currentState)
-					{
-						transitsForOneState.push_back(newPair.first);
-					}
-				}
-			}
-			newTransits.insert({ pair.first, std::make_pair(transitsForOneState, pair.second) });
+			WriteBadRequest(e.what());
+			return 1;
 		}
+	}
 
-		currSize = newMapOfGroups.size();
-		prevSize = mapOfGroups.size();
+	std::string automataType = update ? argv[2] : argv[1];
+	std::string inputFileName = argv[2];
+	std::string outputFileName = argv[3];
 
-		if (currSize == prevSize || currSize == moore.statesWithTransitions.size())
-		{
-			finalMultimap = newMultimap;
-			finalMapOfGroups = newMapOfGroups;
-			finalTransits = newTransits;
-			break;
-		}
-		else
+	Stats stats;
+	try
+	{
 		{
-			multimapOfGroups = newMultimap;
-			transits = newTransits;
+			StatsScope statsScope(options.stats ? &stats : nullptr);
+			if (update)
+			{
+				(automataType == MEALY_AUTOMATA) ?
+					UpdateMealy(argv[3], argv[4], argv[5], options) :
+					((automataType == MOORE_AUTOMATA) ?
+						UpdateMoore(argv[3], argv[4], argv[5], options) :
+						WriteBadRequest("Invalid type of automata"));
+			}
+			else
+			{
+				(automataType == MEALY_AUTOMATA) ?
+					MinimizeMealy(inputFileName, outputFileName, options) :
+					((automataType == MOORE_AUTOMATA) ?
+						MinimizeMoore(inputFileName, outputFileName, options) :
+						WriteBadRequest("Invalid type of automata"));
+			}
 		}
-	}
-
-	Moore minMoore;
-	minMoore.entries = moore.entries;
-	std::vector<std::vector<MooreStateWithTransitions>> states(finalMapOfGroups.size());
-	for (const auto& pair : finalMultimap)
-	{
-		states[pair.first].push_back(pair.second);
-	}
-	std::vector<std::vector<std::string>> minTransits(states.size());
-	for (const auto& pair : finalTransits)
-	{
-		std::vector<std::string> minT;
-		for (const auto& t : pair.second.first)
+		if (options.stats)
 		{
-			minT.push_back("X" + std::to_string(t));
+			SaveStats(stats, options.statsFileName);
 		}
-		minTransits[pair.first] = minT;
-	}
-	for (size_t j = 0; j < states.size(); j++)
-	{
-		minMoore.statesWithTransitions.push_back({ "X" + std::to_string(j), states[j][0].out, std::vector<std::string>() });
 	}
-	for (size_t j = 0; j < states.size(); j++)
+	catch (const std::exception& e)
 	{
-		minMoore.statesWithTransitions[j].transitions = minTransits[j];
-	}
-
-	WriteMoore(minMoore, outFileName);
-}
-
-void WriteBadRequest(const std::string& message)
-{
-	std::cout << message << std::endl;
-}
-
-int main(int argc, char* argv[])
-{
-	if (argc != 4)
-	{
-		std::cout << "Usage: " << argv[0] << " <type-of-automata> <input.csv> <output.csv>" << std::endl;
+		WriteBadRequest(e.what());
 		return 1;
 	}
-
-	std::string automataType = argv[1];
-	std::string inputFileName = argv[2];
-	std::string outputFileName = argv[3];
-
-	(automataType == MEALY_AUTOMATA) ?
-		MinimizeMealy(inputFileName, outputFileName) :
-		((automataType == MOORE_AUTOMATA) ?
-			MinimizeMoore(inputFileName, outputFileName) :
-			WriteBadRequest("Invalid type of automata"));
 	return 0;
-}
\ No newline at end of file
+}